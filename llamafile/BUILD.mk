@@ -30,10 +30,12 @@ o/$(MODE)/llamafile/zipalign:				\
 		o/$(MODE)/llamafile/zipalign.o		\
 		o/$(MODE)/llamafile/help.o		\
 		o/$(MODE)/llamafile/has.o		\
+		o/$(MODE)/llamafile/zipcopy.o		\
 		o/$(MODE)/llamafile/zipalign.1.asc.zip.o
 
 o/$(MODE)/llamafile/zipcheck:				\
 		o/$(MODE)/llamafile/zipcheck.o		\
+		o/$(MODE)/llamafile/zipcopy.o		\
 		o/$(MODE)/llamafile/zip.o		\
 
 o/$(MODE)/llamafile/simple:				\
@@ -44,6 +46,10 @@ o/$(MODE)/llamafile/tokenize:				\
 		o/$(MODE)/llamafile/tokenize.o		\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 
+o/$(MODE)/llamafile/tokenize_bench:			\
+		o/$(MODE)/llamafile/tokenize_bench.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 o/$(MODE)/llamafile/curl:					\
 		o/$(MODE)/llamafile/curl.o			\
 		o/$(MODE)/llama.cpp/llama.cpp.a			\
@@ -57,8 +63,12 @@ o/$(MODE)/llamafile:						\
 		o/$(MODE)/llamafile/zipalign			\
 		o/$(MODE)/llamafile/zipcheck			\
 		o/$(MODE)/llamafile/tokenize			\
+		o/$(MODE)/llamafile/tokenize_bench		\
 		o/$(MODE)/llamafile/addnl			\
 		o/$(MODE)/llamafile/high			\
+		o/$(MODE)/llamafile/bpe_test.runs		\
+		o/$(MODE)/llamafile/core_manager_test.runs	\
+		o/$(MODE)/llamafile/numa_test.runs		\
 		o/$(MODE)/llamafile/datauri_test.runs		\
 		o/$(MODE)/llamafile/parse_cidr_test.runs	\
 		o/$(MODE)/llamafile/pool_cancel_test.runs	\
@@ -123,6 +133,8 @@ o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avxvnni.o: private TARGET_ARCH += -Xx
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avxvnni.o: private TARGET_ARCH += -Xx86_64-mtune=alderlake -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavxvnni
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512f.o: private TARGET_ARCH += -Xx86_64-mtune=cannonlake -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx512f.o: private TARGET_ARCH += -Xx86_64-mtune=cannonlake -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512vnni.o: private TARGET_ARCH += -Xx86_64-mtune=icelake-server -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bw -Xx86_64-mavx512dq
+o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx512vnni.o: private TARGET_ARCH += -Xx86_64-mtune=icelake-server -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bw -Xx86_64-mavx512dq
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
@@ -130,6 +142,7 @@ o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o: private TARGET_ARCH += -Xaarch6
 
 o/$(MODE)/llamafile/sgemm.o: private CXXFLAGS += -Os
 
+o/$(MODE)/llamafile/sgemm_iquant_test.o			\
 o/$(MODE)/llamafile/sgemm_matmul_test.o			\
 o/$(MODE)/llamafile/sgemm_sss_test.o			\
 o/$(MODE)/llamafile/sgemm_vecdot_test.o			\
@@ -138,6 +151,7 @@ o/$(MODE)/llamafile/iqk_mul_mat_amd_zen4.o		\
 o/$(MODE)/llamafile/iqk_mul_mat_arm82.o			\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx2.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx512f.o	\
+o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx512vnni.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avxvnni.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_fma.o	\
@@ -146,6 +160,7 @@ o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm80.o		\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o		\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx2.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512f.o	\
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512vnni.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avxvnni.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_fma.o	\
@@ -196,6 +211,18 @@ o/$(MODE)/llamafile/pool_cancel_test:			\
 		o/$(MODE)/llamafile/crash.o		\
 		o/$(MODE)/llamafile/pool.o		\
 
+o/$(MODE)/llamafile/bpe_test:				\
+		o/$(MODE)/llamafile/bpe_test.o		\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llamafile/core_manager_test:		\
+		o/$(MODE)/llamafile/core_manager_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llamafile/numa_test:				\
+		o/$(MODE)/llamafile/numa_test.o		\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 o/$(MODE)/llamafile/thread_test:			\
 		o/$(MODE)/llamafile/thread_test.o	\
 		o/$(MODE)/llamafile/crash.o		\
@@ -205,6 +232,8 @@ o/$(MODE)/llamafile/sgemm_sss_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_sss_test.o: private CCFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test.o: private CCFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_iquant_test: private LDFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_iquant_test.o: private CCFLAGS += -fopenmp
 
 o/$(MODE)/llamafile/sgemm_sss_test:			\
 		o/$(MODE)/llamafile/sgemm_sss_test.o	\
@@ -218,6 +247,10 @@ o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 		o/$(MODE)/llamafile/sgemm_vecdot_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
 
+o/$(MODE)/llamafile/sgemm_iquant_test:			\
+		o/$(MODE)/llamafile/sgemm_iquant_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
 o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 		private LDFLAGS += -fopenmp
 
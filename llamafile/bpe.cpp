@@ -0,0 +1,843 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bpe.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cosmo.h>
+#include <pthread.h>
+#include <string.h>
+#include <unordered_map>
+
+#include "llama.cpp/cores.h"
+#include "llama.cpp/ggml.h"
+#include "llama.cpp/llama.h"
+#include "llama.cpp/unicode.h"
+#include "llamafile.h"
+#include "log.h"
+#include "pool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define kLetter 1
+#define kNumber 2
+#define kSpace 4
+#define kDefined 8
+
+#define kMaxBpeTokenizers 4
+#define kMaxEncodeThreads 16
+#define kParallelChunkBytes 65536
+
+static const uint32_t kOutOfRange = 0xffffffff;
+
+struct Cpt {
+    uint32_t c;
+    unsigned len;
+    unsigned flags;
+};
+
+static unsigned classify(uint32_t c) {
+    codepoint_flags f = unicode_cpt_flags(c);
+    return (f.is_letter ? kLetter : 0) | //
+           (f.is_number ? kNumber : 0) | //
+           (f.is_whitespace ? kSpace : 0) | //
+           (f.as_uint() ? kDefined : 0);
+}
+
+static unsigned char g_ascii[128];
+static pthread_once_t g_ascii_once = PTHREAD_ONCE_INIT;
+
+static void init_ascii(void) {
+    for (int c = 0; c < 128; ++c)
+        g_ascii[c] = classify(c);
+}
+
+// gpt2 represents each byte of text as a printable codepoint
+static bool is_printable_byte(int b) {
+    return (b >= '!' && b <= '~') || (b >= 0xa1 && b <= 0xac) || (b >= 0xae && b <= 0xff);
+}
+
+static uint32_t byte_to_cpt(int b) {
+    if (is_printable_byte(b))
+        return b;
+    int n = 0;
+    for (int i = 0; i < b; ++i)
+        n += !is_printable_byte(i);
+    return 256 + n;
+}
+
+static bool is_valid_utf8(const unsigned char *p, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+#ifdef __SSE2__
+        while (i + 16 <= n && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i))))
+            i += 16;
+#elif defined(__ARM_NEON)
+        while (i + 16 <= n && vmaxvq_u8(vld1q_u8(p + i)) < 0x80)
+            i += 16;
+#endif
+        if (i == n)
+            break;
+        unsigned c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        unsigned lo = 0x80, hi = 0xbf, k;
+        if (c >= 0xc2 && c <= 0xdf) {
+            k = 1;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            k = 2;
+            if (c == 0xe0)
+                lo = 0xa0;
+            if (c == 0xed)
+                hi = 0x9f;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            k = 3;
+            if (c == 0xf0)
+                lo = 0x90;
+            if (c == 0xf4)
+                hi = 0x8f;
+        } else {
+            return false;
+        }
+        if (n - i <= k || p[i + 1] < lo || p[i + 1] > hi)
+            return false;
+        for (unsigned j = 2; j <= k; ++j)
+            if ((p[i + j] & 0xc0) != 0x80)
+                return false;
+        i += k + 1;
+    }
+    return true;
+}
+
+// returns number of ascii letters at start of string
+static size_t span_ascii_letters(const unsigned char *p, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)), _mm_set1_epi8(0x20));
+        __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+        unsigned mask = _mm_movemask_epi8(m);
+        if (mask != 0xffff)
+            return i + __builtin_ctz(~mask);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vorrq_u8(vld1q_u8(p + i), vdupq_n_u8(0x20));
+        uint8x16_t m = vandq_u8(vcgeq_u8(v, vdupq_n_u8('a')), vcleq_u8(v, vdupq_n_u8('z')));
+        if (vminvq_u8(m) != 0xff)
+            break;
+    }
+#endif
+    while (i < n && (unsigned)((p[i] | 0x20) - 'a') < 26)
+        ++i;
+    return i;
+}
+
+// text must be valid utf-8
+static inline Cpt get_cpt(const unsigned char *s, size_t n, size_t i) {
+    if (i >= n)
+        return {kOutOfRange, 0, 0};
+    unsigned c = s[i];
+    if (c < 0x80)
+        return {c, 1, g_ascii[c]};
+    uint32_t cpt;
+    unsigned len;
+    if (c < 0xe0) {
+        cpt = (c & 31) << 6 | (s[i + 1] & 63);
+        len = 2;
+    } else if (c < 0xf0) {
+        cpt = (c & 15) << 12 | (s[i + 1] & 63) << 6 | (s[i + 2] & 63);
+        len = 3;
+    } else {
+        cpt = (c & 7) << 18 | (s[i + 1] & 63) << 12 | (s[i + 2] & 63) << 6 | (s[i + 3] & 63);
+        len = 4;
+    }
+    return {cpt, len, classify(cpt)};
+}
+
+static inline uint32_t lower(uint32_t c) {
+    if (c < 0x80)
+        return c - 'A' < 26 ? c + 32 : c;
+    return unicode_tolower(c);
+}
+
+static unsigned hash_bytes(std::string_view s) {
+    unsigned h = 2166136261u;
+    for (unsigned char c : s)
+        h = (h ^ c) * 16777619u;
+    return h | 1; // zero means empty slot
+}
+
+static unsigned hash_pair(unsigned long key) {
+    return (key * 0x9e3779b97f4a7c15ul) >> 32;
+}
+
+BpeTokenizer::BpeTokenizer(Split split, const std::vector<std::string> &tokens,
+                           const std::vector<std::string> &merges)
+    : ok_(false), split_(split) {
+    pthread_once(&g_ascii_once, init_ascii);
+
+    // undo the gpt2 byte encoding of token text
+    int cpt_to_byte[512];
+    for (int i = 0; i < 512; ++i)
+        cpt_to_byte[i] = -1;
+    for (int b = 0; b < 256; ++b)
+        cpt_to_byte[byte_to_cpt(b)] = b;
+    offsets_.resize(tokens.size() + 1);
+    std::vector<bool> decodable(tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        offsets_[i] = bytes_.size();
+        std::string_view s = tokens[i];
+        const unsigned char *p = (const unsigned char *)s.data();
+        decodable[i] = is_valid_utf8(p, s.size());
+        for (size_t j = 0; decodable[i] && j < s.size();) {
+            Cpt c = get_cpt(p, s.size(), j);
+            if (c.c >= 512 || cpt_to_byte[c.c] == -1) {
+                decodable[i] = false;
+                bytes_.resize(offsets_[i]);
+            } else {
+                bytes_ += (char)cpt_to_byte[c.c];
+            }
+            j += c.len;
+        }
+    }
+    offsets_[tokens.size()] = bytes_.size();
+
+    // index token text, where the last duplicate wins like llama.cpp
+    size_t cap = 16;
+    while (cap < tokens.size() * 2)
+        cap *= 2;
+    words_.resize(cap);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (!decodable[i])
+            continue;
+        std::string_view s(bytes_.data() + offsets_[i], offsets_[i + 1] - offsets_[i]);
+        unsigned h = hash_bytes(s);
+        for (size_t j = h;; ++j) {
+            Word &w = words_[j & (cap - 1)];
+            if (!w.hash) {
+                w = {h, (int)i};
+                break;
+            }
+            if (w.hash == h && equal(w.id, s)) {
+                w.id = i;
+                break;
+            }
+        }
+    }
+    for (int b = 0; b < 256; ++b) {
+        char c = b;
+        if ((byte_id_[b] = find(std::string_view(&c, 1))) == -1) {
+            tinylogf("bpe: vocabulary is missing byte %d\n", b);
+            return;
+        }
+    }
+
+    // index merge ranks by token id pair, where the first one wins
+    cap = 16;
+    while (cap < merges.size() * 2)
+        cap *= 2;
+    merges_.resize(cap);
+    std::unordered_map<std::string_view, int> by_text;
+    for (size_t i = 0; i < tokens.size(); ++i)
+        if (decodable[i])
+            by_text[tokens[i]] = i;
+    for (size_t rank = 0; rank < merges.size(); ++rank) {
+        const std::string &m = merges[rank];
+        size_t pos = m.find(' ', 1);
+        if (pos == std::string::npos)
+            continue;
+        std::string_view a = std::string_view(m).substr(0, pos);
+        std::string_view b = std::string_view(m).substr(pos + 1);
+        auto ia = by_text.find(a);
+        auto ib = by_text.find(b);
+        if (ia == by_text.end() || ib == by_text.end())
+            continue; // can never be applied
+        auto iab = by_text.find(std::string(a) + std::string(b));
+        if (iab == by_text.end()) {
+            tinylogf("bpe: merge %zu produces token not in vocabulary\n", rank);
+            return;
+        }
+        unsigned long key = (unsigned long)ia->second << 32 | (unsigned)ib->second;
+        for (size_t j = hash_pair(key);; ++j) {
+            Merge &e = merges_[j & (cap - 1)];
+            if (!e.id) {
+                e = {key, (int)rank, iab->second + 1};
+                break;
+            }
+            if (e.key == key)
+                break;
+        }
+    }
+    for (Merge &e : merges_)
+        --e.id;
+    ok_ = true;
+}
+
+/**
+ * Returns id of token whose raw bytes are `s`, or -1 if not found.
+ */
+int BpeTokenizer::find(std::string_view s) const {
+    unsigned h = hash_bytes(s);
+    size_t mask = words_.size() - 1;
+    for (size_t j = h;; ++j) {
+        const Word &w = words_[j & mask];
+        if (!w.hash)
+            return -1;
+        if (w.hash == h && equal(w.id, s))
+            return w.id;
+    }
+}
+
+bool BpeTokenizer::equal(int id, std::string_view s) const {
+    return offsets_[id + 1] - offsets_[id] == s.size() &&
+           !memcmp(bytes_.data() + offsets_[id], s.data(), s.size());
+}
+
+const BpeTokenizer::Merge *BpeTokenizer::lookup(int a, int b) const {
+    unsigned long key = (unsigned long)a << 32 | (unsigned)b;
+    size_t mask = merges_.size() - 1;
+    for (size_t j = hash_pair(key);; ++j) {
+        const Merge &e = merges_[j & mask];
+        if (e.id == -1)
+            return nullptr;
+        if (e.key == key)
+            return &e;
+    }
+}
+
+// calls f(start, end) for each word of valid utf-8 text
+//
+// these are transliterations of unicode_regex_split_custom_gpt2() and
+// unicode_regex_split_custom_llama3() from llama.cpp, operating on byte
+// offsets rather than codepoint indices.
+template <typename F>
+void BpeTokenizer::each_word(std::string_view text, F f) const {
+    const unsigned char *s = (const unsigned char *)text.data();
+    size_t n = text.size();
+    size_t i = 0;
+    auto emit = [&](size_t end) {
+        if (end > i)
+            f(i, end);
+        i = end;
+    };
+    auto get = [&](size_t j) { return get_cpt(s, n, j); };
+    auto letters = [&](size_t j) {
+        for (;;) {
+            j += span_ascii_letters(s + j, n - j);
+            Cpt t = get(j);
+            if (!(t.flags & kLetter))
+                return j;
+            j += t.len;
+        }
+    };
+    auto other = [](const Cpt &t) { // [^\s\p{L}\p{N}]
+        return !(t.flags & (kSpace | kLetter | kNumber)) && (t.flags & kDefined);
+    };
+
+    while (i < n) {
+        Cpt a = get(i);
+
+        if (split_ == LLAMA3) {
+
+            // (?i:'s|'t|'re|'ve|'m|'ll|'d)
+            if (a.c == '\'' && i + 1 < n) {
+                Cpt b = get(i + 1);
+                uint32_t lb = lower(b.c);
+                if (lb == 's' || lb == 't' || lb == 'm' || lb == 'd') {
+                    emit(i + 1 + b.len);
+                    continue;
+                }
+                if (i + 1 + b.len < n) {
+                    Cpt c = get(i + 1 + b.len);
+                    uint32_t lc = lower(c.c);
+                    if ((lb == 'r' && lc == 'e') || (lb == 'v' && lc == 'e') ||
+                        (lb == 'l' && lc == 'l')) {
+                        emit(i + 1 + b.len + c.len);
+                        continue;
+                    }
+                }
+            }
+
+            // [^\r\n\p{L}\p{N}]?\p{L}+
+            if (!(a.c == '\r' || a.c == '\n' || (a.flags & kNumber))) {
+                if ((a.flags & kLetter) || (get(i + a.len).flags & kLetter)) {
+                    emit(letters(i + a.len));
+                    continue;
+                }
+            }
+
+            // \p{N}{1,3}
+            if (a.flags & kNumber) {
+                size_t j = i;
+                int k = 0;
+                for (Cpt t; (t = get(j)).flags & kNumber;) {
+                    j += t.len;
+                    if (++k == 3) {
+                        emit(j);
+                        k = 0;
+                    }
+                }
+                emit(j);
+                continue;
+            }
+
+            // ?[^\s\p{L}\p{N}]+[\r\n]*
+            Cpt b = a.c == ' ' ? get(i + 1) : a;
+            if (!(b.flags & (kSpace | kLetter | kNumber))) {
+                size_t j = i + (a.c == ' ');
+                for (Cpt t; other(t = get(j));)
+                    j += t.len;
+                while (j < n && (s[j] == '\r' || s[j] == '\n'))
+                    ++j;
+                emit(j);
+                continue;
+            }
+
+            // \s*[\r\n]+
+            size_t j = i, last = 0, lastrn = 0, count = 0;
+            for (Cpt t; (t = get(j)).flags & kSpace; ++count) {
+                if (t.c == '\r' || t.c == '\n')
+                    lastrn = j + 1;
+                last = j;
+                j += t.len;
+            }
+            if (lastrn) {
+                emit(lastrn);
+                continue;
+            }
+
+            // \s+(?!\S)
+            if (count > 1 && j < n) {
+                emit(last);
+                continue;
+            }
+
+            // \s+
+            if (count) {
+                emit(j);
+                continue;
+            }
+
+        } else {
+
+            // 's|'t|'re|'ve|'m|'ll|'d
+            if (a.c == '\'' && i + 1 < n) {
+                Cpt b = get(i + 1);
+                if (b.c == 's' || b.c == 't' || b.c == 'm' || b.c == 'd') {
+                    emit(i + 2);
+                    continue;
+                }
+                if (i + 1 + b.len < n) {
+                    Cpt c = get(i + 1 + b.len);
+                    if ((b.c == 'r' && c.c == 'e') || (b.c == 'v' && c.c == 'e') ||
+                        (b.c == 'l' && c.c == 'l')) {
+                        emit(i + 3);
+                        continue;
+                    }
+                }
+            }
+
+            // ?\p{L}+
+            size_t j = i + (a.c == ' ');
+            Cpt b = a.c == ' ' ? get(j) : a;
+            if (b.flags & kLetter) {
+                emit(letters(j));
+                continue;
+            }
+
+            // ?\p{N}+
+            if (b.flags & kNumber) {
+                for (Cpt t; (t = get(j)).flags & kNumber;)
+                    j += t.len;
+                emit(j);
+                continue;
+            }
+
+            // ?[^\s\p{L}\p{N}]+
+            if (other(b)) {
+                for (Cpt t; other(t = get(j));)
+                    j += t.len;
+                emit(j);
+                continue;
+            }
+
+            // \s+(?!\S)
+            size_t last = 0, count = 0;
+            j = i;
+            for (Cpt t; (t = get(j)).flags & kSpace; ++count) {
+                last = j;
+                j += t.len;
+            }
+            if (count > 1 && j < n) {
+                emit(last);
+                continue;
+            }
+
+            // \s+
+            if (count) {
+                emit(j);
+                continue;
+            }
+        }
+
+        // no matches
+        emit(i + a.len);
+    }
+}
+
+// merges bytes of word into tokens, lowest rank first
+void BpeTokenizer::merge(std::string_view word, std::vector<int> *out) const {
+    struct Symbol {
+        int id; // or -1 if merged into left neighbor
+        int prev;
+        int next;
+    };
+    struct Bigram {
+        int rank;
+        int left;
+        int right;
+        int left_id;
+        int right_id;
+        bool operator<(const Bigram &b) const {
+            return rank > b.rank || (rank == b.rank && left > b.left);
+        }
+    };
+
+    if (split_ == LLAMA3) {
+        int id = find(word);
+        if (id != -1) {
+            out->push_back(id);
+            return;
+        }
+    }
+    if (word.size() == 1) {
+        out->push_back(byte_id_[(unsigned char)word[0]]);
+        return;
+    }
+
+    thread_local std::vector<Symbol> syms;
+    thread_local std::vector<Bigram> heap;
+    int n = word.size();
+    syms.resize(n);
+    heap.clear();
+    for (int i = 0; i < n; ++i)
+        syms[i] = {byte_id_[(unsigned char)word[i]], i - 1, i + 1 < n ? i + 1 : -1};
+    auto add = [&](int left, int right) {
+        if (left == -1 || right == -1)
+            return;
+        if (const Merge *m = lookup(syms[left].id, syms[right].id)) {
+            heap.push_back({m->rank, left, right, syms[left].id, syms[right].id});
+            std::push_heap(heap.begin(), heap.end());
+        }
+    };
+    for (int i = 1; i < n; ++i)
+        add(i - 1, i);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        Bigram b = heap.back();
+        heap.pop_back();
+        Symbol &l = syms[b.left];
+        Symbol &r = syms[b.right];
+        if (l.id != b.left_id || r.id != b.right_id || l.next != b.right)
+            continue; // outdated
+        l.id = lookup(b.left_id, b.right_id)->id;
+        l.next = r.next;
+        if (r.next != -1)
+            syms[r.next].prev = b.left;
+        r.id = -1;
+        add(l.prev, b.left);
+        add(b.left, l.next);
+    }
+    for (int i = 0; i != -1; i = syms[i].next)
+        out->push_back(syms[i].id);
+}
+
+/**
+ * Splits text into words the way the pre-tokenizer regex would.
+ *
+ * @return false if text isn't valid utf-8
+ */
+bool BpeTokenizer::split(std::string_view text, std::vector<std::string_view> *words) const {
+    if (!is_valid_utf8((const unsigned char *)text.data(), text.size()))
+        return false;
+    each_word(text, [&](size_t i, size_t j) { words->push_back(text.substr(i, j - i)); });
+    return true;
+}
+
+/**
+ * Appends tokens of text to output.
+ *
+ * @return false if text isn't valid utf-8, in which case nothing was
+ *     appended, and llama_tokenize() should be used instead
+ */
+bool BpeTokenizer::encode(std::string_view text, std::vector<int> *out) const {
+    if (!ok_ || !is_valid_utf8((const unsigned char *)text.data(), text.size()))
+        return false;
+    each_word(text, [&](size_t i, size_t j) { merge(text.substr(i, j - i), out); });
+    return true;
+}
+
+static bool is_ascii_letter(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+
+/**
+ * Returns first offset at or after `i` where text may be cut.
+ *
+ * Cutting text at such an offset and tokenizing both halves gives the
+ * same tokens as tokenizing the whole thing. We only consider places
+ * where neither pre-tokenizer could let a word run across the cut:
+ *
+ *   - before the space in "a b", which always becomes ["a", " b"]
+ *   - after the newline in "a\nb", which always becomes ["a", "\n", "b"]
+ *
+ * where a and b are ascii letters.
+ *
+ * @return offset or std::string_view::npos if there's none
+ */
+size_t BpeTokenizer::boundary(std::string_view text, size_t i) {
+    if (i < 2)
+        i = 2;
+    for (; i + 1 < text.size(); ++i) {
+        if (text[i] == ' ' && is_ascii_letter(text[i - 1]) && is_ascii_letter(text[i + 1]))
+            return i;
+        if (text[i - 1] == '\n' && is_ascii_letter(text[i - 2]) && is_ascii_letter(text[i]))
+            return i;
+    }
+    return std::string_view::npos;
+}
+
+struct EncodeJob {
+    const BpeTokenizer *bpe;
+    std::string_view text;
+    std::vector<int> toks;
+    llamafile_task_t task;
+    bool ok;
+};
+
+static void *encode_worker(void *arg) {
+    EncodeJob *job = (EncodeJob *)arg;
+    job->ok = job->bpe->encode(job->text, &job->toks);
+    return nullptr;
+}
+
+/**
+ * Appends tokens of text to output, using up to `chunks` threads.
+ *
+ * The text is cut at boundary() offsets near equally spaced points,
+ * each piece is encoded on the thread pool, and the results are then
+ * concatenated. The output is identical to what encode() produces.
+ *
+ * @return false if text isn't valid utf-8, in which case nothing was
+ *     appended, and llama_tokenize() should be used instead
+ */
+bool BpeTokenizer::encode_parallel(std::string_view text, std::vector<int> *out,
+                                   int chunks) const {
+    EncodeJob jobs[kMaxEncodeThreads];
+    chunks = std::min(chunks, kMaxEncodeThreads);
+    int n = 0;
+    size_t start = 0;
+    for (int i = 1; i < chunks; ++i) {
+        size_t cut = boundary(text, std::max(start + 1, text.size() / chunks * i));
+        if (cut == std::string_view::npos)
+            break;
+        jobs[n].text = text.substr(start, cut - start);
+        start = cut;
+        ++n;
+    }
+    jobs[n++].text = text.substr(start);
+    if (n == 1)
+        return encode(text, out);
+    for (int i = 0; i < n; ++i) {
+        jobs[i].bpe = this;
+        jobs[i].task = nullptr;
+    }
+    for (int i = 1; i < n; ++i)
+        if (llamafile_task_create(&jobs[i].task, encode_worker, &jobs[i]))
+            jobs[i].task = nullptr;
+    encode_worker(&jobs[0]);
+    bool ok = jobs[0].ok;
+    for (int i = 1; i < n; ++i) {
+        if (jobs[i].task)
+            npassert(!llamafile_task_join(jobs[i].task, nullptr));
+        else
+            encode_worker(&jobs[i]);
+        ok &= jobs[i].ok;
+    }
+    if (!ok)
+        return false;
+    for (int i = 0; i < n; ++i)
+        out->insert(out->end(), jobs[i].toks.begin(), jobs[i].toks.end());
+    return true;
+}
+
+/**
+ * Loads tokenizer from the metadata of a gguf file.
+ *
+ * Returns null if the vocabulary isn't one we can tokenize exactly as
+ * llama.cpp would, e.g. sentencepiece models, other pre-tokenizers, or
+ * vocabularies with user defined tokens (which llama.cpp matches even
+ * when special tokens aren't being parsed).
+ */
+BpeTokenizer *bpe_load(const char *path) {
+    struct llamafile *file = llamafile_open_gguf(path, "rb");
+    if (!file)
+        return nullptr;
+    struct gguf_init_params params = {
+        /* .no_alloc = */ true,
+        /* .ctx      = */ nullptr,
+    };
+    struct gguf_context *ctx = gguf_init_from_file(file, params);
+    if (!ctx) {
+        llamafile_close(file);
+        return nullptr;
+    }
+    BpeTokenizer *bpe = nullptr;
+    BpeTokenizer::Split split;
+    int model = gguf_find_key(ctx, "tokenizer.ggml.model");
+    int pre = gguf_find_key(ctx, "tokenizer.ggml.pre");
+    int tokens = gguf_find_key(ctx, "tokenizer.ggml.tokens");
+    int merges = gguf_find_key(ctx, "tokenizer.ggml.merges");
+    int types = gguf_find_key(ctx, "tokenizer.ggml.token_type");
+    if (model == -1 || pre == -1 || tokens == -1 || merges == -1)
+        goto Finish;
+    if (strcmp(gguf_get_val_str(ctx, model), "gpt2"))
+        goto Finish;
+    if (!strcmp(gguf_get_val_str(ctx, pre), "llama3") ||
+        !strcmp(gguf_get_val_str(ctx, pre), "llama-v3") ||
+        !strcmp(gguf_get_val_str(ctx, pre), "llama-bpe")) {
+        split = BpeTokenizer::LLAMA3;
+    } else if (!strcmp(gguf_get_val_str(ctx, pre), "gpt-2") ||
+               !strcmp(gguf_get_val_str(ctx, pre), "phi-2")) {
+        split = BpeTokenizer::GPT2;
+    } else {
+        goto Finish;
+    }
+    if (types != -1) {
+        if (gguf_get_arr_type(ctx, types) != GGUF_TYPE_INT32)
+            goto Finish;
+        const int *type = (const int *)gguf_get_arr_data(ctx, types);
+        for (int i = 0; i < gguf_get_arr_n(ctx, types); ++i)
+            if (type[i] == LLAMA_TOKEN_TYPE_USER_DEFINED)
+                goto Finish;
+    }
+    {
+        std::vector<std::string> vocab(gguf_get_arr_n(ctx, tokens));
+        for (size_t i = 0; i < vocab.size(); ++i)
+            vocab[i] = gguf_get_arr_str(ctx, tokens, i);
+        std::vector<std::string> ranks(gguf_get_arr_n(ctx, merges));
+        for (size_t i = 0; i < ranks.size(); ++i)
+            ranks[i] = gguf_get_arr_str(ctx, merges, i);
+        bpe = new BpeTokenizer(split, vocab, ranks);
+        if (!bpe->ok()) {
+            delete bpe;
+            bpe = nullptr;
+        }
+    }
+Finish:
+    gguf_free(ctx);
+    llamafile_close(file);
+    return bpe;
+}
+
+struct BpeTokenizers {
+    std::atomic<const llama_model *> model[kMaxBpeTokenizers];
+    BpeTokenizer *bpe[kMaxBpeTokenizers];
+};
+
+static BpeTokenizers g_bpe;
+static pthread_mutex_t g_bpe_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Loads fast tokenizer for model, if its vocabulary is supported.
+ *
+ * This should be called after the model is loaded, before any threads
+ * use it. The path should be the gguf file the model was loaded from.
+ */
+void llamafile_bpe_load(const llama_model *model, const char *path) {
+    if (llama_vocab_type(model) != LLAMA_VOCAB_TYPE_BPE)
+        return;
+    BpeTokenizer *bpe = bpe_load(path);
+    if (!bpe)
+        return;
+    pthread_mutex_lock(&g_bpe_lock);
+    for (int i = 0; i < kMaxBpeTokenizers; ++i) {
+        if (!g_bpe.model[i].load(std::memory_order_relaxed)) {
+            g_bpe.bpe[i] = bpe;
+            g_bpe.model[i].store(model, std::memory_order_release);
+            bpe = nullptr;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_bpe_lock);
+    delete bpe;
+}
+
+/**
+ * Frees fast tokenizer of model.
+ */
+void llamafile_bpe_free(const llama_model *model) {
+    pthread_mutex_lock(&g_bpe_lock);
+    for (int i = 0; i < kMaxBpeTokenizers; ++i) {
+        if (g_bpe.model[i].load(std::memory_order_relaxed) == model) {
+            g_bpe.model[i].store(nullptr, std::memory_order_relaxed);
+            delete g_bpe.bpe[i];
+            g_bpe.bpe[i] = nullptr;
+        }
+    }
+    pthread_mutex_unlock(&g_bpe_lock);
+}
+
+/**
+ * Tokenizes text without parsing special tokens.
+ *
+ * @return false if caller should use llama_tokenize() instead
+ */
+bool llamafile_bpe_tokenize(const llama_model *model, std::string_view text, bool add_special,
+                            std::vector<int> *out) {
+    const BpeTokenizer *bpe = nullptr;
+    for (int i = 0; i < kMaxBpeTokenizers; ++i)
+        if (g_bpe.model[i].load(std::memory_order_acquire) == model)
+            bpe = g_bpe.bpe[i];
+    if (!bpe)
+        return false;
+    size_t n = out->size();
+    if (add_special && llama_add_bos_token(model) == 1)
+        out->push_back(llama_token_bos(model));
+    bool ok;
+    int chunks = std::min(text.size() / kParallelChunkBytes, (size_t)cpu_get_num_math());
+    if (chunks > 1)
+        ok = bpe->encode_parallel(text, out, chunks);
+    else
+        ok = bpe->encode(text, out);
+    if (!ok) {
+        out->resize(n);
+        return false;
+    }
+    if (add_special && llama_add_eos_token(model) == 1)
+        out->push_back(llama_token_eos(model));
+    return true;
+}
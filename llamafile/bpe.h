@@ -0,0 +1,85 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct llama_model;
+
+// byte pair encoding tokenizer for gpt2 and llama3 vocabularies
+//
+// llama.cpp pre-tokenizes text by decoding it into a vector of
+// codepoints, splitting that with its regex machinery, re-encoding
+// each word, and then merging symbols using a priority queue of
+// std::string pairs. we do the same thing, except the pre-tokenizer
+// is a state machine that walks utf-8 directly and uses simd to skip
+// over ascii, and merges happen on token ids using hash tables that
+// are flat arrays. the output is exactly what llama_tokenize() would
+// return. text that isn't valid utf-8 is refused, since llama.cpp
+// would replace the bad bytes, so callers can fall back to it.
+class BpeTokenizer {
+  public:
+    enum Split {
+        GPT2, // 's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)
+        LLAMA3, // (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}|...
+    };
+
+    BpeTokenizer(Split, const std::vector<std::string> &, const std::vector<std::string> &);
+    bool split(std::string_view, std::vector<std::string_view> *) const;
+    bool encode(std::string_view, std::vector<int> *) const;
+    bool encode_parallel(std::string_view, std::vector<int> *, int) const;
+    int find(std::string_view) const;
+    static size_t boundary(std::string_view, size_t);
+
+    bool ok() const {
+        return ok_;
+    }
+
+  private:
+    struct Word {
+        unsigned hash;
+        int id;
+    };
+
+    struct Merge {
+        unsigned long key;
+        int rank;
+        int id;
+    };
+
+    template <typename F>
+    void each_word(std::string_view, F) const;
+    void merge(std::string_view, std::vector<int> *) const;
+    const Merge *lookup(int, int) const;
+    bool equal(int, std::string_view) const;
+
+    bool ok_;
+    Split split_;
+    int byte_id_[256];
+    std::string bytes_; // raw bytes of every token
+    std::vector<unsigned> offsets_; // token i is bytes_[offsets_[i]:offsets_[i+1]]
+    std::vector<Word> words_; // open addressing
+    std::vector<Merge> merges_; // open addressing
+};
+
+BpeTokenizer *bpe_load(const char *);
+
+void llamafile_bpe_load(const llama_model *, const char *);
+void llamafile_bpe_free(const llama_model *);
+bool llamafile_bpe_tokenize(const llama_model *, std::string_view, bool, std::vector<int> *);
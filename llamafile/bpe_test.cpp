@@ -0,0 +1,184 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bpe.h"
+
+#include <cosmo.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// tiny vocabulary where tokens 0-255 are the bytes in order, followed
+// by whatever merges produce. token text uses gpt2's byte encoding so
+// "Ġw" is a space followed by w.
+
+bool is_printable(int b) {
+    return (b >= '!' && b <= '~') || (b >= 0xa1 && b <= 0xac) || (b >= 0xae && b <= 0xff);
+}
+
+std::string encode_byte(int b) {
+    unsigned c = b;
+    if (!is_printable(b)) {
+        c = 256;
+        for (int i = 0; i < b; ++i)
+            c += !is_printable(i);
+    }
+    std::string s;
+    if (c < 0x80) {
+        s += c;
+    } else {
+        s += 0xc0 | c >> 6;
+        s += 0x80 | (c & 63);
+    }
+    return s;
+}
+
+BpeTokenizer *make(BpeTokenizer::Split split) {
+    std::vector<std::string> tokens;
+    for (int b = 0; b < 256; ++b)
+        tokens.push_back(encode_byte(b));
+    std::vector<std::string> merges = {
+        "l l", "h e", "he ll", "hell o", "Ġ w", "Ġw o", "e l",
+    };
+    for (const std::string &m : merges) {
+        size_t i = m.find(' ');
+        tokens.push_back(m.substr(0, i) + m.substr(i + 1));
+    }
+    return new BpeTokenizer(split, tokens, merges);
+}
+
+std::vector<std::string> split(const BpeTokenizer *bpe, const std::string &text) {
+    std::vector<std::string_view> words;
+    npassert(bpe->split(text, &words));
+    return std::vector<std::string>(words.begin(), words.end());
+}
+
+std::vector<int> tokenize(const BpeTokenizer *bpe, const std::string &text) {
+    std::vector<int> toks;
+    npassert(bpe->encode(text, &toks));
+    return toks;
+}
+
+void test_byte_encoding() {
+    npassert(encode_byte('A') == "A");
+    npassert(encode_byte(' ') == "Ġ");
+    npassert(encode_byte('\n') == "Ċ");
+    npassert(encode_byte(0) == "Ā");
+    npassert(encode_byte(0xad) == "Ń");
+}
+
+void test_split_gpt2() {
+    BpeTokenizer *bpe = make(BpeTokenizer::GPT2);
+    npassert(bpe->ok());
+    npassert(split(bpe, "Hello world's  123456 \n\n") ==
+             std::vector<std::string>({"Hello", " world", "'s", " ", " 123456", " \n\n"}));
+    npassert(split(bpe, "I'M héllo") == std::vector<std::string>({"I", "'", "M", " héllo"}));
+    npassert(split(bpe, "a...b") == std::vector<std::string>({"a", "...", "b"}));
+    npassert(split(bpe, "") == std::vector<std::string>());
+    delete bpe;
+}
+
+void test_split_llama3() {
+    BpeTokenizer *bpe = make(BpeTokenizer::LLAMA3);
+    npassert(bpe->ok());
+    npassert(split(bpe, "Hello world's  123456 \n\n") ==
+             std::vector<std::string>({"Hello", " world", "'s", " ", " ", "123", "456", " \n\n"}));
+    npassert(split(bpe, "I'M héllo") == std::vector<std::string>({"I", "'M", " héllo"}));
+    npassert(split(bpe, "a...b") == std::vector<std::string>({"a", "...", "b"}));
+    delete bpe;
+}
+
+void test_merge() {
+    BpeTokenizer *bpe = make(BpeTokenizer::GPT2);
+    int he = bpe->find("he");
+    int ll = bpe->find("ll");
+    int hello = bpe->find("hello");
+    int Gw = bpe->find(" w");
+    int Gwo = bpe->find(" wo");
+    npassert(he == 257);
+    npassert(hello == 259);
+    npassert(tokenize(bpe, "hello") == std::vector<int>({hello}));
+    npassert(tokenize(bpe, "helo") == std::vector<int>({he, 'l', 'o'}));
+    npassert(tokenize(bpe, "hello world") == std::vector<int>({hello, Gwo, 'r', 'l', 'd'}));
+    npassert(tokenize(bpe, " w") == std::vector<int>({Gw}));
+
+    // lower rank wins even though "e l" comes first in the text
+    npassert(tokenize(bpe, "ell") == std::vector<int>({'e', ll}));
+    delete bpe;
+}
+
+void test_invalid_utf8() {
+    BpeTokenizer *bpe = make(BpeTokenizer::LLAMA3);
+    std::vector<int> toks;
+    npassert(!bpe->encode("\xff", &toks));
+    npassert(!bpe->encode("hi \xc3", &toks));
+    npassert(!bpe->encode("\xe0\x80\x80", &toks)); // overlong
+    npassert(!bpe->encode("\xed\xa0\x80", &toks)); // surrogate
+    delete bpe;
+}
+
+void test_boundary() {
+    std::string_view s = "hi there.\nhello  world\nok go";
+    npassert(BpeTokenizer::boundary(s, 0) == 2);
+    npassert(BpeTokenizer::boundary(s, 3) == s.find("ok"));
+    npassert(BpeTokenizer::boundary(s, s.find("ok") + 1) == s.find(" go"));
+    npassert(BpeTokenizer::boundary(s, s.find("go")) == std::string_view::npos);
+}
+
+void test_parallel() {
+    const char *atoms[] = {"hello", " ", "world", "\n", "'s", "12345", "héllo", "  ", ".", "\r\n"};
+    std::string text;
+    unsigned x = 1;
+    while (text.size() < 300000) {
+        x = x * 1103515245 + 12345;
+        text += atoms[(x >> 16) % (sizeof(atoms) / sizeof(*atoms))];
+    }
+    for (BpeTokenizer::Split split : {BpeTokenizer::GPT2, BpeTokenizer::LLAMA3}) {
+        BpeTokenizer *bpe = make(split);
+        std::vector<int> want = tokenize(bpe, text);
+        for (int chunks = 1; chunks <= 7; ++chunks) {
+            std::vector<int> got;
+            npassert(bpe->encode_parallel(text, &got, chunks));
+            npassert(got == want);
+        }
+        std::vector<int> got;
+        std::string bad = text;
+        bad[bad.size() / 2] = '\xff';
+        npassert(!bpe->encode_parallel(bad, &got, 4));
+        npassert(got.empty());
+        delete bpe;
+    }
+}
+
+void test_missing_byte() {
+    std::vector<std::string> tokens = {"a", "b"};
+    BpeTokenizer bpe(BpeTokenizer::GPT2, tokens, {});
+    npassert(!bpe.ok());
+}
+
+int main(int argc, char *argv[]) {
+    ShowCrashReports();
+    test_byte_encoding();
+    test_split_gpt2();
+    test_split_llama3();
+    test_merge();
+    test_invalid_utf8();
+    test_boundary();
+    test_parallel();
+    test_missing_byte();
+    CheckForMemoryLeaks();
+}
@@ -26,6 +26,8 @@
     "The assistant gives helpful, detailed, and polite answers to the " \
     "human's questions."
 
+#define MAX_BRANCHES 16
+
 struct bestlineCompletions;
 struct clip_ctx;
 struct gpt_params;
@@ -51,10 +53,14 @@ extern char g_last_printed_char;
 extern clip_ctx *g_clip;
 extern enum Role g_role;
 extern gpt_params g_params;
+extern int g_seq;
 extern int g_system_prompt_tokens;
 extern llama_context *g_ctx;
 extern llama_model *g_model;
 extern std::vector<int> g_history;
+extern std::vector<int> g_stack;
+extern std::vector<int> g_undo;
+extern thread_local bool g_in_background;
 extern volatile sig_atomic_t g_got_sigint;
 
 int main(int, char **);
@@ -64,37 +70,50 @@ bool eval_token(int);
 bool eval_tokens(std::vector<int>);
 bool handle_command(const char *);
 bool is_base_model();
+bool load_session(const char *);
 bool out_of_context(int);
+bool upload_in_progress(void);
+bool save_session(const char *);
 char *on_hint(const char *, const char **, const char **);
 const char *get_role_color(enum Role);
 const char *get_role_name(enum Role);
 enum Role cycle_role(enum Role);
 enum Role get_next_role(enum Role);
+int branch_count(void);
 int tokens_used(void);
+std::string describe_position(int);
+std::string get_background_status(void);
 std::string token_to_piece(const llama_context *, int, bool);
 void adjust_stacks(int, int);
 void clear_ephemeral(void);
 void ensure_newline();
 void err(const char *, ...);
 void fix_stacks(void);
+void flush_background_errors(void);
 void logo(char **);
+void on_branch(const std::vector<std::string> &);
 void on_clear(const std::vector<std::string> &);
 void on_completion(const char *, int, bestlineCompletions *);
 void on_context(const std::vector<std::string> &);
 void on_dump(const std::vector<std::string> &);
 void on_forget(const std::vector<std::string> &);
 void on_help(const std::vector<std::string> &);
+void on_load(const std::vector<std::string> &);
 void on_manual(const std::vector<std::string> &);
 void on_pop(const std::vector<std::string> &);
 void on_push(const std::vector<std::string> &);
+void on_save(const std::vector<std::string> &);
 void on_stack(const std::vector<std::string> &);
+void on_switch(const std::vector<std::string> &);
 void on_undo(const std::vector<std::string> &);
 void on_upload(const std::vector<std::string> &);
 void print(const std::string_view &);
 void print_ephemeral(const std::string_view &);
 void record_undo(void);
 void repl();
+void reset_branches(void);
 void rewind(int);
+void wait_for_upload(void);
 
 } // namespace chatbot
 } // namespace lf
@@ -0,0 +1,206 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "chatbot.h"
+
+#include <string>
+#include <vector>
+
+#include "llama.cpp/llama.h"
+#include "llamafile/color.h"
+
+// conversation branches
+//
+// each branch is a separate sequence id in the kv cache. forking copies
+// the current sequence with llama_kv_cache_seq_cp(), which only tags the
+// cells with the new sequence id, so the prefix both branches share is
+// stored once. tokens evaluated afterwards go into cells of their own.
+// switching branches just swaps which sequence id we're using, so it's
+// instant, and none of the other branch needs to be evaluated again.
+
+namespace lf {
+namespace chatbot {
+
+struct Branch {
+    std::string name;
+    int seq;
+    int system_prompt_tokens;
+    std::vector<int> history;
+    std::vector<int> undo;
+    std::vector<int> stack;
+};
+
+int g_seq;
+static int g_branch;
+static std::vector<Branch> g_branches = {{"main", 0}};
+
+int branch_count(void) {
+    return g_branches.size();
+}
+
+static int find_branch(const std::string &name) {
+    for (int i = 0; i < (int)g_branches.size(); ++i)
+        if (g_branches[i].name == name)
+            return i;
+    return -1;
+}
+
+static void stash_branch(void) {
+    Branch &b = g_branches[g_branch];
+    b.system_prompt_tokens = g_system_prompt_tokens;
+    b.history = g_history;
+    b.undo = g_undo;
+    b.stack = g_stack;
+}
+
+static void checkout_branch(int i) {
+    Branch &b = g_branches[i];
+    g_branch = i;
+    g_seq = b.seq;
+    g_system_prompt_tokens = b.system_prompt_tokens;
+    g_history = std::move(b.history);
+    g_undo = std::move(b.undo);
+    g_stack = std::move(b.stack);
+}
+
+// forgets all branches except current one, which becomes main branch
+// with sequence id zero. the kv cache must only have sequence zero.
+void reset_branches(void) {
+    g_seq = 0;
+    g_branch = 0;
+    g_branches = {{"main", 0}};
+}
+
+static void print_branches(void) {
+    int n = g_branches.size();
+    std::vector<int> total(n);
+    std::vector<int> unique(n);
+    llama_kv_cache_view view = llama_kv_cache_view_init(g_ctx, MAX_BRANCHES);
+    llama_kv_cache_view_update(g_ctx, &view);
+    for (int c = 0; c < view.n_cells; ++c) {
+        if (view.cells[c].pos < 0)
+            continue;
+        int owners = 0;
+        int owner = -1;
+        for (int s = 0; s < view.n_seq_max; ++s) {
+            int seq = view.cells_sequences[c * view.n_seq_max + s];
+            if (seq < 0)
+                continue;
+            for (int i = 0; i < n; ++i) {
+                if (g_branches[i].seq == seq) {
+                    ++total[i];
+                    owner = i;
+                    ++owners;
+                }
+            }
+        }
+        if (owners == 1)
+            ++unique[owner];
+    }
+    llama_kv_cache_view_free(&view);
+    for (int i = 0; i < n; ++i) {
+        std::string where;
+        if (i == g_branch) {
+            where = describe_position(tokens_used());
+        } else {
+            std::swap(g_history, g_branches[i].history);
+            where = describe_position(tokens_used());
+            std::swap(g_history, g_branches[i].history);
+        }
+        double mib = 0;
+        if (total[i])
+            mib = (double)llama_state_seq_get_size(g_ctx, g_branches[i].seq) / total[i] *
+                  unique[i] / (1024 * 1024);
+        printf("%c %-16s %8d tokens %9.1f MiB unique " FAINT "(%s)" RESET "\n",
+               i == g_branch ? '*' : ' ', g_branches[i].name.c_str(), total[i], mib,
+               where.c_str());
+    }
+}
+
+static void delete_branch(const std::string &name) {
+    int i = find_branch(name);
+    if (i == -1) {
+        err("%s: no such branch", name.c_str());
+        return;
+    }
+    if (i == g_branch) {
+        err("%s: can't delete current branch", name.c_str());
+        return;
+    }
+    llama_kv_cache_seq_rm(g_ctx, g_branches[i].seq, -1, -1);
+    g_branches.erase(g_branches.begin() + i);
+    if (g_branch > i)
+        --g_branch;
+}
+
+static void create_branch(const std::string &name) {
+    if (find_branch(name) != -1) {
+        err("%s: branch already exists", name.c_str());
+        return;
+    }
+    int seq = -1;
+    for (int s = 0; s < MAX_BRANCHES && seq == -1; ++s) {
+        seq = s;
+        for (const Branch &b : g_branches)
+            if (b.seq == s)
+                seq = -1;
+    }
+    if (seq == -1) {
+        err("error: can't have more than %d branches (try /branch -d NAME)", MAX_BRANCHES);
+        return;
+    }
+    llama_kv_cache_seq_cp(g_ctx, g_seq, seq, -1, -1);
+    stash_branch();
+    g_branches.push_back({name, seq, g_system_prompt_tokens, g_history, g_undo, g_stack});
+    checkout_branch(g_branches.size() - 1);
+    printf(FAINT "switched to new branch %s" RESET "\n", name.c_str());
+}
+
+void on_branch(const std::vector<std::string> &args) {
+    if (args.size() == 1) {
+        print_branches();
+    } else if (args.size() == 2 && args[1][0] != '-') {
+        create_branch(args[1]);
+    } else if (args.size() == 3 && args[1] == "-d") {
+        delete_branch(args[2]);
+    } else {
+        err("error: bad /branch command\n"
+            "usage: /branch [[-d] NAME]");
+    }
+}
+
+void on_switch(const std::vector<std::string> &args) {
+    if (args.size() != 2) {
+        err("error: bad /switch command\n"
+            "usage: /switch NAME");
+        return;
+    }
+    int i = find_branch(args[1]);
+    if (i == -1) {
+        err("%s: no such branch (use /branch to create one)", args[1].c_str());
+        return;
+    }
+    if (i == g_branch)
+        return;
+    stash_branch();
+    checkout_branch(i);
+    printf(FAINT "switched to branch %s at: %s" RESET "\n", args[1].c_str(),
+           describe_position(tokens_used()).c_str());
+}
+
+} // namespace chatbot
+} // namespace lf
@@ -48,6 +48,8 @@ bool handle_command(const char *command) {
     while (iss >> arg)
         args.push_back(arg);
     if (args[0] == "exit" || args[0] == "bye") {
+        if (FLAG_session)
+            save_session(FLAG_session);
         exit(0);
     } else if (args[0] == "help") {
         on_help(args);
@@ -73,6 +75,14 @@ bool handle_command(const char *command) {
         on_stack(args);
     } else if (args[0] == "upload") {
         on_upload(args);
+    } else if (args[0] == "branch") {
+        on_branch(args);
+    } else if (args[0] == "switch") {
+        on_switch(args);
+    } else if (args[0] == "save") {
+        on_save(args);
+    } else if (args[0] == "load") {
+        on_load(args);
     } else {
         err("%s: unrecognized command", args[0].c_str());
     }
@@ -32,13 +32,16 @@ static bool is_directory(const char *path) {
 }
 
 void on_completion(const char *line, int pos, bestlineCompletions *comp) {
-    if (startswith(line, "/upload ")) {
-        std::string pattern(line + strlen("/upload "));
+    if (startswith(line, "/upload ") || startswith(line, "/load ") ||
+        startswith(line, "/save ")) {
+        const char *arg = strrchr(line, ' ') + 1;
+        std::string command(line, arg - line);
+        std::string pattern(arg);
         pattern += '*';
         glob_t gl;
         if (!glob(pattern.c_str(), GLOB_TILDE, 0, &gl)) {
             for (size_t i = 0; i < gl.gl_pathc; ++i) {
-                std::string completion = "/upload ";
+                std::string completion = command;
                 completion += gl.gl_pathv[i];
                 if (is_directory(gl.gl_pathv[i]))
                     completion += '/';
@@ -48,19 +51,23 @@ void on_completion(const char *line, int pos, bestlineCompletions *comp) {
         }
     } else {
         static const char *const kCompletions[] = {
+            "/branch", // usage: /branch [[-d] NAME]
             "/clear", // usage: /clear
             "/context", // usage: /context
             "/dump", // usage: /dump [FILE]
             "/exit", // usage: /exit
             "/forget", // usage: /forget
             "/help", // usage: /help [COMMAND]
+            "/load", // usage: /load FILE
             "/manual", // usage: /manual [on|off]
             "/pop", // usage: /pop
             "/push", // usage: /push
+            "/save", // usage: /save FILE
             "/stack", // usage: /stack
             "/stats", // usage: /stats
+            "/switch", // usage: /switch NAME
             "/undo", // usage: /undo
-            "/upload", // usage: /upload FILE
+            "/upload", // usage: /upload PATH...
         };
         for (int i = 0; i < sizeof(kCompletions) / sizeof(*kCompletions); ++i)
             if (startswith(kCompletions[i], line))
@@ -46,7 +46,7 @@ bool eval_tokens(std::vector<llama_token> tokens) {
         int n_eval = (int)tokens.size() - i;
         if (n_eval > g_params.n_batch)
             n_eval = g_params.n_batch;
-        if (llama_decode(g_ctx, llama_batch_get_one(&tokens[i], n_eval, tokens_used(), 0)))
+        if (llama_decode(g_ctx, llama_batch_get_one(&tokens[i], n_eval, tokens_used(), g_seq)))
             return out_of_context(n_eval);
         g_history.insert(g_history.end(), tokens.begin() + i, tokens.begin() + i + n_eval);
     }
@@ -81,7 +81,7 @@ bool eval_image_embed(const llava_image_embed *image_embed) {
             .embd = image_embed->embed + i * n_embd,
             .all_pos_0 = tokens_used(),
             .all_pos_1 = 1,
-            .all_seq_id = 0,
+            .all_seq_id = g_seq,
         };
         if (llama_decode(g_ctx, batch))
             return out_of_context(n_eval);
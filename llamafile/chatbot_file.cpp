@@ -17,80 +17,274 @@
 
 #include "chatbot.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
 #include <string>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
 #include "llama.cpp/common.h"
+#include "llama.cpp/llava/clip.h"
 #include "llamafile/color.h"
 #include "llamafile/image.h"
 #include "llamafile/llama.h"
+#include "llamafile/pool.h"
 #include "llamafile/string.h"
 
+#define MAX_UPLOAD_FILES 10000
+#define MAX_UPLOAD_THREADS 8
+
 namespace lf {
 namespace chatbot {
 
+// file being shared with the assistant
+//
+// files are read and turned into tokens by a pool of threads. then the
+// tokens are evaluated by a background thread, while the user is busy
+// typing their question. the repl waits for that thread to finish when
+// the user presses enter, or runs any command.
+
+struct Upload {
+    std::string path;
+    struct stat st;
+    std::string image; // raw content, if it's an image
+    std::string message; // chat message to be evaluated
+    std::vector<llama_token> tokens; // of message, if it's text
+    const char *skip; // reason it won't be uploaded, or null
+};
+
+struct UploadJob {
+    std::vector<Upload> uploads;
+    std::atomic_int next;
+};
+
+static llamafile_task_t g_upload_task;
+static std::atomic_bool g_upload_done;
+
 static bool has_binary(const std::string_view s) {
     return s.find('\0') != std::string_view::npos;
 }
 
-void on_upload(const std::vector<std::string> &args) {
-    if (args.size() < 2) {
-        err("error: missing file path" RESET "\n"
-            "usage: /upload PATH");
+static void find_files(const std::string &path, std::vector<std::string> *out) {
+    struct stat st;
+    if (out->size() >= MAX_UPLOAD_FILES || stat(path.c_str(), &st))
         return;
+    if (S_ISREG(st.st_mode)) {
+        out->push_back(path);
+    } else if (S_ISDIR(st.st_mode)) {
+        DIR *dir;
+        std::vector<std::string> names;
+        if (!(dir = opendir(path.c_str())))
+            return;
+        while (struct dirent *ent = readdir(dir))
+            if (ent->d_name[0] != '.')
+                names.push_back(ent->d_name);
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        for (const std::string &name : names)
+            find_files(path.back() == '/' ? path + name : path + '/' + name, out);
     }
-    if (args.size() > 2) {
-        err("error: too many arguments" RESET "\n"
-            "usage: /upload PATH");
+}
+
+static void expand_path(const std::string &arg, std::vector<std::string> *out) {
+    if (arg.find_first_of("*?[") == std::string::npos && arg[0] != '~') {
+        find_files(arg, out);
         return;
     }
-    const char *path = args[1].c_str();
-    struct stat st;
-    if (stat(path, &st) || !S_ISREG(st.st_mode)) {
-        err("%s: file does not exist", path);
-        return;
+    glob_t gl;
+    if (!glob(arg.c_str(), GLOB_TILDE, 0, &gl)) {
+        for (size_t i = 0; i < gl.gl_pathc; ++i)
+            find_files(gl.gl_pathv[i], out);
+        globfree(&gl);
     }
-    int tokens_used_before = tokens_used();
-    std::string content;
-    if (!slurp(&content, path)) {
-        err("%s: failed to slurp file", path);
+}
+
+static void prepare_upload(Upload *up) {
+    int fd;
+    if ((fd = open(up->path.c_str(), O_RDONLY)) == -1 || fstat(fd, &up->st)) {
+        up->skip = "can't open file";
+        if (fd != -1)
+            close(fd);
         return;
     }
+    std::string_view content;
+    void *map = MAP_FAILED;
+    if (up->st.st_size) {
+        map = mmap(0, up->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            up->skip = "can't map file";
+            close(fd);
+            return;
+        }
+        content = std::string_view((const char *)map, up->st.st_size);
+    }
+    close(fd);
     std::string markdown;
     markdown += "- **Filename**: `";
-    markdown += path;
+    markdown += up->path;
     markdown += "`\n- **Last modified**: ";
-    markdown += iso8601(st.st_mtim);
+    markdown += iso8601(up->st.st_mtim);
     markdown += "\n\n";
     if (is_image(content)) {
-        if (!g_clip) {
-            err("%s: need --mmproj model to process images", path);
-            return;
+        if (g_clip) {
+            up->image = content;
+            convert_image_to_uri(&markdown, content);
+        } else {
+            up->skip = "need --mmproj model to process images";
         }
-        print_image(1, content, 80);
-        convert_image_to_uri(&markdown, content);
+    } else if (has_binary(content)) {
+        up->skip = "binary file type not supported";
     } else {
-        if (has_binary(content)) {
-            err("%s: binary file type not supported", path);
-            return;
-        }
         markdown += "``````";
-        markdown += extname(path);
+        markdown += extname(up->path);
         markdown += '\n';
         markdown += content;
         if (markdown.back() != '\n')
             markdown += '\n';
         markdown += "``````";
     }
-    std::vector<llama_chat_msg> chat = {{"system", std::move(markdown)}};
-    if (!eval_string(
-            llama_chat_apply_template(g_model, g_params.chat_template, chat, DONT_ADD_ASSISTANT),
-            DONT_ADD_SPECIAL, PARSE_SPECIAL)) {
-        rewind(tokens_used_before);
+    if (map != MAP_FAILED)
+        munmap(map, up->st.st_size);
+    if (up->skip)
         return;
+    std::vector<llama_chat_msg> chat = {{"system", std::move(markdown)}};
+    up->message =
+        llama_chat_apply_template(g_model, g_params.chat_template, chat, DONT_ADD_ASSISTANT);
+    if (up->image.empty())
+        up->tokens = llamafile_tokenize(g_model, up->message, DONT_ADD_SPECIAL, PARSE_SPECIAL);
+}
+
+static void *prepare_worker(void *arg) {
+    UploadJob *job = (UploadJob *)arg;
+    for (int i; (i = job->next++) < (int)job->uploads.size();)
+        prepare_upload(&job->uploads[i]);
+    return nullptr;
+}
+
+static void prepare_uploads(UploadJob *job) {
+    int n = std::min((int)job->uploads.size(), MAX_UPLOAD_THREADS);
+    std::vector<llamafile_task_t> tasks(n);
+    job->next = 0;
+    for (int i = 1; i < n; ++i)
+        if (llamafile_task_create(&tasks[i], prepare_worker, job))
+            tasks[i] = nullptr;
+    prepare_worker(job);
+    for (int i = 1; i < n; ++i)
+        if (tasks[i])
+            llamafile_task_join(tasks[i], nullptr);
+}
+
+static void *upload_worker(void *arg) {
+    UploadJob *job = (UploadJob *)arg;
+    g_in_background = true;
+    int tokens_used_before = tokens_used();
+    for (const Upload &up : job->uploads) {
+        if (up.skip)
+            continue;
+        print_ephemeral(format("uploading %s...", up.path.c_str()));
+        bool ok;
+        if (up.image.empty()) {
+            ok = eval_tokens(up.tokens);
+        } else {
+            ok = eval_string(up.message, DONT_ADD_SPECIAL, PARSE_SPECIAL);
+        }
+        if (!ok) {
+            err("%s: upload canceled", up.path.c_str());
+            rewind(tokens_used_before);
+            break;
+        }
     }
     llama_synchronize(g_ctx);
+    clear_ephemeral();
+    g_in_background = false;
+    delete job;
+    g_upload_done = true;
+    return nullptr;
+}
+
+bool upload_in_progress(void) {
+    return g_upload_task && !g_upload_done;
+}
+
+// blocks until background upload is finished, while showing progress
+void wait_for_upload(void) {
+    if (!g_upload_task)
+        return;
+    while (!g_upload_done) {
+        print_ephemeral(get_background_status());
+        usleep(100000);
+    }
+    clear_ephemeral();
+    llamafile_task_join(g_upload_task, nullptr);
+    g_upload_task = nullptr;
+    g_upload_done = false;
+    flush_background_errors();
+}
+
+void on_upload(const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        err("error: missing file path" RESET "\n"
+            "usage: /upload PATH...");
+        return;
+    }
+    wait_for_upload();
+
+    // find files to upload
+    std::vector<std::string> paths;
+    for (size_t i = 1; i < args.size(); ++i) {
+        size_t count = paths.size();
+        expand_path(args[i], &paths);
+        if (paths.size() == count)
+            err("%s: no such file or directory", args[i].c_str());
+    }
+    if (paths.empty())
+        return;
+
+    // read and tokenize files in parallel
+    UploadJob *job = new UploadJob;
+    for (const std::string &path : paths)
+        job->uploads.push_back({path});
+    print_ephemeral(format("reading %zu files...", paths.size()));
+    prepare_uploads(job);
+    clear_ephemeral();
+
+    // leave an eighth of the context window for conversation
+    int budget = llama_n_ctx(g_ctx) - llama_n_ctx(g_ctx) / 8 - tokens_used();
+    int files = 0;
+    int tokens = 0;
+    for (Upload &up : job->uploads) {
+        int n = up.image.empty() ? up.tokens.size() : clip_n_patches(g_clip);
+        if (!up.skip && tokens + n > budget)
+            up.skip = "would exceed context window budget";
+        if (up.skip) {
+            err("%s: %s", up.path.c_str(), up.skip);
+            continue;
+        }
+        if (!up.image.empty())
+            print_image(1, up.image, 80);
+        tokens += n;
+        ++files;
+    }
+    if (!files) {
+        delete job;
+        return;
+    }
+
+    // evaluate tokens on background thread
+    printf(FAINT "uploading %d file%s (%d tokens)" RESET "\n", files, files == 1 ? "" : "s",
+           tokens);
+    g_upload_done = false;
+    if (llamafile_task_create(&g_upload_task, upload_worker, job)) {
+        g_upload_task = nullptr;
+        upload_worker(job);
+        flush_background_errors();
+    }
 }
 
 } // namespace chatbot
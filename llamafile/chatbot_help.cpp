@@ -30,19 +30,23 @@ void on_help(const std::vector<std::string> &args) {
 " BOLD "available commands" RESET "\n\
   ctrl-j                   insert line in multi-line mode\n\
   \"\"\"                      use triple quotes for multi-line input\n\
+  /branch [[-d] NAME]      list, create, or delete conversation branches\n\
   /clear                   restart conversation\n\
   /context                 print context window usage\n\
   /dump [FILE]             print or save context window to file\n\
   /exit                    end program\n\
   /forget                  erase oldest message from context\n\
   /help [COMMAND]          show help\n\
+  /load FILE               restore conversation saved by /save\n\
   /manual [on|off]         toggle manual role mode\n\
   /pop                     restore context window size\n\
   /push                    push context window size to stack\n\
+  /save FILE               save conversation and context window to file\n\
   /stack                   prints context window stack\n\
   /stats                   print performance metrics\n\
+  /switch NAME             switch to another conversation branch\n\
   /undo                    erases last message in conversation\n\
-  /upload FILE             share image or text file with assistant\n\
+  /upload PATH...          share files or directories with assistant\n\
 ");
     } else if (args[1] == "context") {
         fprintf(stderr, "\
@@ -129,13 +133,51 @@ manual mode, this will erase only the last chat message.\n\
 ");
     } else if (args[1] == "upload") {
         fprintf(stderr, "\
-usage: /upload FILE" RESET "\n\
-shares file from local hard drive with assistant. if this is a text file\n\
-then a markdown system prompt is generated and added to the conversation\n\
-history that gives the assistant readonly access to the file content and\n\
-metadata. files with nul characters in them are currently not supported.\n\
+usage: /upload PATH..." RESET "\n\
+shares files from local hard drive with assistant. for each text file a\n\
+markdown system prompt is generated and added to the conversation that\n\
+gives the assistant readonly access to the file content and metadata.\n\
+directories are uploaded recursively and glob patterns like src/*.c are\n\
+expanded. files with nul characters in them are skipped, as are files\n\
+that would leave less than an eighth of the context window free. files\n\
+are loaded in the background, so you can type your question while that\n\
+happens; it's evaluated once they're done. press ctrl-c to cancel.\n\
 image files (jpg/png/gif) may be uploaded if you specified a clip vision\n\
 model (e.g. LLaVA) earlier when running llamafile with the --mmproj flag\n\
+");
+    } else if (args[1] == "branch") {
+        fprintf(stderr, "\
+usage: /branch [[-d] NAME]" RESET "\n\
+forks the conversation into a new branch called NAME and switches to it.\n\
+this lets you explore an alternative answer without losing the current\n\
+one, which you can go back to using /switch. the history branches have\n\
+in common is only stored once in the context window. when no NAME is\n\
+given, the branches are listed with how many tokens each one is using\n\
+and how much memory is used by tokens no other branch is sharing. the\n\
+-d flag deletes a branch. the first branch is called main.\n\
+");
+    } else if (args[1] == "switch") {
+        fprintf(stderr, "\
+usage: /switch NAME" RESET "\n\
+switches to a conversation branch created earlier by /branch. this is\n\
+instant, since the branch is still in the context window.\n\
+");
+    } else if (args[1] == "save") {
+        fprintf(stderr, "\
+usage: /save FILE" RESET "\n\
+saves the current branch of the conversation to a session file. this\n\
+includes its context window, /undo history, and /push stack. it may be\n\
+restored later with /load, or by passing the --session flag at startup,\n\
+which avoids having to evaluate the system prompt and uploaded files\n\
+all over again.\n\
+");
+    } else if (args[1] == "load") {
+        fprintf(stderr, "\
+usage: /load FILE" RESET "\n\
+restores a conversation from a session file created by /save. this will\n\
+replace the current conversation and delete all other branches. session\n\
+files can only be loaded with the same model that saved them, and a\n\
+context window at least as large.\n\
 ");
     } else if (args[1] == "forget") {
         fprintf(stderr, "\
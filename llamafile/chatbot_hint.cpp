@@ -18,6 +18,7 @@
 #include "chatbot.h"
 
 #include <cstring>
+#include <string>
 
 #include "llamafile/color.h"
 
@@ -25,6 +26,11 @@ namespace lf {
 namespace chatbot {
 
 static const char *on_hint_impl(const char *line) {
+    static std::string status;
+    if (!*line && upload_in_progress()) {
+        status = get_background_status();
+        return status.c_str();
+    }
     if (!*line && g_manual_mode)
         return get_role_name(g_role);
     if (!*line && !g_manual_mode && !g_said_something) {
@@ -35,17 +41,21 @@ static const char *on_hint_impl(const char *line) {
         }
     }
     static const char *const kHints[] = {
+        "/branch", //
         "/clear", //
         "/context", //
         "/dump", //
         "/exit", //
         "/forget", //
         "/help", //
+        "/load", //
         "/manual", //
         "/pop", //
         "/push", //
+        "/save", //
         "/stack", //
         "/stats", //
+        "/switch", //
         "/undo", //
         "/upload", //
     };
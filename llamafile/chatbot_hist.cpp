@@ -196,6 +196,12 @@ void on_forget(const std::vector<std::string> &args) {
         err("error: nothing left to forget");
         return;
     }
+    if (branch_count() > 1) {
+        // shifting positions would move cells other branches share
+        err("error: can't /forget while there's more than one branch\n"
+            "you can delete branches using /branch -d NAME");
+        return;
+    }
     int erase_count;
     llama_pos erase_begin = g_undo[1];
     llama_pos erase_end = g_undo.size() > 2 ? g_undo[2] : tokens_used();
@@ -204,8 +210,8 @@ void on_forget(const std::vector<std::string> &args) {
         return;
     }
     printf(FAINT "forgetting: %s" RESET "\n", describe_erasure(erase_begin, erase_end).c_str());
-    llama_kv_cache_seq_rm(g_ctx, 0, erase_begin, erase_end);
-    llama_kv_cache_seq_add(g_ctx, 0, erase_end, -1, -erase_count);
+    llama_kv_cache_seq_rm(g_ctx, g_seq, erase_begin, erase_end);
+    llama_kv_cache_seq_add(g_ctx, g_seq, erase_end, -1, -erase_count);
     g_history.erase(g_history.begin() + erase_begin, //
                     g_history.begin() + erase_end);
     adjust_stacks(erase_begin, erase_end);
@@ -214,7 +220,7 @@ void on_forget(const std::vector<std::string> &args) {
 
 void rewind(int pos) {
     unassert(pos <= tokens_used());
-    llama_kv_cache_seq_rm(g_ctx, 0, pos, -1);
+    llama_kv_cache_seq_rm(g_ctx, g_seq, pos, -1);
     g_history.resize(pos);
 }
 
@@ -27,6 +27,7 @@
 #include "llama.cpp/ggml-cuda.h"
 #include "llama.cpp/llava/clip.h"
 #include "llama.cpp/server/server.h"
+#include "llamafile/bpe.h"
 #include "llamafile/color.h"
 #include "llamafile/compute.h"
 #include "llamafile/llama.h"
@@ -143,6 +144,8 @@ int main(int argc, char **argv) {
         fprintf(stderr, "%s: failed to load model%s\n", g_params.model.c_str(), tip());
         exit(2);
     }
+    llamafile_pieces_load(g_model);
+    llamafile_bpe_load(g_model, g_params.model.c_str());
     if (g_params.n_ctx <= 0 || g_params.n_ctx > llama_n_ctx_train(g_model))
         g_params.n_ctx = llama_n_ctx_train(g_model);
     if (g_params.n_ctx < g_params.n_batch)
@@ -178,6 +181,7 @@ int main(int argc, char **argv) {
 
     print_ephemeral("initializing context...");
     llama_context_params ctx_params = llama_context_params_from_gpt_params(g_params);
+    ctx_params.n_seq_max = MAX_BRANCHES;
     g_ctx = llama_new_context_with_model(g_model, ctx_params);
     clear_ephemeral();
     if (!g_ctx) {
@@ -211,6 +215,8 @@ int main(int argc, char **argv) {
     clear_ephemeral();
 
     print_ephemeral("freeing model...");
+    llamafile_bpe_free(g_model);
+    llamafile_pieces_free(g_model);
     llama_free_model(g_model);
     clear_ephemeral();
 
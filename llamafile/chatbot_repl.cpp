@@ -20,7 +20,10 @@
 #include <cctype>
 #include <csignal>
 #include <cstdio>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <unistd.h>
 
 #include "llama.cpp/common.h"
 #include "llama.cpp/llama.h"
@@ -28,6 +31,7 @@
 #include "llamafile/color.h"
 #include "llamafile/highlight/highlight.h"
 #include "llamafile/llama.h"
+#include "llamafile/llamafile.h"
 
 namespace lf {
 namespace chatbot {
@@ -35,8 +39,15 @@ namespace chatbot {
 bool g_has_ephemeral;
 bool g_said_something;
 char g_last_printed_char;
+thread_local bool g_in_background;
 volatile sig_atomic_t g_got_sigint;
 
+// the background thread mustn't write to the terminal while bestline
+// owns it, so its status line and error messages are held until later
+static std::mutex g_background_lock;
+static std::string g_background_status;
+static std::string g_background_errors;
+
 void on_sigint(int sig) {
     g_got_sigint = 1;
 }
@@ -65,6 +76,16 @@ void ensure_newline() {
 
 void err(const char *fmt, ...) {
     va_list ap;
+    if (g_in_background) {
+        char buf[1024];
+        va_start(ap, fmt);
+        vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        std::lock_guard<std::mutex> lock(g_background_lock);
+        g_background_errors += buf;
+        g_background_errors += '\n';
+        return;
+    }
     clear_ephemeral();
     ensure_newline();
     va_start(ap, fmt);
@@ -75,57 +96,92 @@ void err(const char *fmt, ...) {
 }
 
 void print_ephemeral(const std::string_view &description) {
+    if (g_in_background) {
+        std::lock_guard<std::mutex> lock(g_background_lock);
+        g_background_status = description;
+        return;
+    }
     fprintf(stderr, " " BRIGHT_BLACK "%.*s" UNFOREGROUND "\r", (int)description.size(),
             description.data());
     g_has_ephemeral = true;
 }
 
 void clear_ephemeral(void) {
+    if (g_in_background)
+        return;
     if (g_has_ephemeral) {
         fprintf(stderr, CLEAR_FORWARD);
         g_has_ephemeral = false;
     }
 }
 
+std::string get_background_status(void) {
+    std::lock_guard<std::mutex> lock(g_background_lock);
+    return g_background_status;
+}
+
+void flush_background_errors(void) {
+    std::string errors;
+    {
+        std::lock_guard<std::mutex> lock(g_background_lock);
+        errors = std::move(g_background_errors);
+        g_background_errors.clear();
+        g_background_status.clear();
+    }
+    if (!errors.empty()) {
+        clear_ephemeral();
+        ensure_newline();
+        fprintf(stderr, BRIGHT_RED "%s" RESET, errors.c_str());
+    }
+}
+
 bool out_of_context(int extra) {
     err("error: ran out of context window at %d tokens\n"
         "consider passing `-c %d` at startup for the maximum\n"
-        "you can free up more space using /forget or /clear",
-        tokens_used() + extra, llama_n_ctx_train(g_model));
+        "you can free up more space using /forget or /clear%s",
+        tokens_used() + extra, llama_n_ctx_train(g_model),
+        branch_count() > 1 ? "\nor by deleting other branches using /branch -d NAME" : "");
     return false;
 }
 
 void repl() {
 
     // setup conversation
-    if (llama_should_add_bos_token(g_model)) {
-        print_ephemeral("loading bos token...");
-        eval_token(llama_token_bos(g_model));
-    }
-    record_undo();
+    if (FLAG_session && !access(FLAG_session, F_OK)) {
+        print_ephemeral("loading session...");
+        if (!load_session(FLAG_session))
+            exit(6);
+        clear_ephemeral();
+    } else {
+        if (llama_should_add_bos_token(g_model)) {
+            print_ephemeral("loading bos token...");
+            eval_token(llama_token_bos(g_model));
+        }
+        record_undo();
 
-    // make base models have no system prompt by default
-    if (is_base_model() && g_params.prompt == DEFAULT_SYSTEM_PROMPT)
-        g_params.prompt = "";
+        // make base models have no system prompt by default
+        if (is_base_model() && g_params.prompt == DEFAULT_SYSTEM_PROMPT)
+            g_params.prompt = "";
 
-    // setup system prompt
-    if (!g_params.prompt.empty()) {
-        print_ephemeral("loading system prompt...");
-        std::string msg;
-        if (is_base_model()) {
-            msg = g_params.prompt;
-        } else {
-            std::vector<llama_chat_msg> chat = {{"system", g_params.prompt}};
-            msg = llama_chat_apply_template(g_model, g_params.chat_template, chat,
-                                            DONT_ADD_ASSISTANT);
+        // setup system prompt
+        if (!g_params.prompt.empty()) {
+            print_ephemeral("loading system prompt...");
+            std::string msg;
+            if (is_base_model()) {
+                msg = g_params.prompt;
+            } else {
+                std::vector<llama_chat_msg> chat = {{"system", g_params.prompt}};
+                msg = llama_chat_apply_template(g_model, g_params.chat_template, chat,
+                                                DONT_ADD_ASSISTANT);
+            }
+            if (!eval_string(msg, DONT_ADD_SPECIAL, PARSE_SPECIAL))
+                exit(6);
+            llama_synchronize(g_ctx);
+            g_system_prompt_tokens = tokens_used();
+            clear_ephemeral();
+            if (g_params.display_prompt)
+                printf("%s\n", g_params.special ? msg.c_str() : g_params.prompt.c_str());
         }
-        if (!eval_string(msg, DONT_ADD_SPECIAL, PARSE_SPECIAL))
-            exit(6);
-        llama_synchronize(g_ctx);
-        g_system_prompt_tokens = tokens_used();
-        clear_ephemeral();
-        if (g_params.display_prompt)
-            printf("%s\n", g_params.special ? msg.c_str() : g_params.prompt.c_str());
     }
 
     // perform important setup
@@ -137,7 +193,6 @@ void repl() {
 
     // run chatbot
     for (;;) {
-        record_undo();
         bestlineLlamaMode(true);
         bestlineSetHintsCallback(on_hint);
         bestlineSetFreeHintsCallback(free);
@@ -146,6 +201,8 @@ void repl() {
         char *line = bestlineWithHistory(">>> ", "llamafile");
         write(1, RESET, strlen(RESET));
         g_last_printed_char = '\n';
+        wait_for_upload();
+        record_undo();
         if (!line) {
             if (g_got_sigint)
                 ensure_newline();
@@ -207,6 +264,8 @@ void repl() {
     }
 
     // cleanup resources
+    if (FLAG_session)
+        save_session(FLAG_session);
     llama_sampling_free(sampler);
 }
 
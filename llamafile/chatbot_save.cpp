@@ -0,0 +1,248 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "chatbot.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "llama.cpp/llama.h"
+#include "llamafile/color.h"
+
+// chatbot session files
+//
+// a session holds the conversation history, the /undo and /push stacks
+// and the kv cache of the current branch, so that uploaded files and long
+// system prompts need not be evaluated again. the file is laid out so the kv cache can be
+// restored directly from a read-only memory mapping of the file:
+//
+//   - header
+//   - int32 history[n_history]
+//   - int32 undo[n_undo]
+//   - int32 stack[n_stack]
+//   - padding to 64kb, which is page aligned on every platform
+//   - llama_state_seq_get_data() bytes
+//
+// integers are stored in host byte order. loading a session refuses to
+// work if the model fingerprint or host byte order doesn't match.
+
+#define SESSION_MAGIC "LFCHAT\r\n"
+#define SESSION_VERSION 2
+#define SESSION_ALIGN 65536
+
+namespace lf {
+namespace chatbot {
+
+struct SessionHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t fingerprint;
+    uint32_t n_history;
+    uint32_t n_undo;
+    uint32_t n_stack;
+    uint32_t system_prompt_tokens;
+    uint32_t role;
+    uint32_t manual_mode;
+    uint64_t state_offset;
+    uint64_t state_size;
+};
+
+static uint64_t hash(uint64_t h, const void *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        h ^= ((const unsigned char *)data)[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+// identifies model weights and vocabulary, so that token ids in the
+// history and tensors in the kv cache are meaningful to this program
+static uint64_t model_fingerprint(void) {
+    char desc[128];
+    uint64_t h = 0xcbf29ce484222325;
+    uint64_t n[] = {
+        llama_model_size(g_model), llama_model_n_params(g_model),
+        (uint64_t)llama_n_vocab(g_model), (uint64_t)llama_n_embd(g_model),
+        (uint64_t)llama_n_layer(g_model),
+    };
+    h = hash(h, n, sizeof(n));
+    llama_model_desc(g_model, desc, sizeof(desc));
+    h = hash(h, desc, strlen(desc));
+    for (int i = 0; i < llama_n_vocab(g_model); ++i) {
+        const char *text = llama_token_get_text(g_model, i);
+        h = hash(h, text, strlen(text) + 1);
+    }
+    return h;
+}
+
+static size_t round_up(size_t x, size_t a) {
+    return (x + a - 1) & -a;
+}
+
+bool save_session(const char *path) {
+    llama_synchronize(g_ctx);
+    SessionHeader hdr = {};
+    memcpy(hdr.magic, SESSION_MAGIC, 8);
+    hdr.version = SESSION_VERSION;
+    hdr.byte_order = 0x01020304;
+    hdr.fingerprint = model_fingerprint();
+    hdr.n_history = g_history.size();
+    hdr.n_undo = g_undo.size();
+    hdr.n_stack = g_stack.size();
+    hdr.system_prompt_tokens = g_system_prompt_tokens;
+    hdr.role = g_role;
+    hdr.manual_mode = g_manual_mode;
+    size_t n_ints = hdr.n_history + hdr.n_undo + hdr.n_stack;
+    hdr.state_offset = round_up(sizeof(hdr) + n_ints * sizeof(int32_t), SESSION_ALIGN);
+    hdr.state_size = llama_state_seq_get_size(g_ctx, g_seq);
+
+    // we write to a temporary file and then rename it, so a failure
+    // or ctrl-c in the middle never destroys a good session file
+    std::string tmp = std::string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        err("%s: %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    size_t size = hdr.state_offset + hdr.state_size;
+    if (ftruncate(fd, size)) {
+        err("%s: %s", tmp.c_str(), strerror(errno));
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    char *map = (char *)mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        err("%s: %s", tmp.c_str(), strerror(errno));
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    char *p = map;
+    p = (char *)mempcpy(p, &hdr, sizeof(hdr));
+    p = (char *)mempcpy(p, g_history.data(), hdr.n_history * sizeof(int32_t));
+    p = (char *)mempcpy(p, g_undo.data(), hdr.n_undo * sizeof(int32_t));
+    p = (char *)mempcpy(p, g_stack.data(), hdr.n_stack * sizeof(int32_t));
+    size_t wrote =
+        llama_state_seq_get_data(g_ctx, (uint8_t *)map + hdr.state_offset, hdr.state_size, g_seq);
+    bool ok = wrote == hdr.state_size;
+    if (munmap(map, size) || close(fd))
+        ok = false;
+    if (!ok || rename(tmp.c_str(), path)) {
+        err("%s: failed to save session", path);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_session(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        err("%s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(SessionHeader)) {
+        err("%s: not a session file", path);
+        close(fd);
+        return false;
+    }
+    char *map = (char *)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        err("%s: %s", path, strerror(errno));
+        return false;
+    }
+    SessionHeader hdr;
+    memcpy(&hdr, map, sizeof(hdr));
+    uint64_t n_ints = (uint64_t)hdr.n_history + hdr.n_undo + hdr.n_stack;
+    bool ok = false;
+    if (memcmp(hdr.magic, SESSION_MAGIC, 8) || hdr.version != SESSION_VERSION ||
+        hdr.byte_order != 0x01020304 || hdr.role > ROLE_SYSTEM) {
+        err("%s: not a session file", path);
+    } else if (hdr.state_offset < sizeof(hdr) + n_ints * sizeof(int32_t) ||
+               hdr.state_offset > (uint64_t)st.st_size ||
+               hdr.state_size > (uint64_t)st.st_size - hdr.state_offset) {
+        err("%s: session file is truncated", path);
+    } else if (hdr.fingerprint != model_fingerprint()) {
+        err("%s: session was saved by a different model", path);
+    } else if (hdr.n_history > llama_n_ctx(g_ctx)) {
+        err("%s: session needs %u tokens of context; try passing `-c %u`", path,
+            hdr.n_history, hdr.n_history);
+    } else {
+        ok = true;
+    }
+    if (ok) {
+        const int32_t *ints = (const int32_t *)(map + sizeof(hdr));
+        llama_kv_cache_clear(g_ctx);
+        reset_branches();
+        if (llama_state_seq_set_data(g_ctx, (const uint8_t *)map + hdr.state_offset,
+                                     hdr.state_size, g_seq)) {
+            g_history.assign(ints, ints + hdr.n_history);
+            ints += hdr.n_history;
+            g_undo.assign(ints, ints + hdr.n_undo);
+            ints += hdr.n_undo;
+            g_stack.assign(ints, ints + hdr.n_stack);
+            g_system_prompt_tokens = hdr.system_prompt_tokens;
+            g_role = (enum Role)hdr.role;
+            g_manual_mode = hdr.manual_mode;
+            fix_stacks();
+        } else {
+            err("%s: failed to restore context state; conversation was cleared", path);
+            llama_kv_cache_clear(g_ctx);
+            g_history.clear();
+            g_undo.clear();
+            g_stack.clear();
+            fix_stacks();
+            ok = false;
+        }
+    }
+    munmap(map, st.st_size);
+    return ok;
+}
+
+void on_save(const std::vector<std::string> &args) {
+    if (args.size() != 2) {
+        err("error: bad /save command\n"
+            "usage: /save FILE");
+        return;
+    }
+    if (save_session(args[1].c_str()))
+        printf(FAINT "saved %d tokens to %s" RESET "\n", tokens_used(), args[1].c_str());
+}
+
+void on_load(const std::vector<std::string> &args) {
+    if (args.size() != 2) {
+        err("error: bad /load command\n"
+            "usage: /load FILE");
+        return;
+    }
+    if (load_session(args[1].c_str()))
+        printf(FAINT "restored %d tokens from %s" RESET "\n", tokens_used(), args[1].c_str());
+}
+
+} // namespace chatbot
+} // namespace lf
@@ -17,17 +17,152 @@
 
 #include "core_manager.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <map>
+#include <sched.h>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
 
 #include "llama.cpp/cores.h"
 
 CoreManager g_core_manager;
 
+bool sysfs_read_line(const std::string &path, std::string *line) {
+    FILE *f;
+    char buf[4096];
+    if (!(f = fopen(path.c_str(), "r")))
+        return false;
+    bool ok = !!fgets(buf, sizeof(buf), f);
+    fclose(f);
+    if (!ok)
+        return false;
+    *line = buf;
+    while (!line->empty() && (line->back() == '\n' || line->back() == ' '))
+        line->pop_back();
+    return true;
+}
+
+static int read_int(const std::string &path, int dflt) {
+    std::string line;
+    if (!sysfs_read_line(path, &line) || line.empty())
+        return dflt;
+    return atoi(line.c_str());
+}
+
+// parses linux cpu list, e.g. "0-3,8,10-11"
+std::vector<int> sysfs_parse_list(const std::string &s) {
+    std::vector<int> cpus;
+    const char *p = s.c_str();
+    while (*p) {
+        char *e;
+        long a = strtol(p, &e, 10);
+        if (e == p)
+            break;
+        long b = a;
+        p = e;
+        if (*p == '-') {
+            b = strtol(p + 1, &e, 10);
+            if (e == p + 1)
+                break;
+            p = e;
+        }
+        for (long i = a; i <= b && i < 65536; ++i)
+            cpus.push_back(i);
+        if (*p == ',')
+            ++p;
+    }
+    return cpus;
+}
+
+/**
+ * Reads cpu topology from sysfs, e.g. "/sys/devices/system/cpu".
+ *
+ * The efficiency cores of hybrid chips are identified by having a
+ * `cpu_capacity` (or failing that a `cpuinfo_max_freq`) that's much
+ * lower than the fastest core. Returns empty vector if unavailable.
+ */
+std::vector<CoreManager::Cpu> cpu_get_topology(const char *sysfs) {
+    std::string line;
+    std::string root = sysfs;
+    std::vector<CoreManager::Cpu> cpus;
+    if (!sysfs_read_line(root + "/online", &line))
+        return cpus;
+    for (int id : sysfs_parse_list(line)) {
+        std::string dir = root + "/cpu" + std::to_string(id);
+        CoreManager::Cpu cpu = {id, id, 0, 0, false};
+        if (sysfs_read_line(dir + "/topology/thread_siblings_list", &line)) {
+            std::vector<int> siblings = sysfs_parse_list(line);
+            if (!siblings.empty())
+                cpu.core = *std::min_element(siblings.begin(), siblings.end());
+        }
+        int llc_level = 0;
+        for (int i = 0;; ++i) {
+            std::string index = dir + "/cache/index" + std::to_string(i);
+            int level = read_int(index + "/level", -1);
+            if (level == -1)
+                break;
+            if (level > llc_level && sysfs_read_line(index + "/shared_cpu_list", &line)) {
+                std::vector<int> shared = sysfs_parse_list(line);
+                if (!shared.empty()) {
+                    cpu.llc = *std::min_element(shared.begin(), shared.end());
+                    llc_level = level;
+                }
+            }
+        }
+        if (!(cpu.capacity = read_int(dir + "/cpu_capacity", 0)))
+            cpu.capacity = read_int(dir + "/cpufreq/cpuinfo_max_freq", 0);
+        cpus.push_back(cpu);
+    }
+    int fastest = 0;
+    for (const CoreManager::Cpu &cpu : cpus)
+        fastest = std::max(fastest, cpu.capacity);
+    std::set<int> cores;
+    for (CoreManager::Cpu &cpu : cpus) {
+        if (!cores.insert(cpu.core).second)
+            continue; // hyperthreading isn't useful for linear algebra
+        // efficiency cores harm lockstep threading. turbo boost means
+        // performance cores differ a little, so look for a big gap.
+        cpu.math = cpu.capacity * 5ll >= fastest * 4ll;
+    }
+    return cpus;
+}
+
 CoreManager::CoreManager()
-    : used_(0),
-      total_(cpu_get_num_math()),
-      cv_(PTHREAD_COND_INITIALIZER),
-      mu_(PTHREAD_MUTEX_INITIALIZER) {
+    : used_(0), pinnable_(false), cv_(PTHREAD_COND_INITIALIZER), mu_(PTHREAD_MUTEX_INITIALIZER) {
+    init("/sys/devices/system/cpu", true);
+}
+
+CoreManager::CoreManager(const char *sysfs)
+    : used_(0), pinnable_(false), cv_(PTHREAD_COND_INITIALIZER), mu_(PTHREAD_MUTEX_INITIALIZER) {
+    init(sysfs, false);
+}
+
+void CoreManager::init(const char *sysfs, bool pinnable) {
+    topology_ = cpu_get_topology(sysfs);
+    if (pinnable)
+        pinnable_ = !sched_getaffinity(0, sizeof(affinity_), &affinity_);
+    for (const Cpu &cpu : topology_) {
+        if (!cpu.math)
+            continue;
+        if (pinnable_ && (cpu.id >= CPU_SETSIZE || !CPU_ISSET(cpu.id, &affinity_)))
+            continue; // respect taskset and cgroups
+        Slot slot = {};
+        slot.cpu = cpu.id;
+        slot.llc = cpu.llc;
+        slots_.push_back(slot);
+    }
+    if (slots_.empty()) {
+        pinnable_ = false;
+        for (int i = cpu_get_num_math(); i-- > 0;) {
+            Slot slot = {};
+            slot.cpu = -1;
+            slots_.push_back(slot);
+        }
+    }
+    total_ = slots_.size();
 }
 
 static void unlock_mutex(void *arg) {
@@ -39,46 +174,116 @@ int CoreManager::acquire(int need, int greed) {
     npassert(need >= 1);
     npassert(greed >= need);
 
-    int got = 0;
+    int got;
+    pthread_mutex_lock(&mu_);
+    pthread_cleanup_push(unlock_mutex, &mu_);
+    while (total_ - used_ < need)
+        pthread_cond_wait(&cv_, &mu_);
+    got = take(greed);
+    pthread_cleanup_pop(true);
+    return got;
+}
 
-    while (got < need) {
-        pthread_mutex_lock(&mu_);
-        pthread_cleanup_push(unlock_mutex, &mu_);
-        if (used_ < total_) {
-            ++got;
-            ++used_;
-        } else {
-            pthread_cond_wait(&cv_, &mu_);
-        }
-        pthread_cleanup_pop(true);
+// hands out free cores to the calling thread. the cores it had last
+// time come first, then cores sharing their cache, and then whichever
+// cache domain has the most cores free, so new threads spread out.
+int CoreManager::take(int greed) {
+    pthread_t self = pthread_self();
+    std::set<int> home;
+    std::map<int, int> free;
+    for (const Slot &slot : slots_) {
+        if (!slot.used)
+            ++free[slot.llc];
+        if (slot.seen && pthread_equal(slot.last, self))
+            home.insert(slot.llc);
     }
-
-    while (got < greed) {
-        errno_t err;
-        if (pthread_mutex_trylock(&mu_))
-            break;
-        if (used_ < total_) {
-            ++got;
-            ++used_;
+    std::vector<std::pair<std::pair<int, int>, int>> order;
+    for (int i = 0; i < total_; ++i) {
+        const Slot &slot = slots_[i];
+        if (slot.used)
+            continue;
+        int rank;
+        if (slot.seen && pthread_equal(slot.last, self)) {
+            rank = 0;
+        } else if (home.count(slot.llc)) {
+            rank = 1;
         } else {
-            greed = got;
+            rank = 2;
         }
-        pthread_mutex_unlock(&mu_);
+        order.push_back({{rank, -free[slot.llc]}, i});
     }
-
+    std::sort(order.begin(), order.end(), [this](const auto &a, const auto &b) {
+        if (a.first != b.first)
+            return a.first < b.first;
+        if (slots_[a.second].llc != slots_[b.second].llc)
+            return slots_[a.second].llc < slots_[b.second].llc;
+        return a.second < b.second;
+    });
+    int got = std::min(greed, (int)order.size());
+    for (int i = 0; i < got; ++i) {
+        Slot &slot = slots_[order[i].second];
+        slot.used = true;
+        slot.seen = true;
+        slot.owner = self;
+        slot.last = self;
+    }
+    used_ += got;
     return got;
 }
 
 void CoreManager::release(int count) {
     bool ok;
+    pthread_t self = pthread_self();
     pthread_mutex_lock(&mu_);
-    if ((used_ -= count) >= 0) {
-        ok = true;
-    } else {
-        ok = false;
-        used_ = 0;
+    for (Slot &slot : slots_) {
+        if (count && slot.used && pthread_equal(slot.owner, self)) {
+            slot.used = false;
+            --used_;
+            --count;
+        }
     }
-    pthread_cond_signal(&cv_);
+    ok = !count;
+    pthread_cond_broadcast(&cv_);
     pthread_mutex_unlock(&mu_);
     npassert(ok);
 }
+
+/**
+ * Returns cpus held by calling thread, or zero if topology is unknown.
+ */
+int CoreManager::cpus(int *out, int max) {
+    int n = 0;
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&mu_);
+    for (const Slot &slot : slots_)
+        if (n < max && slot.cpu >= 0 && slot.used && pthread_equal(slot.owner, self))
+            out[n++] = slot.cpu;
+    pthread_mutex_unlock(&mu_);
+    return n;
+}
+
+void CoreManager::pin(int cpu) {
+    if (!pinnable_ || cpu < 0 || cpu >= CPU_SETSIZE)
+        return;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+}
+
+void CoreManager::unpin() {
+    if (pinnable_)
+        pthread_setaffinity_np(pthread_self(), sizeof(affinity_), &affinity_);
+}
+
+int llamafile_cores_get(int *cpus, int max) {
+    return g_core_manager.cpus(cpus, max);
+}
+
+void llamafile_cores_pin(int cpu) {
+    g_core_manager.pin(cpu);
+}
+
+void llamafile_cores_unpin(void) {
+    g_core_manager.unpin();
+}
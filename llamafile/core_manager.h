@@ -17,18 +17,83 @@
 
 #pragma once
 #include <pthread.h>
+#include <sched.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int llamafile_cores_get(int *, int);
+void llamafile_cores_pin(int);
+void llamafile_cores_unpin(void);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+#include <vector>
+
+// hands out cpu cores to threads that want to do math
+//
+// if the linux sysfs cpu topology is available, then specific cores
+// are handed out, using one logical cpu per physical core and never
+// the efficiency cores of hybrid chips. a thread that comes back for
+// more cores gets the ones it had last time if they're still free,
+// otherwise ones sharing the same last level cache. if there's no
+// topology we just count up to cpu_get_num_math() like before.
 class CoreManager {
   public:
+    struct Cpu {
+        int id; // logical cpu number
+        int core; // lowest cpu sharing this physical core
+        int llc; // lowest cpu sharing the last level cache
+        int capacity; // relative performance, or zero if unknown
+        bool math; // first smt sibling of a performance core
+    };
+
     CoreManager();
+    explicit CoreManager(const char *);
     int acquire(int, int);
     void release(int);
+    int cpus(int *, int);
+    void pin(int);
+    void unpin();
+
+    int total() const {
+        return total_;
+    }
+
+    const std::vector<Cpu> &topology() const {
+        return topology_;
+    }
 
   private:
+    struct Slot {
+        int cpu; // or -1 if topology is unknown
+        int llc;
+        bool used;
+        bool seen;
+        pthread_t owner; // valid if used
+        pthread_t last; // valid if seen
+    };
+
+    void init(const char *, bool);
+    int take(int);
+
     int used_;
     int total_;
+    bool pinnable_;
+    cpu_set_t affinity_;
+    std::vector<Cpu> topology_;
+    std::vector<Slot> slots_;
     pthread_cond_t cv_;
     pthread_mutex_t mu_;
 };
 
+std::vector<CoreManager::Cpu> cpu_get_topology(const char *);
+bool sysfs_read_line(const std::string &, std::string *);
+std::vector<int> sysfs_parse_list(const std::string &);
+
 extern CoreManager g_core_manager;
+
+#endif
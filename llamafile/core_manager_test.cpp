@@ -0,0 +1,193 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core_manager.h"
+
+#include <cosmo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "llama.cpp/cores.h"
+
+// fake sysfs of a hybrid chip with two l3 cache domains
+//
+//   - cpus 0-7 are four smt performance cores sharing an l3
+//   - cpus 8-15 are four smt performance cores sharing an l3
+//   - cpus 16-19 are efficiency cores sharing the second l3
+
+char g_root[64];
+
+void put(const std::string &path, const std::string &content) {
+    for (size_t i = 1; (i = path.find('/', i)) != std::string::npos; ++i)
+        mkdir(path.substr(0, i).c_str(), 0755);
+    FILE *f = fopen(path.c_str(), "w");
+    npassert(f);
+    fputs(content.c_str(), f);
+    fputc('\n', f);
+    npassert(!fclose(f));
+}
+
+void make_sysfs() {
+    strcpy(g_root, "/tmp/core_manager_test.XXXXXX");
+    npassert(mkdtemp(g_root));
+    put(std::string(g_root) + "/online", "0-19");
+    for (int cpu = 0; cpu < 20; ++cpu) {
+        std::string dir = std::string(g_root) + "/cpu" + std::to_string(cpu);
+        bool ecore = cpu >= 16;
+        int core = ecore ? cpu : cpu & -2;
+        if (ecore) {
+            put(dir + "/topology/thread_siblings_list", std::to_string(cpu));
+        } else {
+            put(dir + "/topology/thread_siblings_list",
+                std::to_string(core) + "," + std::to_string(core + 1));
+        }
+        put(dir + "/cache/index0/level", "1");
+        put(dir + "/cache/index0/shared_cpu_list", std::to_string(core));
+        put(dir + "/cache/index1/level", "2");
+        put(dir + "/cache/index1/shared_cpu_list", std::to_string(core));
+        put(dir + "/cache/index2/level", "3");
+        put(dir + "/cache/index2/shared_cpu_list", cpu < 8 ? "0-7" : "8-19");
+        put(dir + "/cpufreq/cpuinfo_max_freq", ecore ? "4300000" : cpu == 2 ? "5800000" : "5400000");
+    }
+}
+
+void test_topology() {
+    std::vector<CoreManager::Cpu> cpus = cpu_get_topology(g_root);
+    npassert(cpus.size() == 20);
+    for (const CoreManager::Cpu &cpu : cpus) {
+        npassert(cpu.core == (cpu.id < 16 ? cpu.id & -2 : cpu.id));
+        npassert(cpu.llc == (cpu.id < 8 ? 0 : 8));
+        npassert(cpu.math == (cpu.id < 16 && !(cpu.id & 1)));
+    }
+}
+
+int get(CoreManager &cm, int *cpus) {
+    int n = cm.cpus(cpus, 20);
+    for (int i = 0; i < n; ++i)
+        npassert(cpus[i] < 16 && !(cpus[i] & 1));
+    return n;
+}
+
+int llc(int cpu) {
+    return cpu < 8 ? 0 : 8;
+}
+
+void test_sticky() {
+    int a[20], b[20];
+    CoreManager cm(g_root);
+    npassert(cm.total() == 8);
+
+    // a single slot keeps its cores within one l3 domain
+    npassert(cm.acquire(1, 3) == 3);
+    npassert(get(cm, a) == 3);
+    npassert(llc(a[0]) == llc(a[1]) && llc(a[1]) == llc(a[2]));
+
+    // and gets the exact same cores back on the next step
+    cm.release(3);
+    npassert(!cm.cpus(b, 20));
+    npassert(cm.acquire(1, 3) == 3);
+    npassert(get(cm, b) == 3);
+    npassert(!memcmp(a, b, sizeof(int) * 3));
+
+    // asking for more grows within the same l3 domain first
+    cm.release(3);
+    npassert(cm.acquire(1, 4) == 4);
+    npassert(get(cm, b) == 4);
+    for (int i = 0; i < 4; ++i)
+        npassert(llc(b[i]) == llc(a[0]));
+    cm.release(4);
+}
+
+struct Other {
+    CoreManager *cm;
+    int greed;
+    int got;
+    int cpus[20];
+    int n;
+};
+
+void *other_slot(void *arg) {
+    Other *o = (Other *)arg;
+    o->got = o->cm->acquire(1, o->greed);
+    o->n = get(*o->cm, o->cpus);
+    o->cm->release(o->got);
+    return 0;
+}
+
+void test_concurrent() {
+    int a[20];
+    CoreManager cm(g_root);
+
+    // a second slot avoids the l3 domain that's busy
+    npassert(cm.acquire(1, 2) == 2);
+    npassert(get(cm, a) == 2);
+    pthread_t th;
+    Other o = {&cm, 2};
+    npassert(!pthread_create(&th, 0, other_slot, &o));
+    npassert(!pthread_join(th, 0));
+    npassert(o.got == 2 && o.n == 2);
+    for (int i = 0; i < 2; ++i) {
+        npassert(llc(o.cpus[i]) != llc(a[0]));
+        npassert(o.cpus[i] != a[0] && o.cpus[i] != a[1]);
+    }
+
+    // greed is capped by whatever is still free
+    o.greed = 8;
+    npassert(!pthread_create(&th, 0, other_slot, &o));
+    npassert(!pthread_join(th, 0));
+    npassert(o.got == 6 && o.n == 6);
+    cm.release(2);
+}
+
+void test_blocking() {
+    CoreManager cm(g_root);
+    npassert(cm.acquire(8, 8) == 8);
+    pthread_t th;
+    Other o = {&cm, 1};
+    npassert(!pthread_create(&th, 0, other_slot, &o));
+    usleep(10000);
+    npassert(!o.got);
+    cm.release(8);
+    npassert(!pthread_join(th, 0));
+    npassert(o.got == 1 && o.n == 1);
+}
+
+void test_fallback() {
+    int a[20];
+    CoreManager cm((std::string(g_root) + "/nonexistent").c_str());
+    npassert(cm.topology().empty());
+    npassert(cm.total() == cpu_get_num_math());
+    npassert(cm.acquire(1, 1) == 1);
+    npassert(!cm.cpus(a, 20));
+    cm.release(1);
+}
+
+int main(int argc, char *argv[]) {
+    ShowCrashReports();
+    make_sysfs();
+    test_topology();
+    test_sticky();
+    test_concurrent();
+    test_blocking();
+    test_fallback();
+    npassert(!rmrf(g_root));
+    CheckForMemoryLeaks();
+}
@@ -40,6 +40,7 @@ bool FLAGS_READY = false;
 bool FLAG_ascii = false;
 bool FLAG_completion_mode = false;
 bool FLAG_fast = false;
+bool FLAG_hugepages = false;
 bool FLAG_iq = false;
 bool FLAG_log_disable = false;
 bool FLAG_mlock = false;
@@ -63,6 +64,7 @@ const char *FLAG_listen = "127.0.0.1:8080";
 const char *FLAG_mmproj = nullptr;
 const char *FLAG_model = nullptr;
 const char *FLAG_prompt = nullptr;
+const char *FLAG_session = nullptr;
 const char *FLAG_url_prefix = "";
 const char *FLAG_www_root = "/zip/www";
 double FLAG_token_rate = 1;
@@ -82,6 +84,7 @@ int FLAG_http_obuf_size = 1024 * 1024;
 int FLAG_keepalive = 5;
 int FLAG_main_gpu = 0;
 int FLAG_n_gpu_layers = -1;
+int FLAG_numa = LLAMAFILE_NUMA_NONE;
 int FLAG_slots = 1;
 int FLAG_split_mode = LLAMA_SPLIT_MODE_LAYER;
 int FLAG_threads = MIN(cpu_get_num_math(), 20);
@@ -557,6 +560,20 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--hugepages")) {
+            FLAG_hugepages = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--numa")) {
+            if (i == argc)
+                missing("--numa");
+            FLAG_numa = llamafile_numa_parse(argv[i++]);
+            if (FLAG_numa == LLAMAFILE_NUMA_ERROR)
+                bad("--numa");
+            continue;
+        }
+
         //////////////////////////////////////////////////////////////////////
         // gpu flags
 
@@ -643,6 +660,12 @@ void llamafile_get_flags(int argc, char **argv) {
     if (!FLAG_model)
         required("--model");
 
+    // find sharded weights and projector inside llamafiles
+    if (char *path = llamafile_zip_gguf(FLAG_model, false))
+        FLAG_model = path;
+    if (!FLAG_mmproj)
+        FLAG_mmproj = llamafile_zip_gguf(FLAG_model, true);
+
     FLAGS_READY = true;
     FLAG_n_gpu_layers = llamafile_gpu_layers(FLAG_n_gpu_layers);
 }
@@ -16,11 +16,17 @@
 // limitations under the License.
 
 #include "llama.h"
+#include "bpe.h"
 #include "llama.cpp/llama.h"
+#include <atomic>
 #include <cassert>
+#include <pthread.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#define kMaxPieceTables 4
+
 int llamafile_token_eot(llama_model *model) {
     llama_token eot = llama_token_eot(model);
     if (eot != -1)
@@ -28,25 +34,127 @@ int llamafile_token_eot(llama_model *model) {
     return llama_token_eos(model);
 }
 
-std::string llamafile_token_to_piece(const llama_context *ctx, llama_token token, bool special) {
-    std::string piece;
-    piece.resize(piece.capacity());
-    const int n_chars =
-        llama_token_to_piece(llama_get_model(ctx), token, &piece[0], piece.size(), 0, special);
+// the detokenized pieces of every token in a model's vocabulary
+//
+// generating text means appending a piece for each token sampled, so
+// rather than asking llama.cpp to render the same tokens over and over
+// into freshly allocated strings, we render the whole vocabulary once
+// when the model is loaded, in both special and non-special modes, and
+// store them in one contiguous string. token i's piece starts at index
+// offsets[i * 2 + special] and ends at the next offset.
+struct PieceTable {
+    std::string bytes;
+    std::vector<unsigned> offsets;
+};
+
+struct PieceTables {
+    std::atomic<const llama_model *> model[kMaxPieceTables];
+    PieceTable *table[kMaxPieceTables];
+};
+
+static PieceTables g_pieces;
+static pthread_mutex_t g_pieces_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void render_piece(std::string *out, const llama_model *model, llama_token token,
+                         bool special) {
+    size_t n = out->size();
+    out->resize(n + 16);
+    int n_chars = llama_token_to_piece(model, token, &(*out)[n], 16, 0, special);
     if (n_chars < 0) {
-        piece.resize(-n_chars);
-        int check =
-            llama_token_to_piece(llama_get_model(ctx), token, &piece[0], piece.size(), 0, special);
+        out->resize(n - n_chars);
+        int check = llama_token_to_piece(model, token, &(*out)[n], -n_chars, 0, special);
         unassert(check == -n_chars);
     } else {
-        piece.resize(n_chars);
+        out->resize(n + n_chars);
+    }
+}
+
+/**
+ * Renders pieces of all tokens in vocabulary of model.
+ *
+ * This should be called after the model is loaded, before any threads
+ * use it. Tokens of models that haven't been loaded into the piece
+ * table will still work but they'll be slower.
+ */
+void llamafile_pieces_load(const llama_model *model) {
+    PieceTable *table = new PieceTable;
+    int n_vocab = llama_n_vocab(model);
+    table->offsets.resize(n_vocab * 2 + 1);
+    for (int i = 0; i < n_vocab * 2; ++i) {
+        table->offsets[i] = table->bytes.size();
+        render_piece(&table->bytes, model, i / 2, i & 1);
+    }
+    table->offsets[n_vocab * 2] = table->bytes.size();
+    table->bytes.shrink_to_fit();
+    pthread_mutex_lock(&g_pieces_lock);
+    for (int i = 0; i < kMaxPieceTables; ++i) {
+        if (!g_pieces.model[i].load(std::memory_order_relaxed)) {
+            g_pieces.table[i] = table;
+            g_pieces.model[i].store(model, std::memory_order_release);
+            table = nullptr;
+            break;
+        }
     }
+    pthread_mutex_unlock(&g_pieces_lock);
+    delete table;
+}
+
+/**
+ * Frees piece table of model.
+ *
+ * This must be called before the model is freed, once no other thread
+ * is detokenizing with it.
+ */
+void llamafile_pieces_free(const llama_model *model) {
+    pthread_mutex_lock(&g_pieces_lock);
+    for (int i = 0; i < kMaxPieceTables; ++i) {
+        if (g_pieces.model[i].load(std::memory_order_relaxed) == model) {
+            g_pieces.model[i].store(nullptr, std::memory_order_relaxed);
+            delete g_pieces.table[i];
+            g_pieces.table[i] = nullptr;
+        }
+    }
+    pthread_mutex_unlock(&g_pieces_lock);
+}
+
+/**
+ * Returns text of token.
+ *
+ * The returned view is valid until the model's piece table is freed
+ * or, if the model doesn't have one, until the next call on the same
+ * thread. Use `str += llamafile_token_piece(...)` to append to buffer
+ * without creating a temporary string.
+ */
+std::string_view llamafile_token_piece(const llama_context *ctx, llama_token token, bool special) {
+    const llama_model *model = llama_get_model(ctx);
+    for (int i = 0; i < kMaxPieceTables; ++i) {
+        if (g_pieces.model[i].load(std::memory_order_acquire) == model) {
+            const PieceTable *table = g_pieces.table[i];
+            if (token < 0 || token * 2 + 1 >= (int)table->offsets.size())
+                break;
+            unsigned beg = table->offsets[token * 2 + special];
+            unsigned end = table->offsets[token * 2 + special + 1];
+            return std::string_view(table->bytes.data() + beg, end - beg);
+        }
+    }
+    static thread_local std::string piece;
+    piece.clear();
+    render_piece(&piece, model, token, special);
     return piece;
 }
 
+std::string llamafile_token_to_piece(const llama_context *ctx, llama_token token, bool special) {
+    return std::string(llamafile_token_piece(ctx, token, special));
+}
+
 std::vector<llama_token> llamafile_tokenize(const struct llama_model *model,
                                             const std::string_view &text, bool add_special,
                                             bool parse_special) {
+    if (!parse_special) {
+        std::vector<llama_token> result;
+        if (llamafile_bpe_tokenize(model, text, add_special, &result))
+            return result;
+    }
     int n_tokens = text.size() + 2 * add_special;
     std::vector<llama_token> result(n_tokens);
     n_tokens = llama_tokenize(model, text.data(), text.size(), result.data(), result.size(),
@@ -42,5 +42,8 @@ struct llama_context;
 
 int llamafile_token_eot(llama_model *);
 
+void llamafile_pieces_load(const llama_model *);
+void llamafile_pieces_free(const llama_model *);
+std::string_view llamafile_token_piece(const llama_context *, int, bool);
 std::string llamafile_token_to_piece(const llama_context *, int, bool);
 std::vector<int> llamafile_tokenize(const llama_model *, const std::string_view &, bool, bool);
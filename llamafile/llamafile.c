@@ -19,14 +19,18 @@
 #include "zip.h"
 #include <assert.h>
 #include <cosmo.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #define Min(a, b) ((a) < (b) ? (a) : (b))
@@ -58,43 +62,75 @@ struct llamafile {
     atomic_int refs;
 };
 
-static struct llamafile *llamafile_open_zip(const char *prog, const char *fname, const char *mode) {
-    int fd = -1;
-    uint8_t *bufdata = NULL;
-    size_t cdirsize = 0;
-    uint8_t *cdirdata = NULL;
-    struct llamafile *file = NULL;
+struct llamafile_zip_entry {
+    char *name;
+    int namelen;
+    int method;
+    uint64_t offset; // of local file header
+    uint64_t size;
+};
 
-    if (!(file = calloc(1, sizeof(struct llamafile))))
-        return 0;
-    strlcpy(file->fname, prog, PATH_MAX);
+// central directory of a pkzip archive, hashed by file name
+//
+// sharded models cause the same archive to be opened many times, and
+// llamafiles can have thousands of assets, so we only parse it once.
+struct llamafile_zip {
+    struct llamafile_zip *next;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtim;
+    unsigned count;
+    unsigned mask;
+    unsigned *table; // entry index plus one, or zero if slot is empty
+    struct llamafile_zip_entry *entries;
+};
 
-    // try opening from this executable's zip store
-    if ((fd = open(prog, O_RDONLY | O_CLOEXEC)) == -1) {
-        free(file);
-        return 0;
+static pthread_mutex_t g_zips_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct llamafile_zip *g_zips;
+
+static uint32_t llamafile_hash(const char *s, int n) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < n; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
     }
-    ssize_t rc;
-    if ((rc = lseek(fd, 0, SEEK_END)) == -1)
-        goto Failure;
-    file->size = rc;
+    return h;
+}
+
+static void llamafile_zip_free(struct llamafile_zip *zip) {
+    if (zip->entries)
+        for (unsigned i = 0; i < zip->count; ++i)
+            free(zip->entries[i].name);
+    free(zip->entries);
+    free(zip->table);
+    free(zip);
+}
+
+static struct llamafile_zip *llamafile_zip_read(const char *prog, int fd, size_t size,
+                                                bool quiet) {
+    uint8_t *bufdata = NULL;
+    size_t cdirsize = 0;
+    uint8_t *cdirdata = NULL;
+    struct llamafile_zip *zip = NULL;
 
     // read the last 64kb of file
     // the zip file format magic can be anywhere in there
     int amt;
     uint64_t off;
-    if (file->size <= 65536) {
+    if (size <= 65536) {
         off = 0;
-        amt = file->size;
+        amt = size;
     } else {
-        off = file->size - 65536;
-        amt = file->size - off;
+        off = size - 65536;
+        amt = size - off;
     }
     if (!(bufdata = gc(malloc(65536))))
         goto Failure;
     if (pread(fd, bufdata, amt, off) != amt) {
-        fprintf(stderr, "%s: warning: failed to read last 64kb of file: %s\n", prog,
-                strerror(errno));
+        if (!quiet)
+            fprintf(stderr, "%s: warning: failed to read last 64kb of file: %s\n", prog,
+                    strerror(errno));
         goto Failure;
     }
 
@@ -127,7 +163,8 @@ static struct llamafile *llamafile_open_zip(const char *prog, const char *fname,
     }
     if (cnt <= 0) {
         // this executable isn't a zip file
-        fprintf(stderr, "%s: warning: not a pkzip archive\n", prog);
+        if (!quiet)
+            fprintf(stderr, "%s: warning: not a pkzip archive\n", prog);
         goto Invalid;
     }
 
@@ -136,55 +173,167 @@ static struct llamafile *llamafile_open_zip(const char *prog, const char *fname,
     if (!(cdirdata = gc(malloc(cdirsize))))
         goto Failure;
     if (pread(fd, cdirdata, cdirsize, off) != (long)cdirsize) {
-        fprintf(stderr, "%s: warning: failed to pread zip cdir: %s\n", prog, strerror(errno));
+        if (!quiet)
+            fprintf(stderr, "%s: warning: failed to pread zip cdir: %s\n", prog,
+                    strerror(errno));
         goto Failure;
     }
     if (ZIP_READ32(cdirdata) != kZipCfileHdrMagic) {
-        fprintf(stderr, "%s: warning: failed to locate zip central directory\n", prog);
+        if (!quiet)
+            fprintf(stderr, "%s: warning: failed to locate zip central directory\n", prog);
         goto Invalid;
     }
 
-    // look for filename in the directory
-    int found = 0;
-    char *zip_name = 0;
-    unsigned cdir_offset;
-    int fname_len = fname ? strlen(fname) : 0;
+    // index each file in the directory by its name
+    unsigned cap = 2;
+    while (cap < cnt * 2)
+        cap *= 2;
+    if (!(zip = calloc(1, sizeof(struct llamafile_zip))) ||
+        !(zip->entries = calloc(cnt, sizeof(struct llamafile_zip_entry))) ||
+        !(zip->table = calloc(cap, sizeof(unsigned))))
+        goto Failure;
+    zip->mask = cap - 1;
     unsigned entry_index, entry_offset;
     for (entry_index = entry_offset = 0;
          entry_index < cnt && entry_offset + kZipCfileHdrMinSize <= cdirsize &&
          entry_offset + ZIP_CFILE_HDRSIZE(cdirdata + entry_offset) <= cdirsize;
          ++entry_index, entry_offset += ZIP_CFILE_HDRSIZE(cdirdata + entry_offset)) {
-        if (ZIP_CFILE_MAGIC(cdirdata + entry_offset) != kZipCfileHdrMagic) {
+        const uint8_t *cfile = cdirdata + entry_offset;
+        if (ZIP_CFILE_MAGIC(cfile) != kZipCfileHdrMagic) {
             fprintf(stderr, "error: corrupted zip central directory entry magic: %s\n", prog);
-            errno = EINVAL;
-            goto Failure;
-        }
-        int entry_name_len = ZIP_CFILE_NAMESIZE(cdirdata + entry_offset);
-        const char *entry_name_bytes = ZIP_CFILE_NAME(cdirdata + entry_offset);
-        if ((fname ? (fname_len == entry_name_len && !memcmp(fname, entry_name_bytes, fname_len))
-                   : (entry_name_len > 5 &&
-                      !memcasecmp(entry_name_bytes + entry_name_len - 5, ".gguf", 5)))) {
-            zip_name = gc(strndup(entry_name_bytes, entry_name_len));
-            off = get_zip_cfile_offset(cdirdata + entry_offset);
-            file->size = get_zip_cfile_compressed_size(cdirdata + entry_offset);
-            cdir_offset = entry_offset;
-            ++found;
+            goto Invalid;
         }
+        struct llamafile_zip_entry *e = zip->entries + zip->count;
+        e->namelen = ZIP_CFILE_NAMESIZE(cfile);
+        if (!(e->name = strndup(ZIP_CFILE_NAME(cfile), e->namelen)))
+            goto Failure;
+        e->method = ZIP_CFILE_COMPRESSIONMETHOD(cfile);
+        e->offset = get_zip_cfile_offset(cfile);
+        e->size = get_zip_cfile_compressed_size(cfile);
+        unsigned h = llamafile_hash(e->name, e->namelen) & zip->mask;
+        while (zip->table[h])
+            h = (h + 1) & zip->mask;
+        zip->table[h] = ++zip->count;
+    }
+    return zip;
+
+Invalid:
+    errno = EINVAL;
+Failure:
+    if (zip)
+        llamafile_zip_free(zip);
+    return 0;
+}
+
+// returns index of central directory of archive, which is cached
+static struct llamafile_zip *llamafile_zip_get(const char *prog, int fd, bool quiet) {
+    struct stat st;
+    struct llamafile_zip *zip;
+    if (fstat(fd, &st))
+        return 0;
+    pthread_mutex_lock(&g_zips_lock);
+    for (zip = g_zips; zip; zip = zip->next)
+        if (zip->dev == st.st_dev && zip->ino == st.st_ino && zip->size == st.st_size &&
+            zip->mtim.tv_sec == st.st_mtim.tv_sec && zip->mtim.tv_nsec == st.st_mtim.tv_nsec)
+            break;
+    if (!zip && (zip = llamafile_zip_read(prog, fd, st.st_size, quiet))) {
+        zip->dev = st.st_dev;
+        zip->ino = st.st_ino;
+        zip->size = st.st_size;
+        zip->mtim = st.st_mtim;
+        zip->next = g_zips;
+        g_zips = zip;
     }
-    if (!found) {
+    pthread_mutex_unlock(&g_zips_lock);
+    return zip;
+}
+
+// returns index of entry with name, or -1 if not found
+static int llamafile_zip_find(const struct llamafile_zip *zip, const char *name, int len) {
+    for (unsigned h = llamafile_hash(name, len) & zip->mask; zip->table[h];
+         h = (h + 1) & zip->mask) {
+        const struct llamafile_zip_entry *e = zip->entries + zip->table[h] - 1;
+        if (e->namelen == len && !memcmp(e->name, name, len))
+            return zip->table[h] - 1;
+    }
+    return -1;
+}
+
+// returns n if name is like "foo-0000n-of-0000m.gguf"
+static int llamafile_shard(const char *name, int len) {
+    if (len < 20)
+        return 0;
+    int n = 0, m = 0;
+    const char *s = name + len - 20;
+    if (s[0] != '-' || memcmp(s + 6, "-of-", 4) || memcasecmp(s + 15, ".gguf", 5))
+        return 0;
+    for (int i = 0; i < 5; ++i) {
+        if (!isdigit(s[1 + i]) || !isdigit(s[10 + i]))
+            return 0;
+        n = n * 10 + s[1 + i] - '0';
+        m = m * 10 + s[10 + i] - '0';
+    }
+    return n <= m ? n : 0;
+}
+
+// chooses which gguf file to load when no name was specified
+//
+// the multimodal projector of a llava model is a separate gguf file
+// that has "mmproj" in its name. big models may be split into shards
+// and llama.cpp finds the rest of a set based on the name of the first
+// one. returns -1 if nothing was found, or -2 if it's ambiguous.
+static int llamafile_zip_pick(const struct llamafile_zip *zip, bool mmproj) {
+    int found = -1;
+    for (unsigned i = 0; i < zip->count; ++i) {
+        const struct llamafile_zip_entry *e = zip->entries + i;
+        if (e->namelen <= 5 || memcasecmp(e->name + e->namelen - 5, ".gguf", 5))
+            continue;
+        if (!!strcasestr(e->name, "mmproj") != mmproj)
+            continue;
+        if (llamafile_shard(e->name, e->namelen) > 1)
+            continue;
+        if (found != -1)
+            return -2;
+        found = i;
+    }
+    return found;
+}
+
+static struct llamafile *llamafile_open_zip(const char *prog, const char *fname, const char *mode) {
+    int fd = -1;
+    struct llamafile *file = NULL;
+    struct llamafile_zip *zip;
+
+    if (!(file = calloc(1, sizeof(struct llamafile))))
+        return 0;
+    strlcpy(file->fname, prog, PATH_MAX);
+
+    // try opening from this executable's zip store
+    if ((fd = open(prog, O_RDONLY | O_CLOEXEC)) == -1) {
+        free(file);
+        return 0;
+    }
+    if (!(zip = llamafile_zip_get(prog, fd, false)))
+        goto Failure;
+
+    // look for filename in the directory
+    int i = fname ? llamafile_zip_find(zip, fname, strlen(fname)) : llamafile_zip_pick(zip, false);
+    if (i == -1) {
         fprintf(stderr, "%s: error: no %s file found in zip archive\n", prog,
                 fname ? fname : ".gguf");
         goto Invalid;
     }
-    if (found != 1) {
-        // TODO: Support opening LLaVA llamafiles.
+    if (i == -2) {
         fprintf(stderr, "%s: error: multiple %s files found in zip archive\n", prog,
                 fname ? fname : ".gguf");
         goto Invalid;
     }
+    const struct llamafile_zip_entry *entry = zip->entries + i;
+    uint64_t off = entry->offset;
+    file->size = entry->size;
     strlcat(file->fname, "@", PATH_MAX);
-    strlcat(file->fname, zip_name, PATH_MAX);
-    if (ZIP_CFILE_COMPRESSIONMETHOD(cdirdata + cdir_offset) != kZipCompressionNone) {
+    strlcat(file->fname, entry->name, PATH_MAX);
+    if (entry->method != kZipCompressionNone) {
         fprintf(
             stderr,
             "%s: error: weights stored in the zip executable can't be stored using compression\n",
@@ -304,6 +453,44 @@ struct llamafile *llamafile_open_gguf(const char *fname, const char *mode) {
     return llamafile_open_zip(fname, 0, mode);
 }
 
+/**
+ * Finds weights inside a pkzip archive, e.g. a llamafile.
+ *
+ * If `path` is an archive holding a model that's been split into gguf
+ * shards, then "path@foo-00001-of-0000n.gguf" is returned, since that
+ * is the name llama.cpp needs to find the rest of the shards. If the
+ * `mmproj` flag is set, then the multimodal projector is looked for
+ * instead, and `path` may also name a file within an archive.
+ *
+ * @return string that needs free(), or NULL if not applicable
+ */
+char *llamafile_zip_gguf(const char *path, bool mmproj) {
+    int fd, i;
+    char buf[4];
+    char *res = 0;
+    const char *p;
+    char zippath[PATH_MAX];
+    struct llamafile_zip *zip;
+    if ((p = strchr(path, '@'))) {
+        if (!mmproj)
+            return 0;
+        strlcpy(zippath, path, Min(p - path + 1, PATH_MAX));
+    } else {
+        strlcpy(zippath, path, PATH_MAX);
+    }
+    if ((fd = open(zippath, O_RDONLY | O_CLOEXEC)) == -1)
+        return 0;
+    if (pread(fd, buf, 4, 0) == 4 && ZIP_READ32(buf) != ZIP_READ32("GGUF") &&
+        ZIP_READ32(buf) != ZIP_READ32("ggml") && (zip = llamafile_zip_get(zippath, fd, true)) &&
+        (i = llamafile_zip_pick(zip, mmproj)) >= 0 &&
+        (mmproj || llamafile_shard(zip->entries[i].name, zip->entries[i].namelen))) {
+        if ((res = malloc(strlen(zippath) + 1 + zip->entries[i].namelen + 1)))
+            stpcpy(stpcpy(stpcpy(res, zippath), "@"), zip->entries[i].name);
+    }
+    close(fd);
+    return res;
+}
+
 FILE *llamafile_fp(struct llamafile *file) {
     return file->fp;
 }
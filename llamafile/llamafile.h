@@ -10,6 +10,7 @@ extern bool FLAGS_READY;
 extern bool FLAG_ascii;
 extern bool FLAG_completion_mode;
 extern bool FLAG_fast;
+extern bool FLAG_hugepages;
 extern bool FLAG_iq;
 extern bool FLAG_log_disable;
 extern bool FLAG_mlock;
@@ -33,6 +34,7 @@ extern const char *FLAG_listen;
 extern const char *FLAG_mmproj;
 extern const char *FLAG_model;
 extern const char *FLAG_prompt;
+extern const char *FLAG_session;
 extern const char *FLAG_url_prefix;
 extern const char *FLAG_www_root;
 extern double FLAG_token_rate;
@@ -53,6 +55,7 @@ extern int FLAG_http_obuf_size;
 extern int FLAG_keepalive;
 extern int FLAG_main_gpu;
 extern int FLAG_n_gpu_layers;
+extern int FLAG_numa;
 extern int FLAG_slots;
 extern int FLAG_split_mode;
 extern int FLAG_threads;
@@ -67,6 +70,7 @@ extern unsigned FLAG_seed;
 
 struct llamafile;
 struct llamafile *llamafile_open_gguf(const char *, const char *);
+char *llamafile_zip_gguf(const char *, bool);
 void llamafile_close(struct llamafile *);
 long llamafile_read(struct llamafile *, void *, size_t);
 long llamafile_write(struct llamafile *, const void *, size_t);
@@ -90,6 +94,7 @@ bool llamafile_has(char **, const char *);
 bool llamafile_extract(const char *, const char *);
 int llamafile_is_file_newer_than(const char *, const char *);
 void llamafile_schlep(const void *, size_t);
+void *llamafile_schlep_huge(const void *, size_t);
 void llamafile_get_app_dir(char *, size_t);
 void llamafile_launch_browser(const char *);
 void llamafile_get_flags(int, char **);
@@ -108,6 +113,12 @@ bool llamafile_has_amd_gpu(void);
 int llamafile_gpu_parse(const char *);
 const char *llamafile_describe_gpu(void);
 
+#define LLAMAFILE_NUMA_ERROR -1
+#define LLAMAFILE_NUMA_NONE 0
+#define LLAMAFILE_NUMA_INTERLEAVE 1
+#define LLAMAFILE_NUMA_REPLICATE 2
+int llamafile_numa_parse(const char *);
+
 #ifdef __cplusplus
 }
 #endif
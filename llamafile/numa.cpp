@@ -0,0 +1,322 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "numa.h"
+
+#include <cosmo.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "core_manager.h"
+#include "llamafile.h"
+#include "log.h"
+
+#define MPOL_DEFAULT 0
+#define MPOL_BIND 2
+#define MPOL_INTERLEAVE 3
+#define MPOL_MF_MOVE 2
+
+#define MAX_NODE_ID 1024
+
+NumaManager g_numa_manager;
+
+static thread_local int g_node = -1;
+
+// cosmopolitan doesn't wrap the linux memory policy system calls
+static long sys_numa_raw(long x86, long arm, long a, long b, long c, long d, long e, long f) {
+#if defined(__x86_64__)
+    long rax;
+    register long r10 asm("r10") = d;
+    register long r8 asm("r8") = e;
+    register long r9 asm("r9") = f;
+    asm volatile("syscall"
+                 : "=a"(rax)
+                 : "0"(x86), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+                 : "rcx", "r11", "memory");
+    return rax;
+#elif defined(__aarch64__)
+    register long x8 asm("x8") = arm;
+    register long x0 asm("x0") = a;
+    register long x1 asm("x1") = b;
+    register long x2 asm("x2") = c;
+    register long x3 asm("x3") = d;
+    register long x4 asm("x4") = e;
+    register long x5 asm("x5") = f;
+    asm volatile("svc\t0"
+                 : "+r"(x0)
+                 : "r"(x8), "r"(x1), "r"(x2), "r"(x3), "r"(x4), "r"(x5)
+                 : "memory");
+    return x0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+static long sys_numa(long x86, long arm, long a, long b, long c, long d, long e, long f) {
+    long rc = sys_numa_raw(x86, arm, a, b, c, d, e, f);
+    if (rc < 0 && rc > -4096) {
+        errno = -rc;
+        return -1;
+    }
+    return rc;
+}
+
+static long sys_mbind(void *addr, size_t len, int mode, const unsigned long *mask, unsigned flags) {
+    return sys_numa(237, 235, (long)addr, len, mode, (long)mask, MAX_NODE_ID + 1, flags);
+}
+
+static long sys_set_mempolicy(int mode, const unsigned long *mask) {
+    return sys_numa(238, 237, mode, (long)mask, mask ? MAX_NODE_ID + 1 : 0, 0, 0, 0);
+}
+
+/**
+ * Reads numa node layout from sysfs, e.g. "/sys/devices/system/node".
+ *
+ * Nodes that don't have any cpus, e.g. cxl memory expanders, aren't
+ * returned. Returns empty vector if unavailable.
+ */
+std::vector<NumaManager::Node> numa_get_topology(const char *sysfs) {
+    std::string line;
+    std::string root = sysfs;
+    std::vector<NumaManager::Node> nodes;
+    if (!sysfs_read_line(root + "/online", &line))
+        return nodes;
+    for (int id : sysfs_parse_list(line)) {
+        if (id >= MAX_NODE_ID)
+            break;
+        NumaManager::Node node = {id};
+        if (sysfs_read_line(root + "/node" + std::to_string(id) + "/cpulist", &line))
+            node.cpus = sysfs_parse_list(line);
+        if (!node.cpus.empty())
+            nodes.push_back(node);
+    }
+    return nodes;
+}
+
+NumaManager::NumaManager() : n_regions_(0), mu_(PTHREAD_MUTEX_INITIALIZER) {
+    init("/sys/devices/system/node", true);
+}
+
+NumaManager::NumaManager(const char *sysfs) : n_regions_(0), mu_(PTHREAD_MUTEX_INITIALIZER) {
+    init(sysfs, false);
+}
+
+void NumaManager::init(const char *sysfs, bool bindable) {
+    bindable_ = bindable && IsLinux();
+    nodes_ = numa_get_topology(sysfs);
+    if (nodes_.size() > kMaxNodes)
+        nodes_.resize(kMaxNodes);
+    for (int i = 0; i < nodes(); ++i) {
+        for (int cpu : nodes_[i].cpus) {
+            if (cpu >= (int)cpu_node_.size())
+                cpu_node_.resize(cpu + 1, -1);
+            cpu_node_[cpu] = i;
+        }
+    }
+    for (Region &r : regions_) {
+        r.base = nullptr;
+        r.size = 0;
+    }
+}
+
+/**
+ * Returns index of node in topology() that `cpu` belongs to, or -1.
+ */
+int NumaManager::node(int cpu) const {
+    if (cpu < 0 || cpu >= (int)cpu_node_.size())
+        return -1;
+    return cpu_node_[cpu];
+}
+
+/**
+ * Spreads or copies read-only memory across numa nodes.
+ *
+ * This does nothing and returns false if there's only a single node.
+ * The memory must not change or be unmapped until unplace() is called.
+ */
+bool NumaManager::place(void *addr, size_t size, int mode) {
+    if (nodes() < 2 || !size)
+        return false;
+    switch (mode) {
+    case LLAMAFILE_NUMA_INTERLEAVE:
+        return interleave(addr, size);
+    case LLAMAFILE_NUMA_REPLICATE:
+        return replicate(addr, size);
+    default:
+        return false;
+    }
+}
+
+// the kernel allocates page cache using the memory policy of the
+// thread that faults it in, so we fault everything in while under an
+// interleave policy. mbind() takes care of pages that were already in
+// the page cache, e.g. from posix_madvise(WILLNEED), by moving them.
+bool NumaManager::interleave(void *addr, size_t size) {
+    if (!bindable_)
+        return true;
+    unsigned long mask[MAX_NODE_ID / 64] = {};
+    for (const Node &node : nodes_)
+        mask[node.id / 64] |= 1ul << node.id % 64;
+    long pagesz = getpagesize();
+    char *beg = (char *)((uintptr_t)addr & -pagesz);
+    char *end = (char *)addr + size;
+    sys_mbind(beg, end - beg, MPOL_INTERLEAVE, mask, MPOL_MF_MOVE);
+    if (sys_set_mempolicy(MPOL_INTERLEAVE, mask) < 0)
+        return false;
+    for (volatile char *p = beg; p < end; p += pagesz)
+        (void)*p;
+    sys_set_mempolicy(MPOL_DEFAULT, 0);
+    return true;
+}
+
+// each node gets an anonymous mapping that's bound to its memory
+bool NumaManager::replicate(void *addr, size_t size) {
+    pthread_mutex_lock(&mu_);
+    int i;
+    for (i = 0; i < kMaxRegions; ++i)
+        if (!regions_[i].base.load(std::memory_order_relaxed))
+            break;
+    if (i == kMaxRegions) {
+        pthread_mutex_unlock(&mu_);
+        return false;
+    }
+    int n;
+    Region &r = regions_[i];
+    for (n = 0; n < nodes(); ++n) {
+        void *p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            break;
+        r.copy[n] = (char *)p;
+        if (bindable_) {
+            unsigned long mask[MAX_NODE_ID / 64] = {};
+            mask[nodes_[n].id / 64] |= 1ul << nodes_[n].id % 64;
+            if (sys_mbind(p, size, MPOL_BIND, mask, 0) < 0) {
+                munmap(p, size);
+                break;
+            }
+        }
+        memcpy(p, addr, size);
+        mprotect(p, size, PROT_READ);
+    }
+    if (n < nodes()) {
+        while (n--)
+            munmap(r.copy[n], size);
+        pthread_mutex_unlock(&mu_);
+        return false;
+    }
+    r.size = size;
+    r.base.store((char *)addr, std::memory_order_release);
+    if (n_regions_.load(std::memory_order_relaxed) <= i)
+        n_regions_.store(i + 1, std::memory_order_release);
+    pthread_mutex_unlock(&mu_);
+    return true;
+}
+
+/**
+ * Frees replicas of memory that was passed to place().
+ *
+ * No thread may be computing on the replicas when this is called.
+ */
+void NumaManager::unplace(void *addr) {
+    if (!addr)
+        return;
+    pthread_mutex_lock(&mu_);
+    for (Region &r : regions_) {
+        if (r.base.load(std::memory_order_relaxed) != addr)
+            continue;
+        r.base.store(nullptr, std::memory_order_relaxed);
+        for (int n = 0; n < nodes(); ++n)
+            munmap(r.copy[n], r.size);
+        r.size = 0;
+    }
+    pthread_mutex_unlock(&mu_);
+}
+
+/**
+ * Chooses replicas on the node of `cpu` for the calling thread.
+ *
+ * If `cpu` is -1 then the cpu the thread is running on is used, which
+ * is only meaningful if something else has pinned the thread there.
+ */
+void NumaManager::bind(int cpu) {
+    if (!n_regions_.load(std::memory_order_relaxed))
+        return;
+    if (cpu < 0)
+        cpu = sched_getcpu();
+    g_node = node(cpu);
+}
+
+/**
+ * Translates pointer to the replica on the calling thread's node.
+ *
+ * Pointers outside placed memory, or calls from threads that haven't
+ * been bound to a node, are returned as is.
+ */
+void *NumaManager::local(const void *ptr) {
+    int node = g_node;
+    int count = n_regions_.load(std::memory_order_acquire);
+    if (node < 0 || !count)
+        return (void *)ptr;
+    const char *p = (const char *)ptr;
+    for (int i = 0; i < count; ++i) {
+        const Region &r = regions_[i];
+        const char *base = r.base.load(std::memory_order_acquire);
+        if (base && base <= p && p < base + r.size)
+            return r.copy[node] + (p - base);
+    }
+    return (void *)ptr;
+}
+
+int llamafile_numa_parse(const char *s) {
+    if (!strcasecmp(s, "none") || !strcasecmp(s, "disable"))
+        return LLAMAFILE_NUMA_NONE;
+    if (!strcasecmp(s, "interleave"))
+        return LLAMAFILE_NUMA_INTERLEAVE;
+    if (!strcasecmp(s, "replicate"))
+        return LLAMAFILE_NUMA_REPLICATE;
+    return LLAMAFILE_NUMA_ERROR;
+}
+
+void llamafile_numa_place(void *addr, size_t size) {
+    static bool once;
+    if (FLAG_numa == LLAMAFILE_NUMA_NONE)
+        return;
+    if (!g_numa_manager.place(addr, size, FLAG_numa) && !once) {
+        once = true;
+        if (g_numa_manager.nodes() < 2) {
+            tinylogf("warning: --numa was passed but only one numa node was found\n");
+        } else {
+            tinylogf("warning: failed to place weights on numa nodes: %s\n", strerror(errno));
+        }
+    }
+}
+
+void llamafile_numa_unplace(void *addr) {
+    g_numa_manager.unplace(addr);
+}
+
+void llamafile_numa_bind(int cpu) {
+    g_numa_manager.bind(cpu);
+}
+
+void *llamafile_numa_local(const void *ptr) {
+    return g_numa_manager.local(ptr);
+}
@@ -0,0 +1,95 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void llamafile_numa_place(void *, size_t);
+void llamafile_numa_unplace(void *);
+void llamafile_numa_bind(int);
+void *llamafile_numa_local(const void *);
+
+#ifdef __cplusplus
+}
+
+#include <atomic>
+#include <pthread.h>
+#include <vector>
+
+// places model weights on the memory of multi-socket systems
+//
+// weights are read-only once loaded, so there are two ways to keep
+// token generation from being limited to cross-socket bandwidth. we
+// can interleave the pages of the mapping across all nodes, so every
+// socket contributes its memory channels evenly. or we can give each
+// node its own copy of the weights, and have each compute thread use
+// the copy that's local to the cpu it's running on. the node layout
+// comes from the linux sysfs, e.g. "/sys/devices/system/node".
+class NumaManager {
+  public:
+    struct Node {
+        int id; // as in /sys/devices/system/node/node<id>
+        std::vector<int> cpus;
+    };
+
+    static constexpr int kMaxNodes = 64;
+    static constexpr int kMaxRegions = 16;
+
+    NumaManager();
+    explicit NumaManager(const char *);
+    bool place(void *, size_t, int);
+    void unplace(void *);
+    void bind(int);
+    void *local(const void *);
+    int node(int) const;
+
+    int nodes() const {
+        return nodes_.size();
+    }
+
+    const std::vector<Node> &topology() const {
+        return nodes_;
+    }
+
+  private:
+    struct Region {
+        std::atomic<char *> base;
+        size_t size;
+        char *copy[kMaxNodes];
+    };
+
+    void init(const char *, bool);
+    bool interleave(void *, size_t);
+    bool replicate(void *, size_t);
+
+    bool bindable_;
+    std::vector<Node> nodes_;
+    std::vector<int> cpu_node_; // cpu number to index in nodes_
+    Region regions_[kMaxRegions];
+    std::atomic<int> n_regions_;
+    pthread_mutex_t mu_;
+};
+
+std::vector<NumaManager::Node> numa_get_topology(const char *);
+
+extern NumaManager g_numa_manager;
+
+#endif
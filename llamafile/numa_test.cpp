@@ -0,0 +1,148 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "numa.h"
+
+#include <cosmo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+
+#include "llamafile.h"
+
+// fake sysfs of a dual socket server
+//
+//   - node0 has cpus 0-7 and 16-23
+//   - node1 has cpus 8-15 and 24-31
+//   - node2 is a memory expander with no cpus
+//   - a second tree where there's only node0
+
+char g_root[64];
+
+void put(const std::string &path, const std::string &content) {
+    for (size_t i = 1; (i = path.find('/', i)) != std::string::npos; ++i)
+        mkdir(path.substr(0, i).c_str(), 0755);
+    FILE *f = fopen(path.c_str(), "w");
+    npassert(f);
+    fputs(content.c_str(), f);
+    fputc('\n', f);
+    npassert(!fclose(f));
+}
+
+std::string dual() {
+    return std::string(g_root) + "/dual";
+}
+
+std::string single() {
+    return std::string(g_root) + "/single";
+}
+
+void make_sysfs() {
+    strcpy(g_root, "/tmp/numa_test.XXXXXX");
+    npassert(mkdtemp(g_root));
+    put(dual() + "/online", "0-2");
+    put(dual() + "/node0/cpulist", "0-7,16-23");
+    put(dual() + "/node1/cpulist", "8-15,24-31");
+    put(dual() + "/node2/cpulist", "");
+    put(single() + "/online", "0");
+    put(single() + "/node0/cpulist", "0-31");
+}
+
+void test_topology() {
+    NumaManager nm(dual().c_str());
+    npassert(nm.nodes() == 2);
+    npassert(nm.topology()[0].id == 0);
+    npassert(nm.topology()[1].id == 1);
+    npassert(nm.topology()[0].cpus.size() == 16);
+    for (int cpu = 0; cpu < 32; ++cpu)
+        npassert(nm.node(cpu) == (cpu & 8 ? 1 : 0));
+    npassert(nm.node(-1) == -1);
+    npassert(nm.node(32) == -1);
+}
+
+void test_replicate() {
+    NumaManager nm(dual().c_str());
+    size_t n = 100000;
+    char *weights = (char *)malloc(n);
+    for (size_t i = 0; i < n; ++i)
+        weights[i] = i * 7;
+    char other;
+
+    // nothing changes until memory has been placed
+    nm.bind(9);
+    npassert(nm.local(weights) == weights);
+
+    // each node gets its own copy
+    npassert(nm.place(weights, n, LLAMAFILE_NUMA_REPLICATE));
+    nm.bind(3);
+    char *a = (char *)nm.local(weights + 123);
+    nm.bind(27);
+    char *b = (char *)nm.local(weights + 123);
+    npassert(a != b);
+    npassert(a != weights + 123);
+    npassert(b != weights + 123);
+    npassert(!memcmp(a - 123, weights, n));
+    npassert(!memcmp(b - 123, weights, n));
+    npassert(nm.local(weights + n) == weights + n);
+    npassert(nm.local(&other) == &other);
+
+    // threads on cpus we don't know about use the original
+    nm.bind(99);
+    npassert(nm.local(weights + 123) == weights + 123);
+
+    nm.unplace(weights);
+    nm.bind(3);
+    npassert(nm.local(weights + 123) == weights + 123);
+    free(weights);
+}
+
+void test_single_node() {
+    char weights[64] = {};
+    NumaManager nm(single().c_str());
+    npassert(nm.nodes() == 1);
+    npassert(!nm.place(weights, sizeof(weights), LLAMAFILE_NUMA_REPLICATE));
+    npassert(!nm.place(weights, sizeof(weights), LLAMAFILE_NUMA_INTERLEAVE));
+    nm.bind(0);
+    npassert(nm.local(weights) == weights);
+}
+
+void test_fallback() {
+    NumaManager nm((std::string(g_root) + "/nonexistent").c_str());
+    npassert(!nm.nodes());
+    npassert(nm.node(0) == -1);
+}
+
+void test_parse() {
+    npassert(llamafile_numa_parse("none") == LLAMAFILE_NUMA_NONE);
+    npassert(llamafile_numa_parse("interleave") == LLAMAFILE_NUMA_INTERLEAVE);
+    npassert(llamafile_numa_parse("REPLICATE") == LLAMAFILE_NUMA_REPLICATE);
+    npassert(llamafile_numa_parse("distribute") == LLAMAFILE_NUMA_ERROR);
+}
+
+int main(int argc, char *argv[]) {
+    ShowCrashReports();
+    make_sysfs();
+    test_topology();
+    test_replicate();
+    test_single_node();
+    test_fallback();
+    test_parse();
+    npassert(!rmrf(g_root));
+    CheckForMemoryLeaks();
+}
@@ -15,25 +15,34 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "llama.cpp/cores.h"
 #include "llama.cpp/ggml.h"
+#include "llamafile/llamafile.h"
 #include "llamafile/log.h"
 #include <cosmo.h>
 #include <errno.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #define FPS 24
-#define THREADS 4
+#define CHUNK (2 * 1024 * 1024)
+#define MIN_THREADS 4
+#define MAX_THREADS 16
 
-struct PageFaulter {
-    long left;
-    long right;
-    long pagesz;
-    pthread_t th;
+struct Schlep {
     const char *data;
-    atomic_long *faults;
+    char *copy;
+    size_t size;
+    long pagesz;
+    atomic_size_t next;
+    atomic_size_t done;
 };
 
 static char Peek(volatile const char *ptr) {
@@ -42,11 +51,26 @@ static char Peek(volatile const char *ptr) {
 
 char (*pPeek)(volatile const char *) = Peek;
 
-static void *PageFaulter(void *arg) {
-    struct PageFaulter *pf = arg;
-    for (long i = pf->left; i < pf->right; i += pf->pagesz) {
-        pPeek(pf->data + i);
-        atomic_fetch_add_explicit(pf->faults, 1, memory_order_release);
+// workers claim chunks in file order, so they all pull from the same
+// region of the disk, and the tensors of the first layers, which gguf
+// stores first, become resident before the ones used at the end.
+static void *Schlepper(void *arg) {
+    size_t i;
+    struct Schlep *s = arg;
+    while ((i = atomic_fetch_add_explicit(&s->next, CHUNK, memory_order_relaxed)) < s->size) {
+        size_t n = s->size - i < CHUNK ? s->size - i : CHUNK;
+        const char *p = s->data + i;
+        // one big readahead request beats a page fault per 128kb
+        uintptr_t b = (uintptr_t)p & -s->pagesz;
+        posix_madvise((void *)b, (uintptr_t)p + n - b, POSIX_MADV_WILLNEED);
+        if (s->copy) {
+            memcpy(s->copy + i, p, n);
+        } else {
+            for (size_t j = 0; j < n; j += s->pagesz)
+                pPeek(p + j);
+            pPeek(p + n - 1);
+        }
+        atomic_fetch_add_explicit(&s->done, n, memory_order_release);
     }
     return 0;
 }
@@ -66,41 +90,34 @@ static void FormatPercent(char sbuf[static 8], double x) {
     *p = 0;
 }
 
-/**
- * Loads memory off disk while reporting progress.
- */
-void llamafile_schlep(const void *data, size_t size) {
-
-    // avoid warmup
-    if (!FLAG_warmup)
-        return;
-
-    // don't bother if logging is disabled
-    if (FLAG_log_disable)
-        return;
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-    // don't bother if memory is small
-    if (size < 128 * 1024 * 1024)
-        return;
+static void Schlep(const char *data, size_t size, char *copy, const char *what) {
 
-    // don't bother if stderr isn't a terminal
-    if (!isatty(2))
+    // don't bother with threads if memory is small
+    struct Schlep s = {data, copy, size, getpagesize()};
+    if (size < 128 * 1024 * 1024) {
+        Schlepper(&s);
         return;
+    }
 
     // launch threads
+    // loading is mostly waiting on i/o so we can use a few more
+    // threads than there are cores, for a deeper nvme queue
     errno_t err;
-    atomic_long faults = 0;
-    long pagesz = getpagesize();
-    long stride = size / THREADS;
-    long pages = (stride + pagesz - 1) / pagesz * THREADS;
-    struct PageFaulter pf[THREADS];
-    for (int i = 0; i < THREADS; ++i) {
-        pf[i].data = data;
-        pf[i].pagesz = pagesz;
-        pf[i].faults = &faults;
-        pf[i].left = stride * i;
-        pf[i].right = stride * (i + 1);
-        err = pthread_create(&pf[i].th, 0, PageFaulter, pf + i);
+    double start = Now();
+    int threads = cpu_get_num_math() * 2;
+    if (threads < MIN_THREADS)
+        threads = MIN_THREADS;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    pthread_t th[MAX_THREADS];
+    for (int i = 0; i < threads; ++i) {
+        err = pthread_create(&th[i], 0, Schlepper, &s);
         if (err) {
             errno = err;
             perror("pthread_create");
@@ -109,18 +126,66 @@ void llamafile_schlep(const void *data, size_t size) {
     }
 
     // report progress
+    bool report = !FLAG_log_disable && isatty(2);
     for (;;) {
         char percent[8];
-        long count = atomic_load_explicit(&faults, memory_order_acquire);
-        if (count == pages)
+        size_t count = atomic_load_explicit(&s.done, memory_order_acquire);
+        if (count == size)
             break;
-        FormatPercent(percent, (double)count / pages);
-        tinyprint(2, "\rmemory map ", percent, "% loaded...\033[K", NULL);
+        if (report) {
+            FormatPercent(percent, (double)count / size);
+            tinyprint(2, "\r", what, " ", percent, "% loaded...\033[K", NULL);
+        }
         usleep(1. / FPS * 1e6);
     }
-    tinyprint(2, "\r\033[K", NULL);
+    if (report)
+        tinyprint(2, "\r\033[K", NULL);
 
     // wait for workers
-    for (int i = 0; i < THREADS; ++i)
-        pthread_join(pf[i].th, 0);
+    for (int i = 0; i < threads; ++i)
+        pthread_join(th[i], 0);
+
+    double secs = Now() - start;
+    tinylogf("%s: loaded %.2f GB in %.3f seconds (%.2f GB/s) using %d threads\n", what,
+             size / 1e9, secs, size / 1e9 / secs, threads);
+}
+
+/**
+ * Loads memory off disk while reporting progress.
+ *
+ * This prefaults the pages of a read-only file mapping, so the first
+ * inference pass doesn't have to wait on the disk one fault at a time.
+ */
+void llamafile_schlep(const void *data, size_t size) {
+    if (!FLAG_warmup)
+        return;
+    Schlep(data, size, 0, "memory map");
+}
+
+/**
+ * Loads memory off disk into transparent huge pages.
+ *
+ * Weights are read all over the place during decode, so using 4096
+ * byte pages makes matmuls thrash the tlb. Anonymous memory can use 2
+ * megabyte pages on Linux, whereas the page cache usually can't. The
+ * returned memory is read-only and should be freed with munmap(). It
+ * costs a second copy of the weights until the page cache is evicted.
+ *
+ * @return copy of `data` or NULL w/ errno
+ */
+void *llamafile_schlep_huge(const void *data, size_t size) {
+    size_t huge = 2 * 1024 * 1024;
+    size_t len = (size + getpagesize() - 1) & -getpagesize();
+    char *p = mmap(0, len + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return 0;
+    char *q = (char *)(((uintptr_t)p + huge - 1) & -huge);
+    if (q > p)
+        munmap(p, q - p);
+    munmap(q + len, p + huge - q);
+    if (IsLinux())
+        madvise(q, len, MADV_HUGEPAGE);
+    Schlep(data, size, q, "huge pages");
+    mprotect(q, len, PROT_READ);
+    return q;
 }
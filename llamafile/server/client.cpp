@@ -688,23 +688,30 @@ Client::dispatcher()
     }
     p1 = p1.substr(1);
 
+    // look for endpoints of the program embedding us
+    for (const Endpoint* e = worker_->server_->endpoints_; e && e->path; ++e)
+        if (p1 == e->path)
+            return e->handler(this);
+
     // look for dynamic endpoints
-    if (p1 == "tokenize")
-        return tokenize();
-    if (p1 == "embedding")
-        return embedding();
-    if (p1 == "v1/embeddings")
-        return embedding();
-    if (p1 == "v1/completions")
-        return v1_completions();
-    if (p1 == "v1/chat/completions")
-        return v1_chat_completions();
-    if (p1 == "v1/models")
-        return v1_models();
-    if (p1 == "slotz")
-        return slotz();
-    if (p1 == "flagz")
-        return flagz();
+    if (model_) {
+        if (p1 == "tokenize")
+            return tokenize();
+        if (p1 == "embedding")
+            return embedding();
+        if (p1 == "v1/embeddings")
+            return embedding();
+        if (p1 == "v1/completions")
+            return v1_completions();
+        if (p1 == "v1/chat/completions")
+            return v1_chat_completions();
+        if (p1 == "v1/models")
+            return v1_models();
+        if (p1 == "slotz")
+            return slotz();
+        if (p1 == "flagz")
+            return flagz();
+    }
 
 #if 0
     // TODO: implement frontend for database
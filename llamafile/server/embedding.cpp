@@ -18,6 +18,7 @@
 #include "client.h"
 #include "llama.cpp/llama.h"
 #include "llamafile/json.h"
+#include "llamafile/llama.h"
 #include "llamafile/server/cleanup.h"
 #include "llamafile/server/fastjson.h"
 #include "llamafile/server/log.h"
@@ -161,20 +162,12 @@ Client::embedding()
     timespec started = timespec_real();
 
     // turn text into tokens
-    auto toks = new std::vector<llama_token>(params->prompt.size() + 16);
+    auto toks = new std::vector<llama_token>(
+      llamafile_tokenize(model_,
+                         params->prompt,
+                         params->add_special,
+                         params->parse_special));
     defer_cleanup(cleanup_token_vector, toks);
-    int count = llama_tokenize(model_,
-                               params->prompt.data(),
-                               params->prompt.size(),
-                               &(*toks)[0],
-                               toks->size(),
-                               params->add_special,
-                               params->parse_special);
-    if (count < 0) {
-        SLOG("llama_tokenize failed");
-        return send_error(405);
-    }
-    toks->resize(count);
 
     if (toks->empty())
         return send_error(400, "completely empty prompt disallowed");
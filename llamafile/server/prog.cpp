@@ -16,6 +16,8 @@
 // limitations under the License.
 
 #include "llama.cpp/llama.h"
+#include "llamafile/bpe.h"
+#include "llamafile/llama.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/pool.h"
 #include "llamafile/server/log.h"
@@ -88,6 +90,8 @@ main(int argc, char* argv[])
         fprintf(stderr, "%s: failed to load model\n", FLAG_model);
         exit(1);
     }
+    llamafile_pieces_load(model);
+    llamafile_bpe_load(model, FLAG_model);
 
     // create slots
     Slots* slots = new Slots(model);
@@ -120,6 +124,8 @@ main(int argc, char* argv[])
     g_server->close();
     delete g_server;
     delete slots;
+    llamafile_bpe_free(model);
+    llamafile_pieces_free(model);
     llama_free_model(model);
     tokenbucket_destroy();
     time_destroy();
@@ -25,8 +25,16 @@ struct llama_model;
 namespace lf {
 namespace server {
 
+struct Client;
 struct Slots;
 
+// endpoint provided by a program that embeds the server
+struct Endpoint
+{
+    const char* path;
+    bool (*handler)(Client*);
+};
+
 struct Server
 {
     Server(int, Slots*, llama_model*);
@@ -46,6 +54,7 @@ struct Server
     int fd;
     Slots* slots_;
     llama_model* model_;
+    const Endpoint* endpoints_ = nullptr; // terminated by null path
     Dll* idle_workers = nullptr;
     Dll* active_workers = nullptr;
     pthread_cond_t cond_ = PTHREAD_COND_INITIALIZER;
@@ -430,7 +430,7 @@ Slot::dump(std::string* result)
         if (history_[i].is_token()) {
             llama_token token = history_[i].token();
             *result +=
-              llamafile_token_to_piece(ctx_, token, RENDER_SPECIAL_TOKENS);
+              llamafile_token_piece(ctx_, token, RENDER_SPECIAL_TOKENS);
         } else if (history_[i].is_image()) {
             convert_image_to_uri(result, history_[i].image().bytes());
         }
@@ -688,7 +688,7 @@ Client::v1_chat_completions()
             break;
         }
         state->piece +=
-          llamafile_token_to_piece(slot_->ctx_, id, DONT_RENDER_SPECIAL_TOKENS);
+          llamafile_token_piece(slot_->ctx_, id, DONT_RENDER_SPECIAL_TOKENS);
         if (!state->piece.empty()) {
             if (params->stream) {
                 if (!ends_with_incomplete_utf8(state->piece)) {
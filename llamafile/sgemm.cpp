@@ -21,6 +21,7 @@
 #include <cosmo.h>
 #include <cpuid.h>
 #include <libc/sysv/consts/hwcap.h>
+#include <sched.h>
 #include <sys/auxv.h>
 
 static const struct GemmFuncs {
@@ -42,6 +43,14 @@ static const struct GemmFuncs {
                             sgemm = llamafile_sgemm_amd_zen4;
                             mixmul = llamafile_mixmul_amd_zen4;
                             iqk_mixmul = iqk_mul_mat_moe_zen4;
+                        } else if (X86_HAVE(AVX512VL) && //
+                                   X86_HAVE(AVX512BW) && //
+                                   X86_HAVE(AVX512DQ) && //
+                                   X86_HAVE(AVX512_VNNI)) {
+                            // Intel Xeon Cascadelake/Icelake+ (2019-)
+                            sgemm = llamafile_sgemm_amd_avx512vnni;
+                            mixmul = llamafile_mixmul_amd_avx512vnni;
+                            iqk_mixmul = iqk_mul_mat_moe_zen4;
                         } else {
                             // Intel Xeon Skylake+ (2015-)
                             sgemm = llamafile_sgemm_amd_avx512f;
@@ -143,3 +152,50 @@ bool llamafile_mixmul_iqk(long Nx, long Ny, long ne00, int ne11, int typeA, cons
                           int ith, int nth) {
     return funcs.iqk_mixmul(Nx, Ny, ne00, ne11, typeA, A, B, C, nb1, nb2, vrow_mapping, ith, nth);
 }
+
+static thread_local struct {
+    tinyblas_sched *sched;
+    int nth;
+    unsigned long seq;
+} g_sched;
+
+/**
+ * Shares tile scheduling state between the threads of a ggml graph.
+ *
+ * Each thread computing a graph should call this with the same `sched`
+ * object before its first op, so that tinyBLAS may hand out tiles via
+ * an atomic counter, and again with null once the graph is finished.
+ * When this hasn't been called, tiles are split statically by thread.
+ *
+ * @param sched is zero initialized memory shared by all `nth` threads
+ * @param nth is number of threads that'll call llamafile_sgemm()
+ */
+void llamafile_sgemm_set_sched(tinyblas_sched *sched, int nth) {
+    g_sched.sched = sched;
+    g_sched.nth = nth;
+    g_sched.seq = 0;
+}
+
+/**
+ * Returns ring slot for the next gemm phase entered by calling thread.
+ *
+ * Every thread bound to the same scheduler enters phases in the same
+ * order, since they all walk the same matrices. So phases may be told
+ * apart by counting them. A fast thread can run ahead by a lap of the
+ * ring at most; it then waits for stragglers to finish the older one.
+ *
+ * @param nth is number of threads participating in matmul
+ * @param out_lap receives lap number that caller must pass when done
+ * @return phase or null if tiles should be statically partitioned
+ */
+tinyblas_sched_phase *llamafile_sgemm_next_phase(int nth, int *out_lap) {
+    if (!g_sched.sched || g_sched.nth != nth)
+        return nullptr;
+    unsigned long seq = g_sched.seq++;
+    tinyblas_sched_phase *phase = &g_sched.sched->ring[seq % TINYBLAS_SCHED_RING];
+    int lap = seq / TINYBLAS_SCHED_RING;
+    while (__atomic_load_n(&phase->lap, __ATOMIC_ACQUIRE) != lap)
+        sched_yield();
+    *out_lap = lap;
+    return phase;
+}
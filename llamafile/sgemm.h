@@ -7,6 +7,22 @@ extern "C" {
 struct ggml_tensor;
 struct ggml_compute_params;
 
+#define TINYBLAS_SCHED_RING 16
+
+struct tinyblas_sched_phase {
+    long next; // chunks claimed after each thread took its first one
+    int lap; // how many times this ring slot has been recycled
+    int done; // threads that have finished working on this phase
+    char pad[64 - sizeof(long) - sizeof(int) * 2];
+};
+
+struct tinyblas_sched {
+    struct tinyblas_sched_phase ring[TINYBLAS_SCHED_RING];
+};
+
+void llamafile_sgemm_set_sched(struct tinyblas_sched *, int);
+struct tinyblas_sched_phase *llamafile_sgemm_next_phase(int, int *);
+
 bool iqk_mul_mat(long, long, long, int, const void *, const void *, float *, long, int, int);
 bool iqk_mul_mat_zen4(long, long, long, int, const void *, const void *, float *, long, int, int);
 bool iqk_mul_mat_arm82(long, long, long, int, const void *, const void *, float *, long, int, int);
@@ -39,6 +55,8 @@ bool llamafile_sgemm_amd_avxvnni(long, long, long, const void *, long, const voi
                                  long, int, int, int, int, int);
 bool llamafile_sgemm_amd_avx512f(long, long, long, const void *, long, const void *, long, void *,
                                  long, int, int, int, int, int);
+bool llamafile_sgemm_amd_avx512vnni(long, long, long, const void *, long, const void *, long,
+                                    void *, long, int, int, int, int, int);
 bool llamafile_sgemm_amd_zen4(long, long, long, const void *, long, const void *, long, void *,
                               long, int, int, int, int, int);
 bool llamafile_sgemm_arm80(long, long, long, const void *, long, const void *, long, void *, long,
@@ -64,6 +82,9 @@ bool llamafile_mixmul_amd_avxvnni(const struct ggml_compute_params *, const stru
 bool llamafile_mixmul_amd_avx512f(const struct ggml_compute_params *, const struct ggml_tensor *,
                                   const struct ggml_tensor *, const struct ggml_tensor *,
                                   struct ggml_tensor *);
+bool llamafile_mixmul_amd_avx512vnni(const struct ggml_compute_params *, const struct ggml_tensor *,
+                                     const struct ggml_tensor *, const struct ggml_tensor *,
+                                     struct ggml_tensor *);
 bool llamafile_mixmul_amd_zen4(const struct ggml_compute_params *, const struct ggml_tensor *,
                                const struct ggml_tensor *, const struct ggml_tensor *,
                                struct ggml_tensor *);
@@ -0,0 +1,123 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench.h"
+#include "llama.cpp/ggml.h"
+#include "macros.h"
+#include "numba.h"
+#include "sgemm.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+// checks that the iqk_mul_mat i-quant kernels agree with ggml_vec_dot
+// and measures how much faster they make prompt processing
+
+#define ITERATIONS 10
+#define ALLOC(n) memalign(4096, n)
+
+void llamafile_sgemm_openmp(long m, long n, long k, const void *A, long lda, const void *B,
+                            long ldb, void *C, long ldc, int Atype, int Btype, int Ctype) {
+    static int nth = cpu_get_num_math();
+#pragma omp parallel for
+    for (int ith = 0; ith < nth; ++ith) {
+        bool res = llamafile_sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
+        assert(res);
+    }
+}
+
+void ggml_vec_dot_openmp(long m, long n, long k, const void *A, size_t lda, const void *B,
+                         size_t ldb, float *C, long ldc, ggml_type_traits_t tt) {
+#pragma omp parallel for collapse(2)
+    for (long j = 0; j < n; ++j)
+        for (long i = 0; i < m; ++i)
+            tt.vec_dot(k, C + ldc * j + i, 0, (const char *)A + lda * i, 0,
+                       (const char *)B + ldb * j, 0, 1);
+}
+
+int test(ggml_type type, int m, int n, int k) {
+    ggml_type_traits_t tt = ggml_internal_get_type_traits(type);
+    ggml_type_traits_t qt = ggml_internal_get_type_traits(tt.vec_dot_type);
+    size_t lda = ggml_row_size(type, k);
+    size_t ldb = ggml_row_size(tt.vec_dot_type, k);
+    float *X = (float *)ALLOC(sizeof(float) * k * MAX(m, n));
+    float *W = (float *)ALLOC(sizeof(float) * k);
+    void *A = ALLOC(lda * m);
+    void *B = ALLOC(ldb * n);
+    float *C = (float *)ALLOC(sizeof(float) * m * n);
+    float *G = (float *)ALLOC(sizeof(float) * m * n);
+
+    // the lowest bit quants refuse to quantize without an importance matrix
+    broadcast(W, k, 1.f);
+    randomize(X, k * m);
+    ggml_quantize_chunk(type, X, A, 0, m, k, ggml_quantize_requires_imatrix(type) ? W : 0);
+    randomize(X, k * n);
+    for (int j = 0; j < n; ++j)
+        qt.from_float(X + k * j, (char *)B + ldb * j, k);
+
+    printf("%s m=%d n=%d k=%d\n", ggml_type_name(type), m, n, k);
+    BENCH(ggml_vec_dot_openmp(m, n, k, A, lda, B, ldb, G, m, tt));
+    BENCH(llamafile_sgemm_openmp(m, n, k / ggml_blck_size(type), A, lda / ggml_type_size(type), B,
+                                 ldb / ggml_type_size(tt.vec_dot_type), C, m, type,
+                                 tt.vec_dot_type, GGML_TYPE_F32));
+
+    // both sides use the same integer dot products, so what's left is
+    // float rounding from summing the blocks in a different order
+    double err_worst = 0;
+    for (int i = 0; i < m * n; ++i) {
+        if (isnan(C[i]) || isnan(G[i])) {
+            fprintf(stderr, "%s:%d: %s: found nan at %d\n", __FILE__, __LINE__,
+                    ggml_type_name(type), i);
+            return 3;
+        }
+        double err = fabs(C[i] - G[i]) / (fabs(G[i]) + 1);
+        if (err > err_worst)
+            err_worst = err;
+    }
+    printf("%12g relative worst\n", err_worst);
+    if (err_worst > 1e-4) {
+        fprintf(stderr, "%s:%d: %s: iqk_mul_mat disagrees with ggml_vec_dot\n", __FILE__,
+                __LINE__, ggml_type_name(type));
+        return 4;
+    }
+
+    free(G);
+    free(C);
+    free(B);
+    free(A);
+    free(W);
+    free(X);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    static const ggml_type kTypes[] = {
+        GGML_TYPE_IQ2_XXS, GGML_TYPE_IQ2_XS, GGML_TYPE_IQ3_XXS,
+        GGML_TYPE_IQ3_S,   GGML_TYPE_IQ1_S,  GGML_TYPE_IQ4_NL,
+    };
+    for (ggml_type type : kTypes) {
+        printf("\n");
+        if ((rc = test(type, 1024, 1, 4096))) // token generation
+            return rc;
+        if ((rc = test(type, 1024, 7, 4096)))
+            return rc;
+        if ((rc = test(type, 1024, 512, 4096))) // prompt processing
+            return rc;
+    }
+    ggml_quantize_free();
+}
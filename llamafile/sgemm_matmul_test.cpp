@@ -23,8 +23,12 @@
 #include "macros.h"
 #include "numba.h"
 #include "sgemm.h"
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
+#include <omp.h>
+#include <pthread.h>
 
 #define ITERATIONS 30
 #define ALLOC(n) (float *)memalign(4096, sizeof(float) * (n))
@@ -39,6 +43,29 @@ void llamafile_sgemm_openmp(long m, long n, long k, const void *A, long lda, con
     }
 }
 
+void llamafile_sgemm_dynamic(long m, long n, long k, const void *A, long lda, const void *B,
+                             long ldb, void *C, long ldc, int Atype, int Btype, int Ctype) {
+    static int nth = cpu_get_num_math();
+    static tinyblas_sched sched;
+    memset(&sched, 0, sizeof(sched));
+#pragma omp parallel num_threads(nth)
+    {
+        int ith = omp_get_thread_num();
+        llamafile_sgemm_set_sched(&sched, nth);
+        bool res = llamafile_sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
+        llamafile_sgemm_set_sched(0, 0);
+        assert(res);
+    }
+}
+
+// simulates a noisy neighbor stealing time from one of our cores
+std::atomic_bool g_noisy;
+void *noisy_neighbor(void *arg) {
+    while (g_noisy.load(std::memory_order_relaxed))
+        __asm__ volatile("" ::: "memory");
+    return 0;
+}
+
 int test(void) {
     int m = 256;
     int n = 500;
@@ -60,6 +87,18 @@ int test(void) {
     BENCH(ansiBLAS::sgemm(m, n, k, A, lda, B, ldb, G, ldc));
     BENCH(llamafile_sgemm_openmp(m, n, k, A, lda, B, ldb, C, ldc, GGML_TYPE_F32, GGML_TYPE_F32,
                                  GGML_TYPE_F32));
+    BENCH(llamafile_sgemm_dynamic(m, n, k, A, lda, B, ldb, C, ldc, GGML_TYPE_F32, GGML_TYPE_F32,
+                                  GGML_TYPE_F32));
+
+    pthread_t th;
+    g_noisy = true;
+    pthread_create(&th, 0, noisy_neighbor, 0);
+    BENCH(llamafile_sgemm_openmp(m, n, k, A, lda, B, ldb, C, ldc, GGML_TYPE_F32, GGML_TYPE_F32,
+                                 GGML_TYPE_F32));
+    BENCH(llamafile_sgemm_dynamic(m, n, k, A, lda, B, ldb, C, ldc, GGML_TYPE_F32, GGML_TYPE_F32,
+                                  GGML_TYPE_F32));
+    g_noisy = false;
+    pthread_join(th, 0);
 
     int flips = 0;
     double err_sum = 0;
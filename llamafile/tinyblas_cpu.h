@@ -45,6 +45,9 @@
 #include "log.h"
 #include "sgemm.h"
 #include <cosmo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
 
 #pragma GCC diagnostic ignored "-Wpedantic"
 #pragma GCC diagnostic ignored "-Wignored-attributes"
@@ -66,6 +69,20 @@
 #define VECTOR_REGISTERS 16
 #endif
 
+// cache blocking for big prompt batches, which is sized so that an
+// RM×KC strip of A stays in L1 while a packed NC×KC panel of B stays
+// in L2 and gets reused by every row of A that we multiply it with.
+#if defined(__AVX512F__)
+#define BLOCK_NC 96
+#elif defined(__AVX__) || defined(__AVX2__)
+#define BLOCK_NC 32
+#else
+#define BLOCK_NC 48
+#endif
+#define BLOCK_MC 64
+#define BLOCK_KC_BYTES 4096
+#define BLOCK_MIN_N 256
+
 #if 0
 #define NOT_SUPPORTED tinyBLAS_not_supported(__FILE__, __LINE__)
 #else
@@ -413,6 +430,133 @@ inline void store(ggml_bf16_t *p, float f) {
     *p = GGML_FP32_TO_BF16(f);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// TILE SCHEDULING
+
+/**
+ * Hands out tiles of a matmul to the threads computing it.
+ *
+ * Giving each thread an equal slice of tiles means the slowest core
+ * sets the pace for every matmul, which hurts on hybrid P-core/E-core
+ * chips and busy hosts. When ggml has bound a shared scheduler to the
+ * calling thread, tiles are instead claimed in small chunks from an
+ * atomic counter, so faster cores end up doing more of the work. The
+ * first chunk a thread takes is always its own, to avoid contention.
+ */
+class TileScheduler {
+  public:
+    TileScheduler(long tiles, int ith, int nth) : tiles(tiles), ith(ith), nth(nth) {
+        if (tiles >= nth * 2 && (phase = llamafile_sgemm_next_phase(nth, &lap))) {
+            chunk = tiles / (nth * 8);
+            if (chunk < 1)
+                chunk = 1;
+            chunks = (tiles + chunk - 1) / chunk;
+        } else {
+            chunk = (tiles + nth - 1) / nth;
+            chunks = nth;
+        }
+    }
+
+    ~TileScheduler() {
+        if (phase && __atomic_add_fetch(&phase->done, 1, __ATOMIC_ACQ_REL) == nth) {
+            phase->next = 0;
+            phase->done = 0;
+            __atomic_store_n(&phase->lap, lap + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    bool next(long *start, long *end) {
+        long job;
+        if (!claimed++)
+            job = ith;
+        else if (phase)
+            job = nth + __atomic_fetch_add(&phase->next, 1, __ATOMIC_RELAXED);
+        else
+            return false;
+        if (job >= chunks)
+            return false;
+        *start = job * chunk;
+        *end = *start + chunk;
+        if (*end > tiles)
+            *end = tiles;
+        return *start < *end;
+    }
+
+  private:
+    const long tiles;
+    const int ith;
+    const int nth;
+    tinyblas_sched_phase *phase = nullptr;
+    int lap = 0;
+    long chunk;
+    long chunks;
+    long claimed = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// CACHE BLOCKING
+
+/**
+ * Returns memory for packing panels of B, which is owned by thread.
+ *
+ * @return pointer to BLOCK_NC * BLOCK_KC_BYTES bytes or null if oom
+ */
+inline void *tinyBLAS_pack_buffer() {
+    static thread_local struct PackBuffer {
+        void *p = nullptr;
+        ~PackBuffer() {
+            free(p);
+        }
+    } buf;
+    if (!buf.p)
+        buf.p = memalign(MAX_ALIGN, BLOCK_NC * BLOCK_KC_BYTES);
+    return buf.p;
+}
+
+/**
+ * Walks the RM×RN aligned part of C = Aᵀ * B in GotoBLAS order.
+ *
+ * The work is split into units of MC rows of A by NC columns of B. A
+ * unit is always finished by the thread that claims it, which copies
+ * each KC slice of its B panel into a contiguous buffer and then runs
+ * `kernel(ii, jj, l, kc, Bp, ldp, accumulate)` on all its tiles. When
+ * `accumulate` is false, the kernel should overwrite C, otherwise add.
+ *
+ * @param KC is elements of k per slice (must be multiple of kernel's)
+ */
+template <int RM, int RN, typename TB, typename F>
+void tinyBLAS_blocked(long m, long n, long k, long KC, const TB *B, long ldb, int ith, int nth,
+                      F kernel) {
+    constexpr long MC = BLOCK_MC / RM * RM;
+    constexpr long NC = BLOCK_NC / RN * RN;
+    long mchunks = (m + MC - 1) / MC;
+    long nchunks = (n + NC - 1) / NC;
+    TB *pack = (TB *)tinyBLAS_pack_buffer();
+    long start, end;
+    TileScheduler sched{mchunks * nchunks, ith, nth};
+    while (sched.next(&start, &end))
+        for (long job = start; job < end; ++job) {
+            long ic = job % mchunks * MC;
+            long jc = job / mchunks * NC;
+            long mc = MIN(MC, m - ic);
+            long nc = MIN(NC, n - jc);
+            for (long pc = 0; pc < k; pc += KC) {
+                long kc = MIN(KC, k - pc);
+                long ldp = ldb;
+                const TB *Bp = B + ldb * jc + pc;
+                if (pack) {
+                    for (long j = 0; j < nc; ++j)
+                        memcpy(pack + KC * j, Bp + ldb * j, kc * sizeof(TB));
+                    Bp = pack;
+                    ldp = KC;
+                }
+                for (long jr = 0; jr < nc; jr += RN)
+                    for (long ir = 0; ir < mc; ir += RM)
+                        kernel(ic + ir, jc + jr, pc, kc, Bp + ldp * jr, ldp, pc > 0);
+            }
+        }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // FLOATING POINT MATRIX MULTIPLICATION
 
@@ -425,10 +569,53 @@ class tinyBLAS {
     }
 
     void matmul(long m, long n) {
-        mnpack(0, m, 0, n);
+        if (!blocked(m, n))
+            mnpack(0, m, 0, n);
     }
 
   private:
+    bool blocked(long m, long n) {
+#if VECTOR_REGISTERS == 32
+        constexpr int RM = 5;
+        constexpr int RN = 5;
+#else
+        constexpr int RM = 4;
+        constexpr int RN = 3;
+#endif
+        constexpr long KC = MAX(KN, BLOCK_KC_BYTES / sizeof(TB) / KN * KN);
+        if (CONFIG || !std::is_same_v<TC, float> || n < BLOCK_MIN_N || k % KN)
+            return false;
+        long mp = m / RM * RM;
+        long np = n / RN * RN;
+        tinyBLAS_blocked<RM, RN>(
+            mp, np, k, KC, B, ldb, ith, nth,
+            [this](long ii, long jj, long l0, long kc, const TB *Bp, long ldp, bool accumulate) {
+                gemm_block<RM, RN>(ii, jj, l0, kc, Bp, ldp, accumulate);
+            });
+        mnpack(mp, m, 0, n);
+        mnpack(0, mp, np, n);
+        return true;
+    }
+
+    template <int RM, int RN>
+    inline void gemm_block(long ii, long jj, long l0, long kc, const TB *Bp, long ldp,
+                           bool accumulate) {
+        D Cv[RN][RM] = {};
+        for (long l = 0; l < kc; l += KN)
+#pragma GCC unroll 100
+            for (int j = 0; j < RN; ++j)
+#pragma GCC unroll 100
+                for (int i = 0; i < RM; ++i)
+                    Cv[j][i] = madd(load<V>(INDEX(A, lda, ii + i, l0 + l)), //
+                                    load<V>(Bp + ldp * j + l), //
+                                    Cv[j][i]);
+        for (int j = 0; j < RN; ++j)
+            for (int i = 0; i < RM; ++i) {
+                TC *c = INDEX(C, ldc, jj + j, ii + i);
+                *c = accumulate ? *c + hsum(Cv[j][i]) : hsum(Cv[j][i]);
+            }
+    }
+
     NOINLINE void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
@@ -535,70 +722,69 @@ class tinyBLAS {
         long ytiles = RM > 1 ? (m - m0) / RM : 1;
         long xtiles = RN > 1 ? (n - n0) / RN : 1;
         long tiles = xtiles * ytiles;
-        long duty = (tiles + nth - 1) / nth;
-        long start = duty * ith;
-        long end = start + duty;
-        if (end > tiles)
-            end = tiles;
-        for (long job = start; job < end; ++job) {
-            long ii = m0 + job / xtiles * RM;
-            long jj = n0 + job % xtiles * RN;
+        long start, end;
+        TileScheduler sched{tiles, ith, nth};
+        while (sched.next(&start, &end))
+            for (long job = start; job < end; ++job) {
+                long ii = m0 + job / xtiles * RM;
+                long jj = n0 + job % xtiles * RN;
+
+                size_t chunk, sp = 0;
+                int i, j, rule, step = 2;
+                for (chunk = 0; chunk + KN * CHUNK * 4 <= k;
+                     chunk += KN * CHUNK * 4, step += 2, ++sp) {
+
+                    D Cv[RN][RM] = {};
+                    for (long l = 0; l < KN * CHUNK * 4; l += KN)
+#pragma GCC unroll 100
+                        for (j = 0; j < RN; ++j)
+#pragma GCC unroll 100
+                            for (i = 0; i < RM; ++i)
+                                Cv[j][i] = madd(load<V>(INDEX(A, lda, ii + i, chunk + l)), //
+                                                load<V>(INDEX(B, ldb, jj + j, chunk + l)), //
+                                                Cv[j][i]);
 
-            size_t chunk, sp = 0;
-            int i, j, rule, step = 2;
-            for (chunk = 0; chunk + KN * CHUNK * 4 <= k; chunk += KN * CHUNK * 4, step += 2, ++sp) {
+                    for (rule = bsr(step & -step); --rule;)
+                        for (--sp, j = 0; j < RN; ++j)
+                            for (i = 0; i < RM; ++i)
+                                Cv[j][i] += stack[sp][j][i];
+
+                    for (j = 0; j < RN; ++j)
+                        for (i = 0; i < RM; ++i)
+                            stack[sp][j][i] = Cv[j][i];
+                }
 
                 D Cv[RN][RM] = {};
-                for (long l = 0; l < KN * CHUNK * 4; l += KN)
+                for (; chunk + KN <= k; chunk += KN)
 #pragma GCC unroll 100
                     for (j = 0; j < RN; ++j)
 #pragma GCC unroll 100
                         for (i = 0; i < RM; ++i)
-                            Cv[j][i] = madd(load<V>(INDEX(A, lda, ii + i, chunk + l)), //
-                                            load<V>(INDEX(B, ldb, jj + j, chunk + l)), //
+                            Cv[j][i] = madd(load<V>(INDEX(A, lda, ii + i, chunk)), //
+                                            load<V>(INDEX(B, ldb, jj + j, chunk)), //
                                             Cv[j][i]);
 
-                for (rule = bsr(step & -step); --rule;)
-                    for (--sp, j = 0; j < RN; ++j)
+                while (sp--)
+                    for (j = 0; j < RN; ++j)
                         for (i = 0; i < RM; ++i)
                             Cv[j][i] += stack[sp][j][i];
 
+                float Cf[RN][RM];
                 for (j = 0; j < RN; ++j)
                     for (i = 0; i < RM; ++i)
-                        stack[sp][j][i] = Cv[j][i];
-            }
+                        Cf[j][i] = hsum(Cv[j][i]);
 
-            D Cv[RN][RM] = {};
-            for (; chunk + KN <= k; chunk += KN)
-#pragma GCC unroll 100
-                for (j = 0; j < RN; ++j)
-#pragma GCC unroll 100
-                    for (i = 0; i < RM; ++i)
-                        Cv[j][i] = madd(load<V>(INDEX(A, lda, ii + i, chunk)), //
-                                        load<V>(INDEX(B, ldb, jj + j, chunk)), //
-                                        Cv[j][i]);
-
-            while (sp--)
-                for (j = 0; j < RN; ++j)
-                    for (i = 0; i < RM; ++i)
-                        Cv[j][i] += stack[sp][j][i];
-
-            float Cf[RN][RM];
-            for (j = 0; j < RN; ++j)
-                for (i = 0; i < RM; ++i)
-                    Cf[j][i] = hsum(Cv[j][i]);
+                for (; chunk < k; ++chunk)
+                    for (j = 0; j < RN; ++j)
+                        for (i = 0; i < RM; ++i)
+                            Cf[j][i] = fmaf(load<float>(INDEX(A, lda, ii + i, chunk)), //
+                                            load<float>(INDEX(B, ldb, jj + j, chunk)), //
+                                            Cf[j][i]);
 
-            for (; chunk < k; ++chunk)
                 for (j = 0; j < RN; ++j)
                     for (i = 0; i < RM; ++i)
-                        Cf[j][i] = fmaf(load<float>(INDEX(A, lda, ii + i, chunk)), //
-                                        load<float>(INDEX(B, ldb, jj + j, chunk)), //
-                                        Cf[j][i]);
-
-            for (j = 0; j < RN; ++j)
-                for (i = 0; i < RM; ++i)
-                    store(INDEX(C, ldc, jj + j, ii + i), Cf[j][i]);
-        }
+                        store(INDEX(C, ldc, jj + j, ii + i), Cf[j][i]);
+            }
     }
 
     const TA *const A;
@@ -625,10 +811,51 @@ class tinyBLAS_Q0_ARM {
     }
 
     void matmul(long m, long n) {
-        mnpack(0, m, 0, n);
+        if (!blocked(m, n))
+            mnpack(0, m, 0, n);
     }
 
   private:
+    bool blocked(long m, long n) {
+        constexpr int RM = 3;
+        constexpr int RN = 3;
+        constexpr long KC = BLOCK_KC_BYTES / sizeof(TB);
+        if (CONFIG || FLAG_precise || !std::is_same_v<TC, float> || n < BLOCK_MIN_N)
+            return false;
+        long mp = m / RM * RM;
+        long np = n / RN * RN;
+        tinyBLAS_blocked<RM, RN>(
+            mp, np, k, KC, B, ldb, ith, nth,
+            [this](long ii, long jj, long l0, long kc, const TB *Bp, long ldp, bool accumulate) {
+                gemm_block<RM, RN>(ii, jj, l0, kc, Bp, ldp, accumulate);
+            });
+        mnpack(mp, m, 0, n);
+        mnpack(0, mp, np, n);
+        return true;
+    }
+
+    template <int RM, int RN>
+    inline void gemm_block(long ii, long jj, long l0, long kc, const TB *Bp, long ldp,
+                           bool accumulate) {
+        float32x4_t Cv[RN][RM] = {};
+        for (long l = 0; l < kc; ++l)
+#pragma GCC unroll 100
+            for (int j = 0; j < RN; ++j)
+#pragma GCC unroll 100
+                for (int i = 0; i < RM; ++i) {
+                    const TA *a = INDEX(A, lda, ii + i, l0 + l);
+                    const TB *b = Bp + ldp * j + l;
+                    float32x4_t d = vcvtq_f32_s32(vdotq_s32(
+                        vdotq_s32(vdupq_n_s32(0), load_lo(a), load_lo(b)), load_hi(a), load_hi(b)));
+                    Cv[j][i] = vmlaq_n_f32(Cv[j][i], d, unhalf(a->d) * unhalf(b->d));
+                }
+        for (int j = 0; j < RN; ++j)
+            for (int i = 0; i < RM; ++i) {
+                TC *c = INDEX(C, ldc, jj + j, ii + i);
+                *c = accumulate ? *c + hsum(Cv[j][i]) : hsum(Cv[j][i]);
+            }
+    }
+
     NOINLINE void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
@@ -713,38 +940,38 @@ class tinyBLAS_Q0_ARM {
         long ytiles = RM > 1 ? (m - m0) / RM : 1;
         long xtiles = RN > 1 ? (n - n0) / RN : 1;
         long tiles = xtiles * ytiles;
-        long duty = (tiles + nth - 1) / nth;
-        long start = duty * ith;
-        long end = start + duty;
-        if (end > tiles)
-            end = tiles;
-        for (long job = start; job < end; ++job) {
-            long ii = m0 + job / xtiles * RM;
-            long jj = n0 + job % xtiles * RN;
-            float32x4_t Cv[RN][RM] = {};
-            float32x4_t Ce[RN][RM] = {};
-            for (int l = 0; l < k; ++l)
+        long start, end;
+        TileScheduler sched{tiles, ith, nth};
+        while (sched.next(&start, &end))
+            for (long job = start; job < end; ++job) {
+                long ii = m0 + job / xtiles * RM;
+                long jj = n0 + job % xtiles * RN;
+                float32x4_t Cv[RN][RM] = {};
+                float32x4_t Ce[RN][RM] = {};
+                for (int l = 0; l < k; ++l)
 #pragma GCC unroll 100
-                for (int j = 0; j < RN; ++j)
+                    for (int j = 0; j < RN; ++j)
 #pragma GCC unroll 100
-                    for (int i = 0; i < RM; ++i) {
-                        float32x4_t a = vcvtq_f32_s32(vdotq_s32(
-                            vdotq_s32(vdupq_n_s32(0), load_lo(INDEX(A, lda, ii + i, l)),
-                                      load_lo(INDEX(B, ldb, jj + j, l))),
-                            load_hi(INDEX(A, lda, ii + i, l)), load_hi(INDEX(B, ldb, jj + j, l))));
-                        float b = unhalf(INDEX(A, lda, ii + i, l)->d) *
-                                  unhalf(INDEX(B, ldb, jj + j, l)->d);
-                        if (PRECISE)
-                            Cv[j][i] = badder(a, b, Cv[j][i], &Ce[j][i]);
-                        else
-                            Cv[j][i] = vmlaq_n_f32(Cv[j][i], a, b);
-                    }
+                        for (int i = 0; i < RM; ++i) {
+                            float32x4_t a = vcvtq_f32_s32(
+                                vdotq_s32(vdotq_s32(vdupq_n_s32(0),
+                                                    load_lo(INDEX(A, lda, ii + i, l)),
+                                                    load_lo(INDEX(B, ldb, jj + j, l))),
+                                          load_hi(INDEX(A, lda, ii + i, l)),
+                                          load_hi(INDEX(B, ldb, jj + j, l))));
+                            float b = unhalf(INDEX(A, lda, ii + i, l)->d) *
+                                      unhalf(INDEX(B, ldb, jj + j, l)->d);
+                            if (PRECISE)
+                                Cv[j][i] = badder(a, b, Cv[j][i], &Ce[j][i]);
+                            else
+                                Cv[j][i] = vmlaq_n_f32(Cv[j][i], a, b);
+                        }
 #pragma GCC unroll 100
-            for (int j = 0; j < RN; ++j)
+                for (int j = 0; j < RN; ++j)
 #pragma GCC unroll 100
-                for (int i = 0; i < RM; ++i)
-                    store(INDEX(C, ldc, jj + j, ii + i), hsum(Cv[j][i]));
-        }
+                    for (int i = 0; i < RM; ++i)
+                        store(INDEX(C, ldc, jj + j, ii + i), hsum(Cv[j][i]));
+            }
     }
 
     inline int8x16_t load_lo(const block_q8_0 *b) {
@@ -786,14 +1013,121 @@ class tinyBLAS_Q0_AVX2 {
     }
 
     void matmul(long m, long n) {
-        mnpack(0, m, 0, n);
+        if (!blocked(m, n))
+            mnpack(0, m, 0, n);
     }
 
   private:
+    bool blocked(long m, long n) {
+#if defined(__AVX512VNNI__)
+        constexpr int RM = 4;
+        constexpr int RN = 3;
+#elif VECTOR_REGISTERS == 32
+        constexpr int RM = 3;
+        constexpr int RN = 3;
+#else
+        constexpr int RM = 3;
+        constexpr int RN = 2;
+#endif
+        constexpr long KC = BLOCK_KC_BYTES / sizeof(TB);
+        if (CONFIG || FLAG_precise || !std::is_same_v<TC, float> || n < BLOCK_MIN_N)
+            return false;
+        long mp = m / RM * RM;
+        long np = n / RN * RN;
+        tinyBLAS_blocked<RM, RN>(
+            mp, np, k, KC, B, ldb, ith, nth,
+            [this](long ii, long jj, long l0, long kc, const TB *Bp, long ldp, bool accumulate) {
+                gemm_block<RM, RN>(ii, jj, l0, kc, Bp, ldp, accumulate);
+            });
+        mnpack(mp, m, 0, n);
+        mnpack(0, mp, np, n);
+        return true;
+    }
+
+    template <int RM, int RN>
+    inline void gemm_block(long ii, long jj, long l0, long kc, const TB *Bp, long ldp,
+                           bool accumulate) {
+#if defined(__AVX512VNNI__) || defined(__AVXVNNI__)
+        vnni_f Cv[RN][RM] = {};
+        vnni_tile<RM, RN>(ii, jj, l0, kc, Bp, ldp, Cv);
+#else
+        __m256 Cv[RN][RM] = {};
+        for (long l = 0; l < kc; ++l)
+#pragma GCC unroll 100
+            for (int j = 0; j < RN; ++j)
+#pragma GCC unroll 100
+                for (int i = 0; i < RM; ++i) {
+                    const TA *a = INDEX(A, lda, ii + i, l0 + l);
+                    const TB *b = Bp + ldp * j + l;
+                    __m256 s = _mm256_set1_ps(unhalf(a->d) * unhalf(b->d));
+                    __m256 d = updot(_mm256_sign_epi8(load(a), load(a)),
+                                     _mm256_sign_epi8(load(b), load(a)));
+                    Cv[j][i] = madd(s, d, Cv[j][i]);
+                }
+#endif
+        for (int j = 0; j < RN; ++j)
+            for (int i = 0; i < RM; ++i) {
+                TC *c = INDEX(C, ldc, jj + j, ii + i);
+                *c = accumulate ? *c + hsum(Cv[j][i]) : hsum(Cv[j][i]);
+            }
+    }
+
     void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
 #if VECTOR_REGISTERS == 32
+#if defined(__AVX512VNNI__)
+        if (!FLAG_precise) {
+            switch ((MIN(m - m0, 4) << 4) | MIN(n - n0, 3)) {
+            case 0x43:
+                mc = 4;
+                nc = 3;
+                gemm_vnni<4, 3>(m0, m, n0, n);
+                break;
+            case 0x42:
+                mc = 4;
+                nc = 2;
+                gemm_vnni<4, 2>(m0, m, n0, n);
+                break;
+            case 0x41:
+                mc = 4;
+                nc = 1;
+                gemm_vnni<4, 1>(m0, m, n0, n);
+                break;
+            case 0x33:
+                mc = 3;
+                nc = 3;
+                gemm_vnni<3, 3>(m0, m, n0, n);
+                break;
+            case 0x32:
+            case 0x23:
+            case 0x22:
+                mc = 2;
+                nc = 2;
+                gemm_vnni<2, 2>(m0, m, n0, n);
+                break;
+            case 0x31:
+            case 0x21:
+                mc = 2;
+                nc = 1;
+                gemm_vnni<2, 1>(m0, m, n0, n);
+                break;
+            case 0x13:
+            case 0x12:
+                mc = 1;
+                nc = 2;
+                gemm_vnni<1, 2>(m0, m, n0, n);
+                break;
+            case 0x11:
+                mc = 1;
+                nc = 1;
+                gemm_vnni<1, 1>(m0, m, n0, n);
+                break;
+            default:
+                return;
+            }
+        } else {
+#else
         if (!FLAG_precise) {
             switch ((MIN(m - m0, 3) << 4) | MIN(n - n0, 3)) {
             case 0x33:
@@ -829,6 +1163,7 @@ class tinyBLAS_Q0_AVX2 {
                 return;
             }
         } else {
+#endif
             switch ((MIN(m - m0, 3) << 4) | MIN(n - n0, 3)) {
             case 0x33:
                 mc = 3;
@@ -868,6 +1203,34 @@ class tinyBLAS_Q0_AVX2 {
 #if VECTOR_REGISTERS == 16
         if (!FLAG_precise) {
             switch ((MIN(m - m0, 3) << 4) | MIN(n - n0, 2)) {
+#if defined(__AVXVNNI__)
+            case 0x32:
+                mc = 3;
+                nc = 2;
+                gemm_vnni<3, 2>(m0, m, n0, n);
+                break;
+            case 0x22:
+                mc = 2;
+                nc = 2;
+                gemm_vnni<2, 2>(m0, m, n0, n);
+                break;
+            case 0x31:
+            case 0x21:
+                mc = 2;
+                nc = 1;
+                gemm_vnni<2, 1>(m0, m, n0, n);
+                break;
+            case 0x12:
+                mc = 1;
+                nc = 2;
+                gemm_vnni<1, 2>(m0, m, n0, n);
+                break;
+            case 0x11:
+                mc = 1;
+                nc = 1;
+                gemm_vnni<1, 1>(m0, m, n0, n);
+                break;
+#else
             case 0x32:
                 mc = 3;
                 nc = 2;
@@ -899,6 +1262,7 @@ class tinyBLAS_Q0_AVX2 {
                 nc = 1;
                 gemm<1, 1, false>(m0, m, n0, n);
                 break;
+#endif
             default:
                 return;
             }
@@ -936,40 +1300,172 @@ class tinyBLAS_Q0_AVX2 {
         long ytiles = RM > 1 ? (m - m0) / RM : 1;
         long xtiles = RN > 1 ? (n - n0) / RN : 1;
         long tiles = xtiles * ytiles;
-        long duty = (tiles + nth - 1) / nth;
-        long start = duty * ith;
-        long end = start + duty;
-        if (end > tiles)
-            end = tiles;
-        for (long job = start; job < end; ++job) {
-            long ii = m0 + job / xtiles * RM;
-            long jj = n0 + job % xtiles * RN;
-            __m256 Cv[RN][RM] = {};
-            __m256 Ce[RN][RM] = {};
-            for (long l = 0; l < k; ++l)
+        long start, end;
+        TileScheduler sched{tiles, ith, nth};
+        while (sched.next(&start, &end))
+            for (long job = start; job < end; ++job) {
+                long ii = m0 + job / xtiles * RM;
+                long jj = n0 + job % xtiles * RN;
+                __m256 Cv[RN][RM] = {};
+                __m256 Ce[RN][RM] = {};
+                for (long l = 0; l < k; ++l)
+#pragma GCC unroll 100
+                    for (int j = 0; j < RN; ++j)
+#pragma GCC unroll 100
+                        for (int i = 0; i < RM; ++i) {
+                            __m256 a = _mm256_set1_ps(unhalf(INDEX(A, lda, ii + i, l)->d) *
+                                                      unhalf(INDEX(B, ldb, jj + j, l)->d));
+                            __m256 b = updot(_mm256_sign_epi8(load(INDEX(A, lda, ii + i, l)),
+                                                              load(INDEX(A, lda, ii + i, l))),
+                                             _mm256_sign_epi8(load(INDEX(B, ldb, jj + j, l)),
+                                                              load(INDEX(A, lda, ii + i, l))));
+                            if (PRECISE)
+                                Cv[j][i] = madder(a, b, Cv[j][i], &Ce[j][i]);
+                            else
+                                Cv[j][i] = madd(a, b, Cv[j][i]);
+                        }
 #pragma GCC unroll 100
                 for (int j = 0; j < RN; ++j)
 #pragma GCC unroll 100
-                    for (int i = 0; i < RM; ++i) {
-                        __m256 a = _mm256_set1_ps(unhalf(INDEX(A, lda, ii + i, l)->d) *
-                                                  unhalf(INDEX(B, ldb, jj + j, l)->d));
-                        __m256 b = updot(_mm256_sign_epi8(load(INDEX(A, lda, ii + i, l)),
-                                                          load(INDEX(A, lda, ii + i, l))),
-                                         _mm256_sign_epi8(load(INDEX(B, ldb, jj + j, l)),
-                                                          load(INDEX(A, lda, ii + i, l))));
-                        if (PRECISE)
-                            Cv[j][i] = madder(a, b, Cv[j][i], &Ce[j][i]);
-                        else
-                            Cv[j][i] = madd(a, b, Cv[j][i]);
-                    }
+                    for (int i = 0; i < RM; ++i)
+                        store(INDEX(C, ldc, jj + j, ii + i), hsum(Cv[j][i]));
+            }
+    }
+
+#if defined(__AVX512VNNI__) || defined(__AVXVNNI__)
+    // VNNI multiplies unsigned bytes with signed bytes, so rather than use
+    // the sign trick we bias the weights into the unsigned range. Since
+    // (a + c)·b = a·b + c·Σb, each dot product then starts out from -c·Σb
+    // which only needs computing once per block of B. With AVX512 we put
+    // two consecutive blocks of k into each vector, so a 4x3 tile can hold
+    // all its accumulators, operands, and offsets in the 32 registers.
+#if defined(__AVX512VNNI__)
+    typedef __m512i vnni_i;
+    typedef __m512 vnni_f;
+    static constexpr int KV = 2;
+#else
+    typedef __m256i vnni_i;
+    typedef __m256 vnni_f;
+    static constexpr int KV = 1;
+#endif
+    static constexpr int BIAS_SHIFT = std::is_same_v<TA, block_q4_0> ? 3 : 7;
+
+    template <int RM, int RN>
+    inline void vnni_tile(long ii, long jj, long l0, long kc, const TB *Bp, long ldp,
+                          vnni_f Cv[RN][RM]) {
+        long l = 0;
+        for (; l + KV <= kc; l += KV)
+            vnni_step<RM, RN, KV>(ii, l0 + l, Bp + l, ldp, Cv);
+        if (KV > 1 && l < kc)
+            vnni_step<RM, RN, 1>(ii, l0 + l, Bp + l, ldp, Cv);
+    }
+
+    template <int RM, int RN, int N>
+    inline void vnni_step(long ii, long l, const TB *Bp, long ldp, vnni_f Cv[RN][RM]) {
+        vnni_i b[RN];
+        vnni_i o[RN];
+        vnni_f db[RN];
 #pragma GCC unroll 100
-            for (int j = 0; j < RN; ++j)
+        for (int j = 0; j < RN; ++j) {
+            b[j] = vnni_load_b<N>(Bp + ldp * j);
+            o[j] = vnni_offset(b[j]);
+            db[j] = vnni_scale<N>(Bp + ldp * j);
+        }
 #pragma GCC unroll 100
-                for (int i = 0; i < RM; ++i)
-                    store(INDEX(C, ldc, jj + j, ii + i), hsum(Cv[j][i]));
+        for (int i = 0; i < RM; ++i) {
+            vnni_i a = vnni_load_a<N>(INDEX(A, lda, ii + i, l));
+            vnni_f da = vnni_scale<N>(INDEX(A, lda, ii + i, l));
+#pragma GCC unroll 100
+            for (int j = 0; j < RN; ++j)
+                Cv[j][i] = madd(vnni_dot(o[j], a, b[j]), mul(da, db[j]), Cv[j][i]);
         }
     }
 
+    template <int RM, int RN>
+    NOINLINE void gemm_vnni(long m0, long m, long n0, long n) {
+        long ytiles = RM > 1 ? (m - m0) / RM : 1;
+        long xtiles = RN > 1 ? (n - n0) / RN : 1;
+        long tiles = xtiles * ytiles;
+        long start, end;
+        TileScheduler sched{tiles, ith, nth};
+        while (sched.next(&start, &end))
+            for (long job = start; job < end; ++job) {
+                long ii = m0 + job / xtiles * RM;
+                long jj = n0 + job % xtiles * RN;
+                vnni_f Cv[RN][RM] = {};
+                vnni_tile<RM, RN>(ii, jj, 0, k, INDEX(B, ldb, jj, 0), ldb, Cv);
+#pragma GCC unroll 100
+                for (int j = 0; j < RN; ++j)
+#pragma GCC unroll 100
+                    for (int i = 0; i < RM; ++i)
+                        store(INDEX(C, ldc, jj + j, ii + i), hsum(Cv[j][i]));
+            }
+    }
+
+    inline __m256i loadu(const block_q8_0 *a) {
+        return _mm256_xor_si256(load(a), _mm256_set1_epi8(0x80));
+    }
+
+    inline __m256i loadu(const block_q4_0 *a) {
+        __m128i x = _mm_loadu_si128((const __m128i *)a->qs);
+        return _mm256_and_si256(_mm256_set1_epi8(15),
+                                _mm256_insertf128_si256(_mm256_castsi128_si256(x),
+                                                        _mm_srli_epi16(x, 4), 1));
+    }
+
+    template <int N>
+    inline vnni_i vnni_load_a(const TA *a) {
+#if defined(__AVX512VNNI__)
+        return _mm512_inserti64x4(_mm512_castsi256_si512(loadu(a)),
+                                  N > 1 ? loadu(a + 1) : _mm256_setzero_si256(), 1);
+#else
+        return loadu(a);
+#endif
+    }
+
+    template <int N>
+    inline vnni_i vnni_load_b(const TB *b) {
+#if defined(__AVX512VNNI__)
+        return _mm512_inserti64x4(_mm512_castsi256_si512(load(b)),
+                                  N > 1 ? load(b + 1) : _mm256_setzero_si256(), 1);
+#else
+        return load(b);
+#endif
+    }
+
+    template <int N, typename T>
+    inline vnni_f vnni_scale(const T *p) {
+#if defined(__AVX512VNNI__)
+        return _mm512_castsi512_ps(_mm512_inserti64x4(
+            _mm512_castsi256_si512(_mm256_castps_si256(_mm256_set1_ps(unhalf(p[0].d)))),
+            _mm256_castps_si256(_mm256_set1_ps(N > 1 ? unhalf(p[1].d) : 0.f)), 1));
+#else
+        return _mm256_set1_ps(unhalf(p->d));
+#endif
+    }
+
+    // returns -c·Σb where c is the bias that loadu() added to the weights
+    inline vnni_i vnni_offset(vnni_i b) {
+#if defined(__AVX512VNNI__)
+        __m512i sum = _mm512_dpbusd_epi32(_mm512_setzero_si512(), _mm512_set1_epi8(1), b);
+        return _mm512_sub_epi32(_mm512_setzero_si512(),
+                                _mm512_slli_epi32(sum, BIAS_SHIFT));
+#else
+        __m256i sum = _mm256_dpbusd_epi32(_mm256_setzero_si256(), _mm256_set1_epi8(1), b);
+        return _mm256_sub_epi32(_mm256_setzero_si256(),
+                                _mm256_slli_epi32(sum, BIAS_SHIFT));
+#endif
+    }
+
+    inline vnni_f vnni_dot(vnni_i o, vnni_i u, vnni_i s) {
+#if defined(__AVX512VNNI__)
+        return _mm512_cvtepi32_ps(_mm512_dpbusd_epi32(o, u, s));
+#else
+        return _mm256_cvtepi32_ps(_mm256_dpbusd_epi32(o, u, s));
+#endif
+    }
+#endif // __AVX512VNNI__ || __AVXVNNI__
+
     inline __m256i load(const block_q8_0 *b) {
         return _mm256_loadu_si256((const __m256i *)b->qs);
     }
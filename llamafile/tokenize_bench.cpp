@@ -0,0 +1,130 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bpe.h"
+#include "llama.h"
+#include "llamafile.h"
+
+#include <cosmo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string_view>
+#include <time.h>
+#include <vector>
+
+#include "llama.cpp/llama.h"
+
+// compares llama_tokenize() with our fast bpe tokenizer
+//
+//     o//llamafile/tokenize_bench -m Meta-Llama-3-8B.gguf -f corpus.txt
+//
+// the corpus is tokenized a line at a time by both, then we check the
+// tokens are identical, and report how many tokens per second each of
+// them were able to produce. it's then tokenized again as one string,
+// which lets the fast tokenizer split the work across threads.
+
+double now() {
+    return timespec_tonanos(timespec_real()) * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    FLAG_log_disable = true;
+    llamafile_get_flags(argc, argv);
+    if (!FLAG_file) {
+        fprintf(stderr, "%s: missing -f CORPUS\n", argv[0]);
+        return 1;
+    }
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+    llama_model *model = llama_load_model_from_file(FLAG_model, mparams);
+    if (!model)
+        return 3;
+    llamafile_bpe_load(model, FLAG_model);
+
+    std::string corpus;
+    FILE *f = fopen(FLAG_file, "rb");
+    if (!f) {
+        perror(FLAG_file);
+        return 1;
+    }
+    char buf[65536];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f));)
+        corpus.append(buf, n);
+    fclose(f);
+    std::vector<std::string_view> lines;
+    for (size_t i = 0, j; i < corpus.size(); i = j) {
+        j = corpus.find('\n', i);
+        j = j == std::string::npos ? corpus.size() : j + 1;
+        lines.emplace_back(corpus.data() + i, j - i);
+    }
+
+    std::vector<llama_token> want;
+    std::vector<llama_token> toks(4096);
+    double start = now();
+    for (std::string_view line : lines) {
+        if (toks.size() < line.size() + 2)
+            toks.resize(line.size() + 2);
+        int n = llama_tokenize(model, line.data(), line.size(), toks.data(), toks.size(), false,
+                               false);
+        if (n < 0) {
+            fprintf(stderr, "%s: failed to tokenize line\n", argv[0]);
+            return 1;
+        }
+        want.insert(want.end(), toks.begin(), toks.begin() + n);
+    }
+    double slow = now() - start;
+
+    int fallbacks = 0;
+    std::vector<llama_token> got;
+    got.reserve(want.size());
+    start = now();
+    for (std::string_view line : lines) {
+        if (!llamafile_bpe_tokenize(model, line, false, &got)) {
+            ++fallbacks;
+            std::vector<llama_token> r = llamafile_tokenize(model, line, false, false);
+            got.insert(got.end(), r.begin(), r.end());
+        }
+    }
+    double fast = now() - start;
+
+    if (got != want) {
+        fprintf(stderr, "%s: fast tokenizer disagrees with llama_tokenize()\n", argv[0]);
+        return 2;
+    }
+    printf("%zu lines %zu tokens %d fallbacks\n", lines.size(), want.size(), fallbacks);
+    printf("llama_tokenize %12.0f tok/s\n", want.size() / slow);
+    printf("llamafile_bpe  %12.0f tok/s (%.1fx)\n", want.size() / fast, slow / fast);
+
+    start = now();
+    want = llamafile_tokenize(model, corpus, false, false);
+    fast = now() - start;
+    toks.resize(want.size());
+    start = now();
+    int n = llama_tokenize(model, corpus.data(), corpus.size(), toks.data(), toks.size(), false,
+                           false);
+    slow = now() - start;
+    if (n < 0 || toks != want) {
+        fprintf(stderr, "%s: parallel tokenizer disagrees with llama_tokenize()\n", argv[0]);
+        return 2;
+    }
+    printf("whole corpus   %12.0f tok/s (%.1fx)\n", want.size() / fast, slow / fast);
+
+    llamafile_bpe_free(model);
+    llama_free_model(model);
+}
@@ -21,6 +21,8 @@
 #include <assert.h>
 #include <cosmo.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/auxv.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -51,6 +53,25 @@ extern "C" void ggml_vec_silu_f32_amd_k8(const int n, float *y, const float *x);
 extern "C" void ggml_vec_silu_f32_arm82(const int n, float *y, const float *x);
 extern "C" void ggml_vec_silu_f32_arm80(const int n, float *y, const float *x);
 
+#define DECLARE_UNARY(F)                                                          \
+    extern "C" void F##_amd_avx512bf16(const int n, float *y, const float *x);    \
+    extern "C" void F##_amd_avx512vl(const int n, float *y, const float *x);      \
+    extern "C" void F##_amd_avx512(const int n, float *y, const float *x);        \
+    extern "C" void F##_amd_avx2(const int n, float *y, const float *x);          \
+    extern "C" void F##_amd_f16c(const int n, float *y, const float *x);          \
+    extern "C" void F##_amd_fma(const int n, float *y, const float *x);           \
+    extern "C" void F##_amd_avx(const int n, float *y, const float *x);           \
+    extern "C" void F##_amd_ssse3(const int n, float *y, const float *x);         \
+    extern "C" void F##_amd_k8(const int n, float *y, const float *x);            \
+    extern "C" void F##_arm82(const int n, float *y, const float *x);             \
+    extern "C" void F##_arm80(const int n, float *y, const float *x)
+
+DECLARE_UNARY(ggml_vec_tanh_f32);
+DECLARE_UNARY(ggml_vec_sigmoid_f32);
+DECLARE_UNARY(ggml_vec_log_f32);
+DECLARE_UNARY(ggml_vec_elu_f32);
+DECLARE_UNARY(ggml_vec_sqrt_f32);
+
 #define N 256
 
 float mathf(void vmathf(int, float *, const float *), float x) {
@@ -107,11 +128,78 @@ void test_vmathf(void vmathf(int, float *, const float *)) {
     npassert(!munmap(map1, greed + pagesz));
 }
 
+double tanh_ref(double x) {
+    return tanh(x);
+}
+
+double sigmoid_ref(double x) {
+    return 1 / (1 + exp(-x));
+}
+
+double elu_ref(double x) {
+    return x > 0 ? x : expm1(x);
+}
+
+// returns distance between got and want in units in the last place.
+// results that are subnormal in float are allowed to flush to zero.
+double ulp(float got, double want) {
+    if (isnan(want))
+        return isnan(got) ? 0 : INFINITY;
+    if (isnan(got))
+        return INFINITY;
+    float w = want;
+    if (isinf(w))
+        return got == w ? 0 : INFINITY;
+    if (!w || !flt::isnormal(w))
+        return !got || !flt::isnormal(got) ? 0 : INFINITY;
+    return fabs(got - want) / ldexp(1., ilogb(w) - 23);
+}
+
+void test_ulp(const char *name, void vmathf(int, float *, const float *), double ref(double),
+              double max_ulp) {
+
+    // sweep over bit patterns of every sign and exponent, so
+    // special values and the reduction boundaries get covered
+
+    enum { B = 4096, STRIDE = 4099 };
+    static float X[B], Y[B];
+    unsigned long i = 0;
+    while (i <= 0xffffffff) {
+        int n = 0;
+        for (; n < B && i <= 0xffffffff; ++n, i += STRIDE)
+            X[n] = flt::tofloat(i);
+        if (n < B)
+            X[n++] = INFINITY;
+        vmathf(n, Y, X);
+        for (int j = 0; j < n; ++j) {
+            double err = ulp(Y[j], ref(X[j]));
+            if (err > max_ulp) {
+                fprintf(stderr, "%s(%.9g) = %.9g but wanted %.9g (%g ulp)\n", name, X[j], Y[j],
+                        ref(X[j]), err);
+                exit(1);
+            }
+        }
+    }
+}
+
+#define TEST_UNARY(ARCH)                                                          \
+    test_vmathf(ggml_vec_tanh_f32##ARCH);                                         \
+    test_vmathf(ggml_vec_sigmoid_f32##ARCH);                                      \
+    test_vmathf(ggml_vec_log_f32##ARCH);                                          \
+    test_vmathf(ggml_vec_elu_f32##ARCH);                                          \
+    test_vmathf(ggml_vec_sqrt_f32##ARCH);                                         \
+    test_ulp("tanh" #ARCH, ggml_vec_tanh_f32##ARCH, tanh_ref, 4);                 \
+    test_ulp("sigmoid" #ARCH, ggml_vec_sigmoid_f32##ARCH, sigmoid_ref, 5);        \
+    test_ulp("log" #ARCH, ggml_vec_log_f32##ARCH, log, 3.5);                      \
+    test_ulp("elu" #ARCH, ggml_vec_elu_f32##ARCH, elu_ref, 2);                    \
+    test_ulp("sqrt" #ARCH, ggml_vec_sqrt_f32##ARCH, sqrt, .5)
+
 int main(int argc, char *argv[]) {
     ShowCrashReports();
 
     test_vmathf(ggml_vec_gelu_f32);
     test_vmathf(ggml_vec_silu_f32);
+    TEST_UNARY();
 
 #ifdef __x86_64__
 
@@ -119,56 +207,67 @@ int main(int argc, char *argv[]) {
         X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) && X86_HAVE(AVX512VL) && X86_HAVE(AVX512_BF16)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx512bf16);
         test_vmathf(ggml_vec_silu_f32_amd_avx512bf16);
+        TEST_UNARY(_amd_avx512bf16);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2) && X86_HAVE(AVX512F) &&
         X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) && X86_HAVE(AVX512VL)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx512vl);
         test_vmathf(ggml_vec_silu_f32_amd_avx512vl);
+        TEST_UNARY(_amd_avx512vl);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2) && X86_HAVE(AVX512F)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx512);
         test_vmathf(ggml_vec_silu_f32_amd_avx512);
+        TEST_UNARY(_amd_avx512);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx2);
         test_vmathf(ggml_vec_silu_f32_amd_avx2);
+        TEST_UNARY(_amd_avx2);
     }
 
     if (X86_HAVE(AVX) && X86_HAVE(F16C)) {
         test_vmathf(ggml_vec_gelu_f32_amd_f16c);
         test_vmathf(ggml_vec_silu_f32_amd_f16c);
+        TEST_UNARY(_amd_f16c);
     }
 
     if (X86_HAVE(AVX) && X86_HAVE(FMA)) {
         test_vmathf(ggml_vec_gelu_f32_amd_fma);
         test_vmathf(ggml_vec_silu_f32_amd_fma);
+        TEST_UNARY(_amd_fma);
     }
 
     if (X86_HAVE(AVX)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx);
         test_vmathf(ggml_vec_silu_f32_amd_avx);
+        TEST_UNARY(_amd_avx);
     }
 
     if (X86_HAVE(SSSE3)) {
         test_vmathf(ggml_vec_gelu_f32_amd_ssse3);
         test_vmathf(ggml_vec_silu_f32_amd_ssse3);
+        TEST_UNARY(_amd_ssse3);
     }
 
     test_vmathf(ggml_vec_gelu_f32_amd_k8);
     test_vmathf(ggml_vec_silu_f32_amd_k8);
+    TEST_UNARY(_amd_k8);
 
 #elif defined(__aarch64__)
 
     if ((getauxval(AT_HWCAP) & HWCAP_FPHP) && (getauxval(AT_HWCAP) & HWCAP_ASIMDHP)) {
         test_vmathf(ggml_vec_gelu_f32_arm82);
         test_vmathf(ggml_vec_silu_f32_arm82);
+        TEST_UNARY(_arm82);
     }
 
     test_vmathf(ggml_vec_gelu_f32_arm80);
     test_vmathf(ggml_vec_silu_f32_arm80);
+    TEST_UNARY(_arm80);
 
 #endif
 
@@ -259,5 +259,6 @@
 
 int64_t get_zip_cfile_offset(const uint8_t *);
 int64_t get_zip_cfile_compressed_size(const uint8_t *);
+int zip_copy(int, int64_t, int64_t, int, int64_t, uint32_t *);
 
 #endif /* COSMO_ZIP_ */
@@ -322,18 +322,18 @@ int main(int argc, char *argv[]) {
         uint64_t compsize = 0;
         _Alignas(4096) static uint8_t iobuf[CHUNK];
         _Alignas(4096) static uint8_t cdbuf[CHUNK];
-        for (off_t i = 0; i < size; i += rc) {
-            // read chunk
-            if ((rc = pread(fd, iobuf, Min(size, CHUNK), i)) <= 0)
+        if (!flag_level) {
+            // copy and checksum uncompressed file using many threads
+            if (zip_copy(fd, 0, size, zfd, zsize + hdrlen, &crc))
                 DieSys(path);
-            posix_fadvise(fd, i, Min(size, CHUNK), POSIX_FADV_DONTNEED);
-            crc = crc32(crc, iobuf, rc);
-            if (!flag_level) {
-                // write uncompressed chunk to output
-                if (pwrite(zfd, iobuf, rc, zsize + hdrlen + compsize) != rc)
-                    DieSys(zpath);
-                compsize += rc;
-            } else {
+            compsize = size;
+        } else {
+            for (off_t i = 0; i < size; i += rc) {
+                // read chunk
+                if ((rc = pread(fd, iobuf, Min(size, CHUNK), i)) <= 0)
+                    DieSys(path);
+                posix_fadvise(fd, i, Min(size, CHUNK), POSIX_FADV_DONTNEED);
+                crc = crc32(crc, iobuf, rc);
                 // compress chunk and write to output
                 zs.avail_in = rc;
                 zs.next_in = iobuf;
@@ -39,11 +39,13 @@ DESCRIPTION\n\
 FLAGS\n\
 \n\
   -h        help\n\
+  -c        verify crc32 checksums of file contents\n\
 \n"
 
 #define Min(a, b) ((a) < (b) ? (a) : (b))
 
 static const char *prog;
+static bool flag_verify;
 
 static wontreturn void Die(const char *thing, const char *reason) {
     tinyprint(2, thing, ": ", reason, "\n", NULL);
@@ -79,6 +81,34 @@ static void *Realloc(void *p, size_t n) {
     return p;
 }
 
+// computes crc32 of deflated content, which has to be done serially
+static uint32_t InflateCrc32(const char *zpath, int zfd, off_t off, int64_t compsize) {
+    z_stream zs = {0};
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+        DieOom();
+    ssize_t rc;
+    uint32_t crc = 0;
+    int status = Z_OK;
+    static uint8_t iobuf[65536];
+    static uint8_t outbuf[65536];
+    for (int64_t i = 0; i < compsize && status != Z_STREAM_END; i += rc) {
+        if ((rc = pread(zfd, iobuf, Min(compsize - i, sizeof(iobuf)), off + i)) <= 0)
+            Die(zpath, "failed to pread compressed content");
+        zs.next_in = iobuf;
+        zs.avail_in = rc;
+        do {
+            zs.next_out = outbuf;
+            zs.avail_out = sizeof(outbuf);
+            status = inflate(&zs, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+                Die(zpath, "corrupted deflate stream");
+            crc = crc32(crc, outbuf, sizeof(outbuf) - zs.avail_out);
+        } while (!zs.avail_out);
+    }
+    inflateEnd(&zs);
+    return crc;
+}
+
 static wontreturn void PrintUsage(int fd, int rc) {
     tinyprint(fd, "SYNOPSIS\n\n  ", prog, USAGE, NULL);
     exit(rc);
@@ -176,6 +206,28 @@ static void CheckZip(const char *zpath) {
         long align = 1ull << _bsfl(off);
         printf("%.*s has alignment of %ld\n", (int)ZIP_CFILE_NAMESIZE(cdir + entry_offset),
                ZIP_CFILE_NAME(cdir + entry_offset), align);
+
+        // verify checksum of local file content
+        if (flag_verify) {
+            uint32_t crc;
+            int64_t compsize = get_zip_cfile_compressed_size(cdir + entry_offset);
+            switch (ZIP_CFILE_COMPRESSIONMETHOD(cdir + entry_offset)) {
+            case kZipCompressionNone:
+                if (zip_copy(zfd, off, compsize, -1, 0, &crc))
+                    DieSys(zpath);
+                break;
+            case kZipCompressionDeflate:
+                crc = InflateCrc32(zpath, zfd, off, compsize);
+                break;
+            default:
+                Die(zpath, "unsupported compression method");
+            }
+            if (crc != ZIP_CFILE_CRC32(cdir + entry_offset)) {
+                printf("%.*s has bad crc32\n", (int)ZIP_CFILE_NAMESIZE(cdir + entry_offset),
+                       ZIP_CFILE_NAME(cdir + entry_offset));
+                exit(1);
+            }
+        }
     }
 
     // close input
@@ -192,10 +244,13 @@ int main(int argc, char *argv[]) {
 
     // parse flags
     int opt;
-    while ((opt = getopt(argc, argv, "h")) != -1) {
+    while ((opt = getopt(argc, argv, "hc")) != -1) {
         switch (opt) {
         case 'h':
             PrintUsage(1, 0);
+        case 'c':
+            flag_verify = true;
+            break;
         default:
             PrintUsage(2, 1);
         }
@@ -0,0 +1,161 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "zip.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <third_party/zlib/zlib.h>
+#include <unistd.h>
+
+#define PIECE (16 * 1024 * 1024)
+#define CHUNK (2 * 1024 * 1024)
+#define MAX_THREADS 16
+
+#define Min(a, b) ((a) < (b) ? (a) : (b))
+#define Max(a, b) ((a) > (b) ? (a) : (b))
+
+struct ZipCopy {
+    int fd;
+    int zfd;
+    int64_t off;
+    int64_t zoff;
+    int64_t size;
+    int64_t pieces;
+    uint32_t *crcs;
+    atomic_long next;
+    atomic_int err;
+    atomic_bool offload; // copy_file_range() is supported
+};
+
+static bool zip_copy_unsupported(int err) {
+    return err == EXDEV || err == ENOSYS || err == EINVAL || err == EOPNOTSUPP || err == EBADF;
+}
+
+static int zip_copy_piece(struct ZipCopy *c, int64_t k, uint8_t *buf) {
+
+    // have the kernel move the bytes, which reflinks on btrfs and xfs
+    int64_t beg = k * PIECE;
+    int64_t len = Min(PIECE, c->size - beg);
+    int64_t done = 0;
+    if (c->zfd != -1 && atomic_load_explicit(&c->offload, memory_order_relaxed)) {
+        while (done < len) {
+            int64_t in = c->off + beg + done;
+            int64_t out = c->zoff + beg + done;
+            ssize_t rc = copy_file_range(c->fd, &in, c->zfd, &out, len - done, 0);
+            if (rc > 0) {
+                done += rc;
+            } else if (rc == -1 && zip_copy_unsupported(errno)) {
+                atomic_store_explicit(&c->offload, false, memory_order_relaxed);
+                break;
+            } else {
+                if (!rc)
+                    errno = EIO;
+                return -1;
+            }
+        }
+    }
+
+    // checksum the piece, and copy whatever the kernel didn't
+    ssize_t rc;
+    uint32_t crc = crc32(0, 0, 0);
+    for (int64_t i = 0; i < len; i += rc) {
+        if ((rc = pread(c->fd, buf, Min(CHUNK, len - i), c->off + beg + i)) <= 0) {
+            if (!rc)
+                errno = EIO;
+            return -1;
+        }
+        crc = crc32(crc, buf, rc);
+        if (c->zfd != -1 && i + rc > done) {
+            int64_t skip = Max(done - i, 0);
+            if (pwrite(c->zfd, buf + skip, rc - skip, c->zoff + beg + i + skip) != rc - skip)
+                return -1;
+        }
+        posix_fadvise(c->fd, c->off + beg + i, rc, POSIX_FADV_DONTNEED);
+    }
+    c->crcs[k] = crc;
+    return 0;
+}
+
+static void *zip_copy_worker(void *arg) {
+    struct ZipCopy *c = arg;
+    uint8_t *buf = mmap(0, CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        int expect = 0;
+        atomic_compare_exchange_strong(&c->err, &expect, errno);
+        return 0;
+    }
+    for (;;) {
+        int64_t k = atomic_fetch_add_explicit(&c->next, 1, memory_order_relaxed);
+        if (k >= c->pieces)
+            break;
+        if (zip_copy_piece(c, k, buf) == -1) {
+            int expect = 0;
+            atomic_compare_exchange_strong(&c->err, &expect, errno);
+            atomic_store_explicit(&c->next, c->pieces, memory_order_relaxed);
+            break;
+        }
+    }
+    munmap(buf, CHUNK);
+    return 0;
+}
+
+/**
+ * Copies and checksums file content using many threads.
+ *
+ * This reads `size` bytes from `fd` at `off` and computes their crc32
+ * by checksumming pieces independently and combining the results. If
+ * `zfd` isn't -1 then the bytes are also copied to `zoff` in `zfd`,
+ * using copy_file_range() when the kernel and filesystem support it.
+ *
+ * @return 0 on success, or -1 w/ errno
+ */
+int zip_copy(int fd, int64_t off, int64_t size, int zfd, int64_t zoff, uint32_t *out_crc) {
+    struct ZipCopy c = {fd, zfd, off, zoff, size};
+    c.pieces = (size + PIECE - 1) / PIECE;
+    atomic_init(&c.offload, true);
+    if (!(c.crcs = malloc(Max(c.pieces, 1) * sizeof(uint32_t))))
+        return -1;
+
+    // spawn workers, and have this thread be one of them
+    int n = 0;
+    pthread_t th[MAX_THREADS];
+    int threads = Min(Min(c.pieces, sysconf(_SC_NPROCESSORS_ONLN)), MAX_THREADS);
+    for (int i = 1; i < threads; ++i)
+        if (!pthread_create(th + n, 0, zip_copy_worker, &c))
+            ++n;
+    zip_copy_worker(&c);
+    for (int i = 0; i < n; ++i)
+        pthread_join(th[i], 0);
+    if (c.err) {
+        free(c.crcs);
+        errno = c.err;
+        return -1;
+    }
+
+    // crc32(a||b) can be derived from crc32(a), crc32(b), and len(b)
+    uint32_t crc = crc32(0, 0, 0);
+    for (int64_t k = 0; k < c.pieces; ++k)
+        crc = crc32_combine(crc, c.crcs[k], Min(PIECE, size - k * PIECE));
+    free(c.crcs);
+    *out_crc = crc;
+    return 0;
+}
@@ -19,7 +19,7 @@ LOCALSCORE_OBJS =					\
 
 # Build the library
 o/$(MODE)/localscore/localscore.a: 		\
-		$(LOCALSCORE_OBJS)				\
+		$(filter-out %_test.o,$(LOCALSCORE_OBJS))	\
 
 # Any specific compiler flags needed
 $(LOCALSCORE_OBJS): private				\
@@ -36,6 +36,12 @@ o/$(MODE)/localscore/localscore:				\
 
 $(LOCALSCORE_OBJS): localscore/BUILD.mk
 
+o/$(MODE)/localscore/powersampler_test:			\
+		o/$(MODE)/localscore/powersampler_test.o	\
+		o/$(MODE)/localscore/localscore.a	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 .PHONY: o/$(MODE)/localscore
 o/$(MODE)/localscore:					\
 		o/$(MODE)/localscore/localscore		\
+		o/$(MODE)/localscore/powersampler_test.runs	\
@@ -36,6 +36,7 @@ test::test(const cmd_params &inst, const llama_model *lmodel,
     embeddings = inst.embeddings;
     n_prompt = inst.n_prompt;
     n_gen = inst.n_gen;
+    n_parallel = inst.n_parallel;
     reps = repetitions;
     test_completed = false;
     curr_run = 0;
@@ -52,6 +53,11 @@ test::test(const cmd_params &inst, const llama_model *lmodel,
         snprintf(buf, sizeof(buf), "pp%d+tg%d", n_prompt, n_gen);
     }
     name = buf;
+    if (n_parallel > 1) {
+        snprintf(buf, sizeof(buf), " x%d", n_parallel);
+        name += buf;
+    }
+    token_latencies_ns.reserve((size_t)n_gen * reps);
 
     // RFC 3339 date-time format
     time_t t = time(NULL);
@@ -98,25 +104,27 @@ void test::test_prompt() {
 
     std::vector<llama_token> tokens(n_batch);
 
-    int n_processed = 0;
-
     time_interval interval;
     interval.start = utils::get_time_ns();
     interval.end = 0;
     prompt_intervals.push_back(interval);
 
-    while (n_processed < n_prompt) {
-        int n_tokens = std::min(n_prompt - n_processed, n_batch);
-        tokens[0] = n_processed == 0 && llama_add_bos_token(model)
-                        ? llama_token_bos(model)
-                        : std::rand() % n_vocab;
-        for (int i = 1; i < n_tokens; i++) {
-            tokens[i] = std::rand() % n_vocab;
+    // each parallel sequence gets its own prompt in the shared kv cache
+    for (int s = 0; s < n_parallel; s++) {
+        int n_processed = 0;
+        while (n_processed < n_prompt) {
+            int n_tokens = std::min(n_prompt - n_processed, n_batch);
+            tokens[0] = n_processed == 0 && llama_add_bos_token(model)
+                            ? llama_token_bos(model)
+                            : std::rand() % n_vocab;
+            for (int i = 1; i < n_tokens; i++) {
+                tokens[i] = std::rand() % n_vocab;
+            }
+            llama_decode(ctx, llama_batch_get_one(tokens.data(), n_tokens,
+                                                  n_processed, s));
+            n_processed += n_tokens;
+            t_processed = s * n_prompt + n_processed;
         }
-        llama_decode(
-            ctx, llama_batch_get_one(tokens.data(), n_tokens, n_processed, 0));
-        n_processed += n_tokens;
-        t_processed = n_processed;
     }
 
     llama_synchronize(ctx);
@@ -130,24 +138,42 @@ void test::test_gen() {
     const llama_model *model = llama_get_model(ctx);
     const int32_t n_vocab = llama_n_vocab(model);
 
-    llama_token token = llama_add_bos_token(model) ? llama_token_bos(model)
-                                                   : std::rand() % n_vocab;
+    // every decode step advances each parallel sequence by one token
+    llama_batch batch = llama_batch_init(n_parallel, 0, 1);
+    batch.n_tokens = n_parallel;
+    for (int s = 0; s < n_parallel; s++) {
+        batch.token[s] = llama_add_bos_token(model) ? llama_token_bos(model)
+                                                    : std::rand() % n_vocab;
+        batch.n_seq_id[s] = 1;
+        batch.seq_id[s][0] = s;
+        batch.logits[s] = true;
+    }
 
     time_interval interval;
     interval.start = utils::get_time_ns();
     interval.end = 0;
     gen_intervals.push_back(interval);
 
+    uint64_t last = interval.start;
     for (int i = 0; i < n_gen; i++) {
-        llama_decode(ctx, llama_batch_get_one(&token, 1, n_prompt + i, 0));
+        for (int s = 0; s < n_parallel; s++) {
+            batch.pos[s] = n_prompt + i;
+        }
+        llama_decode(ctx, batch);
         llama_synchronize(ctx);
+        uint64_t now = utils::get_time_ns();
+        token_latencies_ns.push_back(now - last);
+        last = now;
         if (i == 0) {
-            uint64_t ttft = utils::get_time_ns() - test_intervals.back().start;
+            uint64_t ttft = now - test_intervals.back().start;
             time_to_first_token.push_back(ttft);
         }
-        token = std::rand() % n_vocab;
-        t_gen = i + 1;
+        for (int s = 0; s < n_parallel; s++) {
+            batch.token[s] = std::rand() % n_vocab;
+        }
+        t_gen = (i + 1) * n_parallel;
     }
+    llama_batch_free(batch);
 
     gen_intervals.back().end = utils::get_time_ns();
 }
@@ -200,6 +226,7 @@ std::vector<double> test::get_ts(token_metric metric) const {
         n_tokens = n_gen;
         break;
     }
+    n_tokens *= n_parallel;
 
     std::vector<double> ts;
     std::vector<uint64_t> samples_ns = get_samples_ns(metric);
@@ -234,6 +261,11 @@ double test::ttft() const {
     return utils::avg(time_to_first_token);
 }
 
+// inter-token latency seen by each sequence, at percentile p
+double test::itl_ms(double p) const {
+    return utils::percentile(token_latencies_ns, p) / 1e6;
+}
+
 std::vector<std::string> test::get_values() const {
     std::string tensor_split_str;
     int max_nonzero = 0;
@@ -277,7 +309,9 @@ std::vector<std::string> test::get_values() const {
         // name, std::to_string(power), std::to_string(monitor_result.vram),
         // std::to_string(ttft() / 1e6)
         name, std::to_string(power), std::to_string(ttft() / 1e6),
-        std::to_string(main_gpu)};
+        std::to_string(main_gpu), std::to_string(n_parallel),
+        std::to_string(itl_ms(.50)), std::to_string(itl_ms(.90)),
+        std::to_string(itl_ms(.99))};
     return values;
 }
 
@@ -307,7 +341,8 @@ const std::vector<std::string> test::get_fields() {
         "prompt_tps", "prompt_tps_watt", "prompt_tps_stddev", "gen_tps",
         "gen_tps_watt", "gen_tps_stddev",
         // "name", "power_watts", "vram_used_mb", "ttft_ms"
-        "name", "power_watts", "ttft_ms", "main_gpu"};
+        "name", "power_watts", "ttft_ms", "main_gpu", "n_parallel",
+        "itl_p50_ms", "itl_p90_ms", "itl_p99_ms"};
     return fields;
 }
 
@@ -343,7 +378,7 @@ test::field_type test::get_field_type(const std::string &field) {
         field == "model_n_params" || field == "n_gpu_layers" ||
         field == "main_gpu" || field == "n_prompt" || field == "n_gen" ||
         field == "avg_time_ms" || field == "stddev_time_ms" ||
-        field == "ttft_ms") {
+        field == "ttft_ms" || field == "n_parallel") {
         return INT;
     }
     if (field == "cuda" || field == "opencl" || field == "vulkan" ||
@@ -356,7 +391,9 @@ test::field_type test::get_field_type(const std::string &field) {
     if (field == "prompt_tps" || field == "prompt_tps_watt" ||
         field == "prompt_tps_stddev" || field == "gen_tps" ||
         field == "gen_tps_watt" || field == "gen_tps_stddev" ||
-        field == "power_watts" || field == "vram_used_mb") {
+        field == "power_watts" || field == "vram_used_mb" ||
+        field == "itl_p50_ms" || field == "itl_p90_ms" ||
+        field == "itl_p99_ms") {
         return FLOAT;
     }
     return STRING;
@@ -19,6 +19,7 @@ struct time_interval {
 struct test_config {
     int n_prompt;
     int n_gen;
+    int n_parallel = 1; // sequences decoded together in one context
 };
 
 enum token_metric { TOTAL_TPS, PROMPT_TPS, GEN_TPS };
@@ -59,18 +60,21 @@ struct test {
     bool embeddings;
     int n_prompt;
     int n_gen;
+    int n_parallel;
     int reps;
     mutable std::mutex t_gen_mutex;
     std::atomic_bool test_completed{false};
     volatile int curr_run;
     volatile int t_gen;       // this is the total number of tokens generated
     volatile int t_processed; // this is the total number of tokens processed
+                              // (both summed across all parallel sequences)
     power_sample_t monitor_result;
     std::string test_time;
     std::vector<time_interval> test_intervals;
     std::vector<time_interval> prompt_intervals;
     std::vector<time_interval> gen_intervals;
     std::vector<uint64_t> time_to_first_token;
+    std::vector<uint64_t> token_latencies_ns; // one per decode step, all reps
     llama_context *ctx;
     PowerSampler *pwr_sampler;
 
@@ -90,6 +94,7 @@ struct test {
     double stdev_ts(token_metric metric = TOTAL_TPS) const;
     double get_tps_watt(token_metric metric = TOTAL_TPS) const;
     double ttft() const;
+    double itl_ms(double p) const;
 
     std::vector<std::string> get_values() const;
     std::map<std::string, std::string> get_map() const;
@@ -3,12 +3,14 @@
 #include "cmd.h"
 #include "llama.cpp/cores.h"
 #include "system.h"
+#include "utils.h"
 #include <cosmo.h>
 
 static const cmd_params cmd_params_defaults = {
     /* model         */ "", // [jart] no default guessing
     /* n_prompt      */ 0,
     /* n_gen         */ 0,
+    /* n_parallel    */ 1,
     /* n_batch       */ 2048,
     /* n_ubatch      */ 512,
     /* type_k        */ X86_HAVE(AVX512_BF16) ? GGML_TYPE_BF16 : GGML_TYPE_F16,
@@ -25,6 +27,7 @@ static const cmd_params cmd_params_defaults = {
     /* embeddings    */ false,
     /* numa          */ GGML_NUMA_STRATEGY_DISABLED,
     /* reps          */ 1,
+    /* parallel_sweep */ {},
     /* verbose       */ false,
     /* plaintext     */ false,
     /* send_results  */ SEND_ASK,
@@ -55,7 +58,8 @@ bool cmd_params::equal_mparams(const cmd_params & other) const {
 llama_context_params cmd_params::to_llama_cparams() const {
     llama_context_params cparams = llama_context_default_params();
 
-    cparams.n_ctx = n_prompt + n_gen;
+    cparams.n_ctx = n_parallel * (n_prompt + n_gen);
+    cparams.n_seq_max = n_parallel;
     cparams.n_batch = n_batch;
     cparams.n_ubatch = n_ubatch;
     cparams.type_k = type_k;
@@ -142,6 +146,21 @@ cmd_params parse_cmd_params(int argc, char ** argv) {
                 invalid_param = true;
             }
             else params.reps = std::max(1, std::stoi(argv[i]));
+        } else if (arg == "--parallel") {
+            if (++i >= argc) {
+                invalid_param = true;
+            }
+            else {
+                params.parallel_sweep = utils::split<int>(argv[i], ',');
+                for (int k : params.parallel_sweep) {
+                    if (k < 1 || k > params.n_batch) {
+                        invalid_param = true;
+                    }
+                }
+                if (params.parallel_sweep.empty()) {
+                    invalid_param = true;
+                }
+            }
         } else if (arg == "--recompile") {
             FLAG_recompile = true;
         } else if (arg == "--localscore") {
@@ -202,4 +221,5 @@ void print_usage(int /* argc */, char ** argv) {
     printf("  -e, --extended                             run 4 reps (shortcut for --reps=4)\n");
     printf("  --long                                     run 16 reps (shortcut for --reps=16)\n");
     printf("  --reps <N>                                 set custom number of repetitions\n");
+    printf("  --parallel <k,...>                         sweep k parallel sequences instead of scoring (e.g. 1,2,4,8)\n");
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ struct cmd_params {
     std::string model;
     int n_prompt;
     int n_gen;
+    int n_parallel;
     int n_batch;
     int n_ubatch;
     ggml_type type_k;
@@ -27,6 +28,7 @@ struct cmd_params {
     bool embeddings;
     ggml_numa_strategy numa;
     int reps;
+    std::vector<int> parallel_sweep;
     bool verbose;
     bool plaintext;
     send_results_mode send_results;
@@ -398,6 +398,28 @@ std::vector<test_config> get_baseline_test_configs() {
     };
 }
 
+// one context shared by k sequences, to see how throughput scales
+std::vector<test_config> get_parallel_test_configs(const std::vector<int>& sweep) {
+    std::vector<test_config> tests;
+    for (int k : sweep) {
+        tests.push_back({512, 128, k});
+    }
+    return tests;
+}
+
+void print_parallel_summary(const std::vector<test_config>& tests,
+                            const std::vector<double>& gen_tps,
+                            const std::vector<double>& itl_p99) {
+    printf("\n%10s %14s %14s %10s %14s\n", "parallel", "tg t/s", "per seq t/s",
+           "scaling", "itl p99");
+    for (size_t i = 0; i < tests.size(); i++) {
+        int k = tests[i].n_parallel;
+        printf("%10d %14.2f %14.2f %9.2fx %11.2f ms\n", k, gen_tps[i],
+               gen_tps[i] / k, gen_tps[0] > 0 ? gen_tps[i] / gen_tps[0] : 0.0,
+               itl_p99[i]);
+    }
+}
+
 void setup_initial_environment(int* argc, char*** argv, cmd_params* params, SystemData* sys_data) {
     LoadZipArgs(argc, argv);
     setlocale(LC_CTYPE, "C.UTF-8");
@@ -462,14 +484,16 @@ void perform_warmup(llama_model* model, const cmd_params& params) {
 
 bool run_baseline_tests(const std::vector<test_config>& tests, llama_model* model, 
                         const cmd_params& params, printer* p, PowerSampler* sampler, 
-                        json_printer* req_printer) {
+                        json_printer* req_printer,
+                        std::vector<double>* gen_tps = nullptr,
+                        std::vector<double>* itl_p99 = nullptr) {
     for (const auto& test_cfg : tests) {
         cmd_params inst = params;
         inst.n_prompt = test_cfg.n_prompt;
         inst.n_gen = test_cfg.n_gen;
+        inst.n_parallel = test_cfg.n_parallel;
 
         llama_context_params cparams = inst.to_llama_cparams();
-        cparams.n_ctx = test_cfg.n_prompt + test_cfg.n_gen;
 
         llama_context* ctx = llama_new_context_with_model(model, cparams);
         if (!ctx) {
@@ -489,6 +513,12 @@ bool run_baseline_tests(const std::vector<test_config>& tests, llama_model* mode
         t.run();
         pthread_join(update_thread, NULL);
         req_printer->print_test(t);
+        if (gen_tps) {
+            gen_tps->push_back(t.avg_ts(GEN_TPS));
+        }
+        if (itl_p99) {
+            itl_p99->push_back(t.itl_ms(.99));
+        }
         
         llama_free(ctx);
     }
@@ -521,11 +551,16 @@ void process_and_submit_results(const std::string& req_payload, const cmd_params
 int localscore_cli(int argc, char** argv) {
     ShowCrashReports();
     
-    auto baseline_tests = get_baseline_test_configs();
-    
     cmd_params params;
     SystemData sys_data;
     setup_initial_environment(&argc, &argv, &params, &sys_data);
+
+    // a parallel sweep isn't comparable with other scores so never submit it
+    bool sweep = !params.parallel_sweep.empty();
+    auto baseline_tests = sweep ? get_parallel_test_configs(params.parallel_sweep)
+                                : get_baseline_test_configs();
+    std::vector<double> gen_tps;
+    std::vector<double> itl_p99;
     
     initialize_llama_backend(params);
     
@@ -547,7 +582,8 @@ int localscore_cli(int argc, char** argv) {
     
     p->print_header(params, sys_data.accelerator, sys_data.runtime, sys_data.sys, model_info);
     
-    if (!run_baseline_tests(baseline_tests, lmodel, params, p.get(), sampler, req_printer)) {
+    if (!run_baseline_tests(baseline_tests, lmodel, params, p.get(), sampler, req_printer,
+                            &gen_tps, &itl_p99)) {
         llama_free_model(lmodel);
         llama_backend_free();
         return 1;
@@ -559,7 +595,13 @@ int localscore_cli(int argc, char** argv) {
     
     llama_backend_free();
     
-    process_and_submit_results(req_payload, params);
+    if (sweep) {
+        if (params.output_format == CONSOLE) {
+            print_parallel_summary(baseline_tests, gen_tps, itl_p99);
+        }
+    } else {
+        process_and_submit_results(req_payload, params);
+    }
     delete req_printer;
     
     return 0;
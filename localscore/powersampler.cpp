@@ -1,4 +1,9 @@
 #include "powersampler.h"
+#include <algorithm>
+#include <dirent.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <cosmo.h>
 
@@ -205,6 +210,123 @@ double ApplePowerSampler::getEnergyConsumed() {
     return mj;
 }
 
+static bool read_ull(const std::string& path, unsigned long long* value) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = fscanf(f, "%llu", value) == 1;
+    fclose(f);
+    return ok;
+}
+
+static std::string read_line(const std::string& path) {
+    char buf[64] = {0};
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return "";
+    }
+    if (!fgets(buf, sizeof(buf), f)) {
+        buf[0] = 0;
+    }
+    fclose(f);
+    buf[strcspn(buf, "\n")] = 0;
+    return buf;
+}
+
+// the package zones include their core and uncore subzones, and psys
+// covers the whole platform, so only package and dram are counted
+static bool is_wanted_rapl_domain(const std::string& name) {
+    return name.rfind("package", 0) == 0 || name == "dram";
+}
+
+RaplPowerSampler::RaplPowerSampler(long sample_length_ms, const char* powercap_dir)
+    : PowerSampler(sample_length_ms), energy_uj_(0) {
+        pthread_mutex_init(&energy_mutex_, nullptr);
+
+        // zones are listed flat, e.g. intel-rapl:0 and intel-rapl:0:1
+        std::vector<std::string> zones;
+        DIR* dir = opendir(powercap_dir);
+        if (dir) {
+            while (struct dirent* ent = readdir(dir)) {
+                if (!strncmp(ent->d_name, "intel-rapl:", 11)) {
+                    zones.push_back(ent->d_name);
+                }
+            }
+            closedir(dir);
+        }
+        std::sort(zones.begin(), zones.end());
+
+        for (const std::string& zone : zones) {
+            std::string path = std::string(powercap_dir) + "/" + zone;
+            RaplDomain domain;
+            domain.name = read_line(path + "/name");
+            if (!is_wanted_rapl_domain(domain.name)) {
+                continue;
+            }
+            domain.energy_path = path + "/energy_uj";
+            if (!read_ull(domain.energy_path, &domain.last_energy_uj)) {
+                continue;  // energy_uj is only readable by root on newer kernels
+            }
+            if (!read_ull(path + "/max_energy_range_uj", &domain.max_energy_uj)) {
+                domain.max_energy_uj = 0;
+            }
+            domains_.push_back(domain);
+        }
+
+        if (domains_.empty()) {
+            pthread_mutex_destroy(&energy_mutex_);
+            throw std::runtime_error("No readable RAPL energy counters");
+        }
+
+        last_sample_time_ = timespec_tomillis(timespec_real());
+        last_sample_mj_ = getEnergyConsumed();
+    }
+
+RaplPowerSampler::~RaplPowerSampler() {
+    if (is_sampling_) {
+        stop();
+    }
+    pthread_mutex_destroy(&energy_mutex_);
+}
+
+power_sample_t RaplPowerSampler::sample() {
+    long long time = timespec_tomillis(timespec_real());
+    double mj = getEnergyConsumed();
+
+    double power = 0;
+    if (time > last_sample_time_) {
+        power = (mj - last_sample_mj_) / (time - last_sample_time_);
+    }
+    last_sample_time_ = time;
+    last_sample_mj_ = mj;
+
+    // convert to power in milliwatts
+    power_sample_t sample = {power * 1e3};
+
+    return sample;
+}
+
+double RaplPowerSampler::getEnergyConsumed() {
+    pthread_mutex_lock(&energy_mutex_);
+    for (RaplDomain& domain : domains_) {
+        unsigned long long uj;
+        if (!read_ull(domain.energy_path, &uj)) {
+            continue;
+        }
+        if (uj >= domain.last_energy_uj) {
+            energy_uj_ += uj - domain.last_energy_uj;
+        } else if (domain.max_energy_uj >= domain.last_energy_uj) {
+            // counter wrapped around to zero
+            energy_uj_ += domain.max_energy_uj - domain.last_energy_uj + uj;
+        }
+        domain.last_energy_uj = uj;
+    }
+    double mj = energy_uj_ / 1e3;
+    pthread_mutex_unlock(&energy_mutex_);
+    return mj;
+}
+
 DummyPowerSampler::DummyPowerSampler(long sample_length_ms)
     : PowerSampler(sample_length_ms) {}
 
@@ -220,6 +342,15 @@ PowerSampler* getPowerSampler(long sample_length_ms, unsigned int main_gpu) {
     if (IsXnu()) {
         return new ApplePowerSampler(sample_length_ms);
     } 
+    if (IsLinux() && !(FLAG_gpu >= 0 && llamafile_has_gpu())) {
+        try {
+            return new RaplPowerSampler(sample_length_ms);
+        } catch (const std::exception& e) {
+            if (FLAG_verbose) {
+                printf("RAPL Power Monitoring failed: %s\n", e.what());
+            }
+        }
+    }
     // else if (llamafile_has_gpu() && FLAG_gpu != LLAMAFILE_GPU_DISABLE) {
         // if (llamafile_has_amd_gpu()) {
         //     // TODO change this to AMD power sampler when it works.
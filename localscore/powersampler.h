@@ -2,6 +2,7 @@
 
 #include <pthread.h>
 #include <time.h>
+#include <string>
 #include <vector>
 #include "nvml.h"
 #include "rsmi.h"
@@ -82,6 +83,32 @@ protected:
     double getEnergyConsumed() override;
 };
 
+// energy counter of one RAPL power zone, e.g. package-0 or dram
+struct RaplDomain {
+    std::string name;
+    std::string energy_path;
+    unsigned long long max_energy_uj;
+    unsigned long long last_energy_uj;
+};
+
+// reads cpu package and dram energy counters from the linux powercap
+// interface. the counters are polled every sample, so wraparound can
+// be detected, and the deltas are accumulated into energy_uj_.
+struct RaplPowerSampler : public PowerSampler {
+    std::vector<RaplDomain> domains_;
+    unsigned long long energy_uj_;
+    long long last_sample_time_;
+    double last_sample_mj_;
+    pthread_mutex_t energy_mutex_;
+
+    RaplPowerSampler(long sample_length_ms, const char* powercap_dir = "/sys/class/powercap");
+    ~RaplPowerSampler() override;
+
+protected:
+    power_sample_t sample() override;
+    double getEnergyConsumed() override;
+};
+
 struct DummyPowerSampler : public PowerSampler {
     DummyPowerSampler(long sample_length_ms);
     ~DummyPowerSampler() override {}
@@ -0,0 +1,132 @@
+#include "powersampler.h"
+
+#include <cosmo.h>
+#include <math.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// tests RaplPowerSampler against a fake /sys/class/powercap tree
+
+static std::string g_root;
+
+static void write_file(const std::string& path, const std::string& content) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        perror(path.c_str());
+        exit(1);
+    }
+    fputs(content.c_str(), f);
+    fclose(f);
+}
+
+static void make_zone(const char* zone, const char* name, unsigned long long energy_uj,
+                      unsigned long long max_energy_uj) {
+    std::string path = g_root + "/" + zone;
+    mkdir(path.c_str(), 0755);
+    write_file(path + "/name", std::string(name) + "\n");
+    write_file(path + "/energy_uj", std::to_string(energy_uj) + "\n");
+    write_file(path + "/max_energy_range_uj", std::to_string(max_energy_uj) + "\n");
+}
+
+static void set_energy(const char* zone, unsigned long long energy_uj) {
+    write_file(g_root + "/" + zone + "/energy_uj", std::to_string(energy_uj) + "\n");
+}
+
+static void make_fake_powercap() {
+    char tmpl[] = "/tmp/powersampler_test.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    g_root = tmpl;
+    mkdir((g_root + "/intel-rapl").c_str(), 0755);  // control type, not a zone
+    make_zone("intel-rapl:0", "package-0", 1000000, 262143328850);
+    make_zone("intel-rapl:0:0", "core", 500000, 262143328850);
+    make_zone("intel-rapl:0:1", "dram", 2000000, 65712999613);
+    make_zone("intel-rapl:1", "package-1", 3000000, 262143328850);
+    make_zone("intel-rapl:2", "psys", 9000000, 262143328850);
+}
+
+static void remove_fake_powercap() {
+    std::string cmd = "rm -rf " + g_root;
+    if (system(cmd.c_str())) {
+        exit(1);
+    }
+}
+
+static void expect_energy(PowerSampler& sampler, double want_mj) {
+    double got_mj = sampler.getEnergyConsumed();
+    if (fabs(got_mj - want_mj) > 1e-3) {
+        fprintf(stderr, "expected %g mJ but got %g mJ\n", want_mj, got_mj);
+        exit(1);
+    }
+}
+
+static void test_domains() {
+    RaplPowerSampler sampler(100, g_root.c_str());
+    if (sampler.domains_.size() != 3 ||  //
+        sampler.domains_[0].name != "package-0" ||  //
+        sampler.domains_[1].name != "dram" ||  //
+        sampler.domains_[2].name != "package-1") {
+        fprintf(stderr, "wrong rapl domains\n");
+        exit(1);
+    }
+}
+
+static void test_energy() {
+    RaplPowerSampler sampler(100, g_root.c_str());
+    expect_energy(sampler, 0);
+
+    // core and psys are ignored since package already counts them
+    set_energy("intel-rapl:0", 1000000 + 40000);
+    set_energy("intel-rapl:0:0", 500000 + 777000);
+    set_energy("intel-rapl:0:1", 2000000 + 2000);
+    set_energy("intel-rapl:1", 3000000 + 3000);
+    set_energy("intel-rapl:2", 9000000 + 999000);
+    expect_energy(sampler, 45);
+
+    // counters wrap around at max_energy_range_uj
+    set_energy("intel-rapl:0", 262143328850 - 1000);
+    expect_energy(sampler, 45 + (262143328850 - 1000 - 1040000) / 1e3);
+    set_energy("intel-rapl:0", 5000);
+    expect_energy(sampler, 45 + (262143328850 - 1040000 + 5000) / 1e3);
+}
+
+static void test_power() {
+    RaplPowerSampler sampler(100, g_root.c_str());
+    PowerSampler& base = sampler;
+    base.sample();
+    usleep(100000);
+    set_energy("intel-rapl:1", 3003000 + 1000000);  // one joule
+    double mw = base.sample().power;
+    if (!(1000 < mw && mw < 11000)) {
+        fprintf(stderr, "one joule over 100ms should be about 10 W, got %g mW\n", mw);
+        exit(1);
+    }
+}
+
+static void test_missing() {
+    try {
+        RaplPowerSampler sampler(100, (g_root + "/nonexistent").c_str());
+    } catch (const std::runtime_error& e) {
+        return;
+    }
+    fprintf(stderr, "expected RaplPowerSampler to fail without counters\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    ShowCrashReports();
+    make_fake_powercap();
+    test_domains();
+    test_energy();
+    test_power();
+    test_missing();
+    remove_fake_powercap();
+    CheckForMemoryLeaks();
+    return 0;
+}
@@ -168,7 +168,10 @@ int console_printer::get_field_width(const std::string & field) {
         return 3;
     }
     if (field == "test") {
-        return 13;
+        return 16;
+    }
+    if (field == "itl p50/p90/p99") {
+        return 20;
     }
 
     int width = std::max((int)field.length(), 10);
@@ -229,6 +232,7 @@ void console_printer::print_header(const cmd_params & params, AcceleratorInfo ac
     fields.emplace_back("pp t/s");
     fields.emplace_back("tg t/s");
     fields.emplace_back("ttft");
+    fields.emplace_back("itl p50/p90/p99");
 
     int total_width = calculate_total_width();
 
@@ -339,10 +343,12 @@ void console_printer::print_test(const test & t) {
         
             value = buf;
         } else if (field == "tokens processed") {
-            int num_generated = t.t_gen + (t.curr_run * t.n_gen);
-            int num_processed = t.t_processed + (t.curr_run * t.n_prompt);
+            int n_gen = t.n_gen * t.n_parallel;
+            int n_prompt = t.n_prompt * t.n_parallel;
+            int num_generated = t.t_gen + (t.curr_run * n_gen);
+            int num_processed = t.t_processed + (t.curr_run * n_prompt);
 
-            snprintf(buf, sizeof(buf), "%d / %d", num_generated + num_processed,  (t.n_gen * t.reps) + (t.n_prompt * t.reps));
+            snprintf(buf, sizeof(buf), "%d / %d", num_generated + num_processed,  (n_gen * t.reps) + (n_prompt * t.reps));
 
             value = buf;
         } else if (field == "pp t/s/watt") {
@@ -362,6 +368,15 @@ void console_printer::print_test(const test & t) {
                 snprintf(buf, sizeof(buf), "%.2f s", ttft / 1e3);
             }
 
+            value = buf;
+        } else if (field == "itl p50/p90/p99") {
+            // latencies are still being appended until the test completes
+            if (t.test_completed && t.n_gen > 0) {
+                snprintf(buf, sizeof(buf), "%.1f/%.1f/%.1f ms", t.itl_ms(.50), t.itl_ms(.90), t.itl_ms(.99));
+            } else {
+                snprintf(buf, sizeof(buf), "-");
+            }
+
             value = buf;
         } else if (field == "power") {
             if (t.monitor_result.power > 0) {
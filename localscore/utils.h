@@ -78,6 +78,18 @@ namespace utils {
         return stdev;
     }
 
+    // nearest-rank percentile, e.g. p=0.99 for p99
+    template<typename T>
+    inline T percentile(std::vector<T> v, double p) {
+        if (v.empty()) {
+            return 0;
+        }
+        size_t rank = static_cast<size_t>(std::ceil(p * v.size()));
+        size_t k = std::min(std::max(rank, (size_t)1), v.size()) - 1;
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    }
+
     inline std::string exec(const char* cmd) {
         std::array<char, 128> buffer;
         std::string result;
@@ -28,6 +28,8 @@ echo "Copying llamafile-specific files..."
 cp "$LLAMAFILE_FILES_DIR/BUILD.mk" .
 cp "$LLAMAFILE_FILES_DIR/README.llamafile" .
 cp "$LLAMAFILE_FILES_DIR/main.cpp" .
+cp "$LLAMAFILE_FILES_DIR/server.cpp" .
+cp "$LLAMAFILE_FILES_DIR/server.h" .
 cp "$LLAMAFILE_FILES_DIR/darts.h" .
 cp "$LLAMAFILE_FILES_DIR/miniz.h" .
 cp "$LLAMAFILE_FILES_DIR/zip.c" .
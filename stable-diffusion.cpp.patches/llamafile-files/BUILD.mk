@@ -29,8 +29,12 @@ $(STABLE_DIFFUSION_CPP_OBJS): private					\
 o/$(MODE)/stable-diffusion.cpp/main:					\
 		o/$(MODE)/stable-diffusion.cpp/main.o			\
 		o/$(MODE)/stable-diffusion.cpp/stable-diffusion.cpp.a	\
+		o/$(MODE)/llamafile/server/server.a			\
 		o/$(MODE)/llama.cpp/llama.cpp.a				\
-		o/$(MODE)/third_party/stb/stb.a
+		o/$(MODE)/llama.cpp/llava/llava.a			\
+		o/$(MODE)/third_party/double-conversion/double-conversion.a \
+		o/$(MODE)/third_party/stb/stb.a				\
+		o/$(MODE)/third_party/sqlite/sqlite3.a
 
 $(STABLE_DIFFUSION_CPP_OBJS): stable-diffusion.cpp/BUILD.mk
 
@@ -10,6 +10,7 @@
 
 // #include "preprocessing.hpp"
 #include "mmdit.hpp"
+#include "server.h"
 #include "stable-diffusion.h"
 #include "t5.hpp"
 
@@ -59,6 +60,7 @@ const char* modes_str[] = {
     "img2img",
     "img2vid",
     "convert",
+    "server",
 };
 
 enum SDMode {
@@ -66,6 +68,7 @@ enum SDMode {
     IMG2IMG,
     IMG2VID,
     CONVERT,
+    SERVER,
     MODE_COUNT
 };
 
@@ -165,7 +168,10 @@ void print_usage(int argc, const char* argv[]) {
     printf("\n");
     printf("arguments:\n");
     printf("  -h, --help                         show this help message and exit\n");
-    printf("  -M, --mode [MODEL]                 run mode (txt2img or img2img or convert, default: txt2img)\n");
+    printf("  -M, --mode [MODEL]                 run mode (txt2img or img2img or convert or server, default: txt2img)\n");
+    printf("  --server                           same as --mode server, which serves /v1/images/generations over http\n");
+    printf("  -l, --listen ADDR:PORT             address and port on which server listens (default: 127.0.0.1:8080)\n");
+    printf("  --workers N                        number of http connections server can handle at once\n");
     printf("  -t, --threads N                    number of threads to use during computation (default: -1).\n");
     printf("                                     If threads <= 0, then threads will be set to the number of CPU physical cores\n");
     printf("  -m, --model [MODEL]                path to model\n");
@@ -228,6 +234,20 @@ void parse_args(int argc, const char** argv, SDParams& params) {
             llamafile_trapping_enabled(+1);
         } else if (arg == "--unsecure") {
             FLAG_unsecure = true;
+        } else if (arg == "--server") {
+            params.mode = SERVER;
+        } else if (arg == "-l" || arg == "--listen") {
+            if (++i >= argc) {
+                invalid_arg = true;
+                break;
+            }
+            FLAG_listen = argv[i];
+        } else if (arg == "--workers") {
+            if (++i >= argc) {
+                invalid_arg = true;
+                break;
+            }
+            FLAG_workers = std::stoi(argv[i]);
         } else if (arg == "--nocompile") {
             FLAG_nocompile = true;
         } else if (arg == "--recompile") {
@@ -531,7 +551,7 @@ void parse_args(int argc, const char** argv, SDParams& params) {
         params.n_threads = cpu_get_num_math();
     }
 
-    if (params.mode != CONVERT && params.mode != IMG2VID && params.prompt.length() == 0) {
+    if (params.mode != CONVERT && params.mode != IMG2VID && params.mode != SERVER && params.prompt.length() == 0) {
         fprintf(stderr, "error: the following arguments are required: prompt\n");
         print_usage(argc, argv);
         exit(1);
@@ -700,7 +720,7 @@ int main(int argc, const char* argv[]) {
         return 1;
     }
 
-    bool vae_decode_only          = true;
+    bool vae_decode_only          = params.mode != SERVER;  // [jart]
     uint8_t* input_image_buffer   = NULL;
     uint8_t* control_image_buffer = NULL;
     if (params.mode == IMG2IMG || params.mode == IMG2VID) {
@@ -776,6 +796,25 @@ int main(int argc, const char* argv[]) {
         return 1;
     }
 
+    // [jart] keep model resident and serve requests until killed
+    if (params.mode == SERVER) {
+        sd_server_params server_params;
+        server_params.negative_prompt      = params.negative_prompt;
+        server_params.clip_skip            = params.clip_skip;
+        server_params.cfg_scale            = params.cfg_scale;
+        server_params.style_ratio          = params.style_ratio;
+        server_params.width                = params.width;
+        server_params.height               = params.height;
+        server_params.sample_method        = params.sample_method;
+        server_params.sample_steps         = params.sample_steps;
+        server_params.strength             = params.strength;
+        server_params.normalize_input      = params.normalize_input;
+        server_params.input_id_images_path = params.input_id_images_path;
+        int rc = sd_server_main(sd_ctx, server_params);
+        free_sd_ctx(sd_ctx);
+        return rc;
+    }
+
     sd_image_t* control_image = NULL;
     if (params.controlnet_path.size() > 0 && params.control_image_path.size() > 0) {
         int c                = 0;
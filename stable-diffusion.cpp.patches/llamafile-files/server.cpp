@@ -0,0 +1,584 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "server.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cosmo.h>
+
+#include "llama.cpp/base64.h"
+#include "llamafile/datauri.h"
+#include "llamafile/json.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/server/client.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/server.h"
+#include "llamafile/server/signals.h"
+#include "llamafile/server/time.h"
+#include "llamafile/server/tokenbucket.h"
+#include "third_party/stb/stb_image.h"
+#include "third_party/stb/stb_image_resize2.h"
+#include "third_party/stb/stb_image_write.h"
+
+// image generation server
+//
+//     sdfile --server -m sd_xl_turbo_1.0.safetensors --listen 0.0.0.0:8080
+//
+// the model is loaded once and stays resident between requests. http
+// connections are handled by the worker threads of llamafiler, which
+// validate requests and put them on a queue. a single generator thread
+// owns the sd_ctx and runs jobs one at a time, since every additional
+// context would need its own copy of the weights. while a job runs, the
+// generator posts sampler progress and finished images to the job, and
+// the worker streams them to its client as server-sent events.
+//
+// sd_ctx can't be interrupted in the middle of sampling, so a client
+// that disconnects stops its job once the current image is finished.
+
+#define MAX_QUEUED_JOBS 32
+#define MAX_IMAGES 8
+#define MAX_STEPS 150
+#define MAX_SIZE 2048
+
+using jt::Json;
+using namespace lf::server;
+
+extern const char* sample_method_str[];
+
+struct Job {
+    std::string prompt;
+    std::string negative_prompt;
+    float cfg_scale;
+    int width;
+    int height;
+    sample_method_t sample_method;
+    int sample_steps;
+    float strength;
+    int64_t seed;
+    int n       = 1;
+    bool stream = false;
+    std::vector<uint8_t> init_image;  // rgb pixels for img2img
+
+    int index = 0;  // image being generated, owned by generator
+    std::atomic_bool canceled{false};
+    std::atomic_int refs{1};
+
+    // guards the fields below, which generator passes to the worker
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond  = PTHREAD_COND_INITIALIZER;
+    std::deque<Json> events;
+    std::string error;
+    bool done = false;
+};
+
+static sd_ctx_t* g_sd_ctx;
+static const sd_server_params* g_params;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond  = PTHREAD_COND_INITIALIZER;
+static std::deque<Job*> g_jobs;
+static bool g_shutdown;
+
+static void unref_job(Job* job) {
+    if (job->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete job;
+}
+
+// called when worker is done with job, or the client is dropped
+static void cleanup_job(void* arg) {
+    Job* job = (Job*)arg;
+    job->canceled = true;
+    unref_job(job);
+}
+
+static void unlock_mutex(void* arg) {
+    pthread_mutex_unlock((pthread_mutex_t*)arg);
+}
+
+static void post_event(Job* job, Json event) {
+    pthread_mutex_lock(&job->lock);
+    job->events.push_back(std::move(event));
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void finish_job(Job* job, const std::string& error) {
+    pthread_mutex_lock(&job->lock);
+    job->error = error;
+    job->done  = true;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+    unref_job(job);
+}
+
+// blocks worker until generator has something to say
+//
+// worker threads may be canceled while waiting here, when the server
+// runs out of workers and drops its oldest client.
+static bool wait_for_events(Job* job, std::deque<Json>* events) {
+    bool done;
+    pthread_mutex_lock(&job->lock);
+    pthread_cleanup_push(unlock_mutex, &job->lock);
+    while (job->events.empty() && !job->done)
+        pthread_cond_wait(&job->cond, &job->lock);
+    events->swap(job->events);
+    done = job->done;
+    pthread_cleanup_pop(true);
+    return done;
+}
+
+static void on_progress(int step, int steps, float time, void* data) {
+    Job* job = (Job*)data;
+    if (!job->stream)
+        return;
+    Json event;
+    event["type"]  = "progress";
+    event["index"] = job->index;
+    event["step"]  = step;
+    event["steps"] = steps;
+    post_event(job, std::move(event));
+}
+
+static void append_png(void* context, void* data, int size) {
+    ((std::string*)context)->append((const char*)data, size);
+}
+
+static std::string encode_base64(const std::string& s) {
+    std::string r;
+    r.resize(base64::required_encode_size(s.size()));
+    r.resize(base64::encode(s.begin(), s.end(), r.begin()) - r.begin());
+    return r;
+}
+
+static void generate(Job* job) {
+    SLOG("generating %d %dx%d image%s with %d steps",
+         job->n, job->width, job->height, job->n == 1 ? "" : "s", job->sample_steps);
+    sd_set_progress_callback(on_progress, job);
+    std::string error;
+    for (int i = 0; i < job->n && !job->canceled; ++i) {
+        job->index   = i;
+        int64_t seed = job->seed + i;
+        sd_image_t* image;
+        if (job->init_image.empty()) {
+            image = txt2img(g_sd_ctx,
+                            job->prompt.c_str(),
+                            job->negative_prompt.c_str(),
+                            g_params->clip_skip,
+                            job->cfg_scale,
+                            job->width,
+                            job->height,
+                            job->sample_method,
+                            job->sample_steps,
+                            seed,
+                            1,
+                            NULL,
+                            0.f,
+                            g_params->style_ratio,
+                            g_params->normalize_input,
+                            g_params->input_id_images_path.c_str());
+        } else {
+            sd_image_t input_image = {(uint32_t)job->width,
+                                      (uint32_t)job->height,
+                                      3,
+                                      job->init_image.data()};
+            image = img2img(g_sd_ctx,
+                            input_image,
+                            job->prompt.c_str(),
+                            job->negative_prompt.c_str(),
+                            g_params->clip_skip,
+                            job->cfg_scale,
+                            job->width,
+                            job->height,
+                            job->sample_method,
+                            job->sample_steps,
+                            job->strength,
+                            seed,
+                            1,
+                            NULL,
+                            0.f,
+                            g_params->style_ratio,
+                            g_params->normalize_input,
+                            g_params->input_id_images_path.c_str());
+        }
+        if (!image || !image->data) {
+            free(image);
+            error = "image generation failed";
+            break;
+        }
+        std::string png;
+        int ok = stbi_write_png_to_func(append_png, &png, image->width, image->height,
+                                        image->channel, image->data, 0);
+        free(image->data);
+        free(image);
+        if (!ok) {
+            error = "png encoding failed";
+            break;
+        }
+        Json event;
+        event["type"]     = "image";
+        event["index"]    = i;
+        event["seed"]     = (long)seed;
+        event["b64_json"] = encode_base64(png);
+        post_event(job, std::move(event));
+    }
+    sd_set_progress_callback(nullptr, nullptr);
+    finish_job(job, error);
+}
+
+static void* generator(void* arg) {
+    set_thread_name("generator");
+    for (;;) {
+        pthread_mutex_lock(&g_lock);
+        while (g_jobs.empty() && !g_shutdown)
+            pthread_cond_wait(&g_cond, &g_lock);
+        if (g_jobs.empty()) {
+            pthread_mutex_unlock(&g_lock);
+            break;
+        }
+        Job* job = g_jobs.front();
+        g_jobs.pop_front();
+        bool shutdown = g_shutdown;
+        pthread_mutex_unlock(&g_lock);
+        if (shutdown) {
+            finish_job(job, "server is shutting down");
+        } else {
+            generate(job);
+        }
+    }
+    return nullptr;
+}
+
+static bool load_init_image(Client* client, Job* job, const std::string& uri) {
+    if (uri.compare(0, 5, "data:"))
+        return client->send_error(400, "image must be a data uri");
+    DataUri data;
+    if (data.parse(std::string_view(uri).substr(5)) == std::string_view::npos)
+        return client->send_error(400, "image data uri is malformed");
+    std::string bytes;
+    try {
+        bytes = data.decode();
+    } catch (const base64_error& e) {
+        return client->send_error(400, "image data uri has bad base64");
+    }
+    int width, height, channels;
+    uint8_t* pixels = stbi_load_from_memory((const uint8_t*)bytes.data(), bytes.size(),
+                                            &width, &height, &channels, 3);
+    if (!pixels)
+        return client->send_error(400, "image couldn't be decoded");
+    job->init_image.resize((size_t)job->width * job->height * 3);
+    if (width == job->width && height == job->height) {
+        memcpy(job->init_image.data(), pixels, job->init_image.size());
+    } else {
+        stbir_resize(pixels, width, height, 0,
+                     job->init_image.data(), job->width, job->height, 0,
+                     STBIR_RGB, STBIR_TYPE_UINT8_SRGB, STBIR_EDGE_CLAMP,
+                     STBIR_FILTER_BOX);
+    }
+    stbi_image_free(pixels);
+    return true;
+}
+
+static bool get_job_params(Client* client, Job* job) {
+    // must be json post request
+    if (client->msg_.method != kHttpPost)
+        return client->send_error(405);
+    const auto& type = client->msg_.headers[kHttpContentType];
+    if (!type.a || !IsMimeType(client->ibuf_.p + type.a, type.b - type.a, "application/json"))
+        return client->send_error(501, "Content Type Not Implemented");
+    if (!client->read_payload())
+        return false;
+    auto [status, json] = Json::parse(std::string(client->payload_));
+    if (status != Json::success)
+        return client->send_error(400, Json::StatusToString(status));
+    if (!json.isObject())
+        return client->send_error(400, "JSON body must be an object");
+
+    // prompt: string
+    if (!json["prompt"].isString())
+        return client->send_error(400, "JSON missing prompt string");
+    job->prompt = json["prompt"].getString();
+
+    // negative_prompt: string|null
+    job->negative_prompt = g_params->negative_prompt;
+    Json& negative_prompt = json["negative_prompt"];
+    if (!negative_prompt.isNull()) {
+        if (!negative_prompt.isString())
+            return client->send_error(400, "negative_prompt field must be string");
+        job->negative_prompt = negative_prompt.getString();
+    }
+
+    // n: integer|null
+    Json& n = json["n"];
+    if (!n.isNull()) {
+        if (!n.isLong())
+            return client->send_error(400, "n field must be integer");
+        if (n.getLong() < 1 || n.getLong() > MAX_IMAGES)
+            return client->send_error(400, "n field must be between 1 and 8");
+        job->n = n.getLong();
+    }
+
+    // size: string|null
+    //
+    // Formatted as WIDTHxHEIGHT, e.g. "512x512". Both dimensions must
+    // be multiples of 64.
+    job->width  = g_params->width;
+    job->height = g_params->height;
+    Json& size  = json["size"];
+    if (!size.isNull()) {
+        int width, height;
+        char junk;
+        if (!size.isString() ||
+            sscanf(size.getString().c_str(), "%dx%d%c", &width, &height, &junk) != 2)
+            return client->send_error(400, "size field must be string like 512x512");
+        if (width <= 0 || width > MAX_SIZE || width % 64 ||  //
+            height <= 0 || height > MAX_SIZE || height % 64)
+            return client->send_error(400, "size must be multiples of 64 no larger than 2048");
+        job->width  = width;
+        job->height = height;
+    }
+
+    // steps: integer|null
+    job->sample_steps = g_params->sample_steps;
+    Json& steps       = json["steps"];
+    if (!steps.isNull()) {
+        if (!steps.isLong())
+            return client->send_error(400, "steps field must be integer");
+        if (steps.getLong() < 1 || steps.getLong() > MAX_STEPS)
+            return client->send_error(400, "steps field must be between 1 and 150");
+        job->sample_steps = steps.getLong();
+    }
+
+    // cfg_scale: number|null
+    job->cfg_scale  = g_params->cfg_scale;
+    Json& cfg_scale = json["cfg_scale"];
+    if (!cfg_scale.isNull()) {
+        if (!cfg_scale.isNumber())
+            return client->send_error(400, "cfg_scale field must be number");
+        job->cfg_scale = cfg_scale.getNumber();
+    }
+
+    // sample_method: string|null
+    job->sample_method  = g_params->sample_method;
+    Json& sample_method = json["sample_method"];
+    if (!sample_method.isNull()) {
+        int found = -1;
+        if (sample_method.isString())
+            for (int m = 0; m < N_SAMPLE_METHODS; m++)
+                if (sample_method.getString() == sample_method_str[m])
+                    found = m;
+        if (found == -1)
+            return client->send_error(400, "sample_method field is unknown");
+        job->sample_method = (sample_method_t)found;
+    }
+
+    // seed: integer|null
+    //
+    // Image i of n is generated with seed + i. If this is not
+    // specified, a random seed is chosen.
+    job->seed  = _rand64() & INT32_MAX;
+    Json& seed = json["seed"];
+    if (!seed.isNull()) {
+        if (!seed.isLong())
+            return client->send_error(400, "seed field must be integer");
+        job->seed = seed.getLong();
+    }
+
+    // strength: number|null
+    job->strength  = g_params->strength;
+    Json& strength = json["strength"];
+    if (!strength.isNull()) {
+        if (!strength.isNumber())
+            return client->send_error(400, "strength field must be number");
+        if (!(0 <= strength.getNumber() && strength.getNumber() <= 1))
+            return client->send_error(400, "strength field must be between 0 and 1");
+        job->strength = strength.getNumber();
+    }
+
+    // image: string|null
+    //
+    // Data uri of image to use as starting point, i.e. img2img. It'll
+    // be resized to the requested size.
+    Json& image = json["image"];
+    if (!image.isNull()) {
+        if (!image.isString())
+            return client->send_error(400, "image field must be string");
+        if (!load_init_image(client, job, image.getString()))
+            return false;
+    }
+
+    // response_format: string|null
+    Json& response_format = json["response_format"];
+    if (!response_format.isNull())
+        if (!response_format.isString() || response_format.getString() != "b64_json")
+            return client->send_error(400, "response_format must be b64_json if specified");
+
+    // stream: bool|null
+    //
+    // If this field is true, then progress of the sampler along with
+    // each image is sent as soon as it's available, and the stream is
+    // terminated by a data: [DONE] message.
+    Json& stream = json["stream"];
+    if (!stream.isNull()) {
+        if (!stream.isBool())
+            return client->send_error(400, "stream field must be boolean");
+        job->stream = stream.getBool();
+    }
+
+    return true;
+}
+
+static std::string make_event(const Json& json) {
+    std::string s = "data: ";
+    s += json.toString();
+    s += "\n\n";
+    return s;
+}
+
+static bool on_generations(Client* client) {
+    Job* job = new Job;
+    client->defer_cleanup(cleanup_job, job);
+    if (!get_job_params(client, job))
+        return false;
+
+    // hand job over to generator thread
+    pthread_mutex_lock(&g_lock);
+    int position = g_jobs.size();
+    if (position < MAX_QUEUED_JOBS) {
+        ++job->refs;
+        g_jobs.push_back(job);
+        pthread_cond_signal(&g_cond);
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (position >= MAX_QUEUED_JOBS)
+        return client->send_error(503, "too many queued requests");
+
+    // initialize response
+    if (job->stream) {
+        char* p = client->append_http_response_message(client->obuf_.p, 200);
+        p       = stpcpy(p, "Content-Type: text/event-stream\r\n");
+        if (!client->send_response_start(client->obuf_.p, p))
+            return false;
+        Json queued;
+        queued["type"]     = "queued";
+        queued["position"] = position;
+        if (!client->send_response_chunk(make_event(queued)))
+            return false;
+    }
+
+    // relay events from generator
+    Json response;
+    int images = 0;
+    std::deque<Json> events;
+    for (bool done = false; !done;) {
+        done = wait_for_events(job, &events);
+        for (Json& event : events) {
+            if (job->stream) {
+                if (!client->send_response_chunk(make_event(event)))
+                    return false;
+            } else if (event["type"].getString() == "image") {
+                Json& data       = response["data"][images++];
+                data["seed"]     = event["seed"];
+                data["b64_json"] = std::move(event["b64_json"]);
+            }
+        }
+        events.clear();
+    }
+
+    // finalize response
+    if (job->stream) {
+        if (!job->error.empty()) {
+            Json error;
+            error["type"]    = "error";
+            error["message"] = job->error;
+            if (!client->send_response_chunk(make_event(error)))
+                return false;
+        }
+        if (!client->send_response_chunk("data: [DONE]\n\n"))
+            return false;
+        return client->send_response_finish();
+    } else {
+        if (!job->error.empty())
+            return client->send_error(500, job->error.c_str());
+        response["created"] = timespec_real().tv_sec;
+        char* p             = client->append_http_response_message(client->obuf_.p, 200);
+        p                   = stpcpy(p, "Content-Type: application/json\r\n");
+        std::string content = response.toString();
+        content += '\n';
+        return client->send_response(client->obuf_.p, p, content);
+    }
+}
+
+static const Endpoint kEndpoints[] = {
+    {"v1/images/generations", on_generations},
+    {nullptr, nullptr},
+};
+
+int sd_server_main(sd_ctx_t* sd_ctx, const sd_server_params& params) {
+    g_sd_ctx = sd_ctx;
+    g_params = &params;
+    signal(SIGPIPE, SIG_IGN);
+    time_init();
+    tokenbucket_init();
+
+    // generator must be created before workers pledge()
+    pthread_t th;
+    if ((errno = pthread_create(&th, 0, generator, 0))) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    // create server
+    if (FLAG_workers <= 0)
+        FLAG_workers = __get_cpu_count() + 4;
+    if (FLAG_workers <= 0)
+        FLAG_workers = 16;
+    set_thread_name("server");
+    g_server = new Server(create_listening_socket(FLAG_listen, 0, 0), nullptr, nullptr);
+    g_server->endpoints_ = kEndpoints;
+    for (int i = 0; i < FLAG_workers; ++i)
+        npassert(!g_server->spawn());
+
+    // run server
+    signals_init();
+    g_server->run();
+    signals_destroy();
+
+    // shutdown server
+    SLOG("shutdown");
+    g_server->shutdown();
+    g_server->close();
+    delete g_server;
+
+    // wait for generator to finish current image
+    pthread_mutex_lock(&g_lock);
+    g_shutdown = true;
+    pthread_cond_signal(&g_cond);
+    pthread_mutex_unlock(&g_lock);
+    pthread_join(th, 0);
+    tokenbucket_destroy();
+    time_destroy();
+    SLOG("exit");
+    return 0;
+}
@@ -0,0 +1,38 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+
+#include "stable-diffusion.h"
+
+// defaults for http requests, which come from the command line
+struct sd_server_params {
+    std::string negative_prompt;
+    int clip_skip                 = -1;
+    float cfg_scale               = 7.0f;
+    float style_ratio             = 20.f;
+    int width                     = 512;
+    int height                    = 512;
+    sample_method_t sample_method = EULER_A;
+    int sample_steps              = 20;
+    float strength                = 0.75f;
+    bool normalize_input          = false;
+    std::string input_id_images_path;
+};
+
+int sd_server_main(sd_ctx_t* sd_ctx, const sd_server_params& params);
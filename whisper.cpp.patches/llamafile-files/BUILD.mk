@@ -48,7 +48,13 @@ o/$(MODE)/whisper.cpp/mic2raw:				\
 		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 
+o/$(MODE)/whisper.cpp/mel_test:			\
+		o/$(MODE)/whisper.cpp/mel_test.o	\
+		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 o/$(MODE)/whisper.cpp/miniaudio.o: private COPTS += -O3
+o/$(MODE)/whisper.cpp/whisper-mel-cpu.o: private COPTS += -O3
 
 $(WHISPER_CPP_OBJS): whisper.cpp/BUILD.mk
 
@@ -58,3 +64,4 @@ o/$(MODE)/whisper.cpp:					\
 		o/$(MODE)/whisper.cpp/stream		\
 		o/$(MODE)/whisper.cpp/mic2txt		\
 		o/$(MODE)/whisper.cpp/mic2raw		\
+		o/$(MODE)/whisper.cpp/mel_test.runs	\
@@ -0,0 +1,464 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "slurp.h"
+#include "whisper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <strings.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#include "llama.cpp/cores.h"
+#include "llama.cpp/json.h"
+#include "llamafile/llamafile.h"
+
+// batch transcription of many audio files
+//
+//     whisperfile --batch -m model.bin -j 4 -osrt recordings/
+//
+// the model is loaded once. audio files are decoded by a pool of
+// producer threads, which feed a bounded queue, so decoding the next
+// files overlaps with transcribing the current ones. each consumer
+// thread owns a whisper_state, so several files are transcribed at the
+// same time while sharing the model weights. the threads are divided
+// between the consumers so cores aren't oversubscribed.
+
+using json = nlohmann::ordered_json;
+
+struct batch_params {
+    std::string model;
+    std::string language = "en";
+    std::string output_dir;
+    std::vector<std::string> inputs;
+    int n_threads = std::min(16, cpu_get_num_math());
+    int n_jobs = 2;
+    int n_decoders = 2;
+    bool translate = false;
+    bool flash_attn = false;
+    bool output_txt = false;
+    bool output_srt = false;
+    bool output_jsn = false;
+};
+
+struct batch_audio {
+    size_t index;
+    std::vector<float> pcmf32;
+    double decode_seconds;
+};
+
+struct batch_stats {
+    std::mutex mu;
+    int done = 0;
+    int failed = 0;
+    double audio_seconds = 0;
+    double decode_seconds = 0;
+    double transcribe_seconds = 0;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool is_audio_file(const std::string & path) {
+    static const char * const kExtensions[] = {".wav", ".mp3", ".flac", ".ogg"};
+    for (const char * ext : kExtensions) {
+        size_t n = strlen(ext);
+        if (path.size() > n && !strcasecmp(path.c_str() + path.size() - n, ext))
+            return true;
+    }
+    return false;
+}
+
+static void find_audio_files(const std::string & path, std::vector<std::string> & out) {
+    struct stat st;
+    if (stat(path.c_str(), &st)) {
+        perror(path.c_str());
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        out.push_back(path);
+        return;
+    }
+    DIR * dir;
+    if (!(dir = opendir(path.c_str()))) {
+        perror(path.c_str());
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent * ent = readdir(dir))
+        if (ent->d_name[0] != '.')
+            names.push_back(ent->d_name);
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string & name : names) {
+        std::string child = path.back() == '/' ? path + name : path + '/' + name;
+        if (!stat(child.c_str(), &st) && (S_ISDIR(st.st_mode) || is_audio_file(child)))
+            find_audio_files(child, out);
+    }
+}
+
+static bool read_file_list(const char * path, std::vector<std::string> & out) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        perror(path);
+        return false;
+    }
+    std::string line;
+    while (std::getline(ifs, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+            line.pop_back();
+        if (!line.empty() && line[0] != '#')
+            out.push_back(line);
+    }
+    return true;
+}
+
+static void print_usage(const char * prog) {
+    fprintf(stderr,
+            "usage: %s --batch -m MODEL [options] PATH...\n"
+            "\n"
+            "transcribes audio files, and audio files in directories, writing\n"
+            "a transcript next to each input file\n"
+            "\n"
+            "options:\n"
+            "  -m FNAME,  --model FNAME      whisper model weights\n"
+            "  -L FNAME,  --file-list FNAME  read more input paths from file\n"
+            "  -o DIR,    --output-dir DIR   write transcripts to DIR instead\n"
+            "  -j N,      --jobs N           files transcribed at once [2]\n"
+            "  -dj N,     --decoders N       audio decoding threads [2]\n"
+            "  -t N,      --threads N        threads shared by all jobs\n"
+            "  -l LANG,   --language LANG    spoken language ('auto' to detect) [en]\n"
+            "  -tr,       --translate        translate into english\n"
+            "  -fa,       --flash-attn       use flash attention\n"
+            "  -otxt,     --output-txt       write .txt transcript (default)\n"
+            "  -osrt,     --output-srt       write .srt subtitles\n"
+            "  -oj,       --output-json      write .json with segments\n"
+            "  --gpu GPU                     gpu to use, e.g. auto, nvidia, amd\n",
+            prog);
+}
+
+static bool parse_args(int argc, char ** argv, batch_params & params) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--batch" || arg == "--cli") {
+        } else if (arg == "--log-disable") {
+            FLAG_log_disable = true;
+        } else if ((arg == "-m" || arg == "--model") && has_value) {
+            params.model = argv[++i];
+        } else if ((arg == "-L" || arg == "--file-list") && has_value) {
+            if (!read_file_list(argv[++i], params.inputs))
+                return false;
+        } else if ((arg == "-o" || arg == "--output-dir") && has_value) {
+            params.output_dir = argv[++i];
+        } else if ((arg == "-j" || arg == "--jobs") && has_value) {
+            params.n_jobs = std::max(1, atoi(argv[++i]));
+        } else if ((arg == "-dj" || arg == "--decoders") && has_value) {
+            params.n_decoders = std::max(1, atoi(argv[++i]));
+        } else if ((arg == "-t" || arg == "--threads") && has_value) {
+            params.n_threads = std::max(1, atoi(argv[++i]));
+        } else if ((arg == "-l" || arg == "--language") && has_value) {
+            params.language = argv[++i];
+        } else if (arg == "-tr" || arg == "--translate") {
+            params.translate = true;
+        } else if (arg == "-fa" || arg == "--flash-attn") {
+            params.flash_attn = true;
+        } else if (arg == "-otxt" || arg == "--output-txt") {
+            params.output_txt = true;
+        } else if (arg == "-osrt" || arg == "--output-srt") {
+            params.output_srt = true;
+        } else if (arg == "-oj" || arg == "--output-json") {
+            params.output_jsn = true;
+        } else if (arg == "-ng" || arg == "--no-gpu") {
+            FLAG_gpu = LLAMAFILE_GPU_DISABLE;
+        } else if (arg == "--gpu" && has_value) {
+            FLAG_gpu = llamafile_gpu_parse(argv[++i]);
+            if (FLAG_gpu == LLAMAFILE_GPU_ERROR) {
+                fprintf(stderr, "error: invalid --gpu flag value: %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg[0] == '-' && arg.size() > 1) {
+            fprintf(stderr, "error: unknown or incomplete argument: %s\n", arg.c_str());
+            return false;
+        } else {
+            params.inputs.push_back(arg);
+        }
+    }
+    FLAGS_READY = true;
+    if (params.model.empty()) {
+        fprintf(stderr, "error: missing -m MODEL\n");
+        return false;
+    }
+    if (params.inputs.empty()) {
+        fprintf(stderr, "error: no audio files or directories specified\n");
+        return false;
+    }
+    if (!params.output_txt && !params.output_srt && !params.output_jsn)
+        params.output_txt = true;
+    return true;
+}
+
+static std::string srt_timestamp(int64_t t) {
+    int64_t ms = t * 10;
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%02d:%02d:%02d,%03d", (int)(ms / 3600000),
+             (int)(ms / 60000 % 60), (int)(ms / 1000 % 60), (int)(ms % 1000));
+    return buf;
+}
+
+static std::string output_path(const batch_params & params, const std::string & input,
+                               const char * ext) {
+    std::string path;
+    if (params.output_dir.empty()) {
+        path = input;
+    } else {
+        size_t slash = input.rfind('/');
+        path = params.output_dir;
+        path += '/';
+        path += slash == std::string::npos ? input : input.substr(slash + 1);
+    }
+    return path + ext;
+}
+
+static bool write_file(const std::string & path, const std::string & content) {
+    FILE * f = fopen(path.c_str(), "wb");
+    if (!f) {
+        perror(path.c_str());
+        return false;
+    }
+    bool ok = fwrite(content.data(), 1, content.size(), f) == content.size();
+    if (fclose(f) || !ok) {
+        perror(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool write_outputs(const batch_params & params, const std::string & input,
+                          whisper_state * state, double duration) {
+    bool ok = true;
+    int n_segments = whisper_full_n_segments_from_state(state);
+    if (params.output_txt) {
+        std::string txt;
+        for (int i = 0; i < n_segments; ++i) {
+            txt += whisper_full_get_segment_text_from_state(state, i);
+            txt += '\n';
+        }
+        ok &= write_file(output_path(params, input, ".txt"), txt);
+    }
+    if (params.output_srt) {
+        std::string srt;
+        for (int i = 0; i < n_segments; ++i) {
+            srt += std::to_string(i + 1);
+            srt += '\n';
+            srt += srt_timestamp(whisper_full_get_segment_t0_from_state(state, i));
+            srt += " --> ";
+            srt += srt_timestamp(whisper_full_get_segment_t1_from_state(state, i));
+            srt += '\n';
+            srt += whisper_full_get_segment_text_from_state(state, i);
+            srt += "\n\n";
+        }
+        ok &= write_file(output_path(params, input, ".srt"), srt);
+    }
+    if (params.output_jsn) {
+        json segments = json::array();
+        std::string text;
+        for (int i = 0; i < n_segments; ++i) {
+            const char * segment = whisper_full_get_segment_text_from_state(state, i);
+            text += segment;
+            segments.push_back({
+                {"start", whisper_full_get_segment_t0_from_state(state, i) / 100.},
+                {"end", whisper_full_get_segment_t1_from_state(state, i) / 100.},
+                {"text", segment},
+            });
+        }
+        json result = {
+            {"file", input},
+            {"language", whisper_lang_str(whisper_full_lang_id_from_state(state))},
+            {"duration", duration},
+            {"text", text},
+            {"segments", segments},
+        };
+        ok &= write_file(output_path(params, input, ".json"), result.dump(2) + '\n');
+    }
+    return ok;
+}
+
+int whisper_batch_main(int argc, char ** argv) {
+    batch_params params;
+    if (!parse_args(argc, argv, params)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // find audio files
+    std::vector<std::string> files;
+    for (const std::string & input : params.inputs)
+        find_audio_files(input, files);
+    if (files.empty()) {
+        fprintf(stderr, "error: no audio files found\n");
+        return 1;
+    }
+    params.n_jobs = std::min(params.n_jobs, (int)files.size());
+    params.n_decoders = std::min(params.n_decoders, (int)files.size());
+    int threads_per_job = std::max(1, params.n_threads / params.n_jobs);
+
+    // load model once
+    auto start = std::chrono::steady_clock::now();
+    whisper_context_params cparams = whisper_context_default_params();
+    cparams.flash_attn = params.flash_attn;
+    whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+    if (!ctx) {
+        fprintf(stderr, "%s: failed to load model\n", params.model.c_str());
+        return 2;
+    }
+    if (params.language != "auto" && whisper_lang_id(params.language.c_str()) == -1) {
+        fprintf(stderr, "error: unknown language '%s'\n", params.language.c_str());
+        whisper_free(ctx);
+        return 1;
+    }
+    std::vector<whisper_state *> states;
+    for (int i = 0; i < params.n_jobs; ++i) {
+        whisper_state * state = whisper_init_state(ctx);
+        if (!state) {
+            fprintf(stderr, "error: failed to initialize whisper state\n");
+            for (whisper_state * state : states)
+                whisper_free_state(state);
+            whisper_free(ctx);
+            return 2;
+        }
+        states.push_back(state);
+    }
+    fprintf(stderr, "transcribing %zu files with %d jobs of %d threads (loaded in %.1fs)\n",
+            files.size(), params.n_jobs, threads_per_job, seconds_since(start));
+
+    // decoded audio waiting to be transcribed
+    //
+    // the queue is bounded so that decoders running ahead of inference
+    // don't hold an entire archive of pcm samples in memory.
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<batch_audio> queue;
+    size_t max_queue = params.n_jobs * 2;
+    int decoders_running = params.n_decoders;
+    std::atomic<size_t> next_file(0);
+    batch_stats stats;
+
+    auto decode = [&]() {
+        for (size_t i; (i = next_file++) < files.size();) {
+            auto t0 = std::chrono::steady_clock::now();
+            batch_audio audio = {i};
+            std::vector<std::vector<float>> pcmf32s;
+            if (!slurp_audio_file(files[i].c_str(), audio.pcmf32, pcmf32s, false)) {
+                std::lock_guard<std::mutex> lock(stats.mu);
+                ++stats.failed;
+                continue;
+            }
+            audio.decode_seconds = seconds_since(t0);
+            std::unique_lock<std::mutex> lock(mu);
+            cv.wait(lock, [&] { return queue.size() < max_queue; });
+            queue.push_back(std::move(audio));
+            cv.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(mu);
+        --decoders_running;
+        cv.notify_all();
+    };
+
+    auto transcribe = [&](whisper_state * state) {
+        for (;;) {
+            batch_audio audio;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                cv.wait(lock, [&] { return !queue.empty() || !decoders_running; });
+                if (queue.empty())
+                    break;
+                audio = std::move(queue.front());
+                queue.pop_front();
+                cv.notify_all();
+            }
+            const std::string & file = files[audio.index];
+            double duration = (double)audio.pcmf32.size() / WHISPER_SAMPLE_RATE;
+            whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+            wparams.n_threads = threads_per_job;
+            wparams.language = params.language.c_str();
+            wparams.translate = params.translate;
+            wparams.print_progress = false;
+            wparams.print_realtime = false;
+            wparams.print_timestamps = false;
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = !whisper_full_with_state(ctx, state, wparams, audio.pcmf32.data(),
+                                               audio.pcmf32.size());
+            double elapsed = seconds_since(t0);
+            if (!ok)
+                fprintf(stderr, "%s: failed to transcribe audio\n", file.c_str());
+            else
+                ok = write_outputs(params, file, state, duration);
+            std::lock_guard<std::mutex> lock(stats.mu);
+            if (ok) {
+                ++stats.done;
+                stats.audio_seconds += duration;
+                stats.decode_seconds += audio.decode_seconds;
+                stats.transcribe_seconds += elapsed;
+            } else {
+                ++stats.failed;
+            }
+            fprintf(stderr, "[%d/%zu] %s: %.1fs of audio in %.1fs (rtf %.3f)\n",
+                    stats.done + stats.failed, files.size(), file.c_str(), duration, elapsed,
+                    duration ? elapsed / duration : 0.);
+        }
+    };
+
+    // run pipeline
+    start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < params.n_decoders; ++i)
+        threads.emplace_back(decode);
+    for (int i = 0; i < params.n_jobs; ++i)
+        threads.emplace_back(transcribe, states[i]);
+    for (std::thread & thread : threads)
+        thread.join();
+    double wall = seconds_since(start);
+
+    // print summary
+    fprintf(stderr,
+            "\n"
+            "%d files transcribed, %d failed\n"
+            "%.1f seconds of audio in %.1f seconds (%.1fx realtime)\n"
+            "%.1f seconds spent decoding, %.1f seconds transcribing\n",
+            stats.done, stats.failed, stats.audio_seconds, wall,
+            wall ? stats.audio_seconds / wall : 0., stats.decode_seconds,
+            stats.transcribe_seconds);
+
+    for (whisper_state * state : states)
+        whisper_free_state(state);
+    whisper_free(ctx);
+    return stats.failed ? 1 : 0;
+}
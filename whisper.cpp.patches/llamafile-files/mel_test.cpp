@@ -0,0 +1,252 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "whisper-mel-cpu.hpp"
+#include "whisper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cosmo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+#include "llama.cpp/ggml-backend.h"
+#include "llama.cpp/ggml.h"
+
+// checks fast cpu mel spectrogram against upstream's scalar algorithm
+//
+// the reference below is the fft and filterbank code whisper.cpp used
+// before we replaced it. afterwards we report how quickly both of them
+// are able to process an hour of audio.
+
+#define SIN_COS_N_COUNT WHISPER_N_FFT
+
+float g_sin_vals[SIN_COS_N_COUNT];
+float g_cos_vals[SIN_COS_N_COUNT];
+float g_hann[WHISPER_N_FFT];
+
+double now() {
+    return timespec_tonanos(timespec_real()) * 1e-9;
+}
+
+void dft(const float *in, int N, float *out) {
+    const int sin_cos_step = SIN_COS_N_COUNT / N;
+    for (int k = 0; k < N; k++) {
+        float re = 0;
+        float im = 0;
+        for (int n = 0; n < N; n++) {
+            int idx = (k * n * sin_cos_step) % (SIN_COS_N_COUNT);
+            re += in[n] * g_cos_vals[idx];
+            im -= in[n] * g_sin_vals[idx];
+        }
+        out[k * 2 + 0] = re;
+        out[k * 2 + 1] = im;
+    }
+}
+
+void fft(float *in, int N, float *out) {
+    if (N == 1) {
+        out[0] = in[0];
+        out[1] = 0;
+        return;
+    }
+    const int half_N = N / 2;
+    if (N - half_N * 2 == 1) {
+        dft(in, N, out);
+        return;
+    }
+    float *even = in + N;
+    for (int i = 0; i < half_N; ++i)
+        even[i] = in[2 * i];
+    float *even_fft = out + 2 * N;
+    fft(even, half_N, even_fft);
+    float *odd = even;
+    for (int i = 0; i < half_N; ++i)
+        odd[i] = in[2 * i + 1];
+    float *odd_fft = even_fft + N;
+    fft(odd, half_N, odd_fft);
+    const int sin_cos_step = SIN_COS_N_COUNT / N;
+    for (int k = 0; k < half_N; k++) {
+        int idx = k * sin_cos_step;
+        float re = g_cos_vals[idx];
+        float im = -g_sin_vals[idx];
+        float re_odd = odd_fft[2 * k + 0];
+        float im_odd = odd_fft[2 * k + 1];
+        out[2 * k + 0] = even_fft[2 * k + 0] + re * re_odd - im * im_odd;
+        out[2 * k + 1] = even_fft[2 * k + 1] + re * im_odd + im * re_odd;
+        out[2 * (k + half_N) + 0] = even_fft[2 * k + 0] - re * re_odd + im * im_odd;
+        out[2 * (k + half_N) + 1] = even_fft[2 * k + 1] - re * im_odd - im * re_odd;
+    }
+}
+
+std::vector<float> reference_mel(const std::vector<float> &samples,
+                                 const whisper_filters &filters) {
+    const int stage_1_pad = WHISPER_SAMPLE_RATE * 30;
+    const int stage_2_pad = WHISPER_N_FFT / 2;
+    const int frame_size = WHISPER_N_FFT;
+    const int frame_step = WHISPER_HOP_LENGTH;
+    const int n_fft = filters.n_fft;
+    int n_samples = samples.size();
+    std::vector<float> padded(n_samples + stage_1_pad + stage_2_pad * 2);
+    std::copy(samples.begin(), samples.end(), padded.begin() + stage_2_pad);
+    std::reverse_copy(samples.begin() + 1, samples.begin() + 1 + stage_2_pad, padded.begin());
+    int n_len = (padded.size() - frame_size) / frame_step;
+    std::vector<float> mel((size_t)n_len * filters.n_mel);
+    std::vector<float> fft_in(frame_size * 2, 0.0);
+    std::vector<float> fft_out(frame_size * 2 * 2 * 2);
+    n_samples += stage_2_pad;
+    int i = 0;
+    for (; i < std::min(n_samples / frame_step + 1, n_len); ++i) {
+        const int offset = i * frame_step;
+        for (int j = 0; j < std::min(frame_size, n_samples - offset); j++)
+            fft_in[j] = g_hann[j] * padded[offset + j];
+        if (n_samples - offset < frame_size)
+            std::fill(fft_in.begin() + (n_samples - offset), fft_in.end(), 0.0);
+        fft(fft_in.data(), frame_size, fft_out.data());
+        for (int j = 0; j < n_fft; j++)
+            fft_out[j] =
+                fft_out[2 * j + 0] * fft_out[2 * j + 0] + fft_out[2 * j + 1] * fft_out[2 * j + 1];
+        for (int j = 0; j < filters.n_mel; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < n_fft; k++)
+                sum += fft_out[k] * filters.data[j * n_fft + k];
+            mel[(size_t)j * n_len + i] = log10(std::max(sum, 1e-10));
+        }
+    }
+    for (; i < n_len; ++i)
+        for (int j = 0; j < filters.n_mel; j++)
+            mel[(size_t)j * n_len + i] = log10(1e-10);
+    double mmax = *std::max_element(mel.begin(), mel.end()) - 8.0;
+    for (float &x : mel)
+        x = (std::max((double)x, mmax) + 4.0) / 4.0;
+    return mel;
+}
+
+// triangular filters evenly spaced on the mel scale
+whisper_filters make_filters(int n_mel) {
+    whisper_filters filters;
+    filters.n_mel = n_mel;
+    filters.n_fft = 1 + WHISPER_N_FFT / 2;
+    filters.data.resize(n_mel * filters.n_fft);
+    auto hz_to_mel = [](double hz) { return 2595 * log10(1 + hz / 700); };
+    auto mel_to_hz = [](double mel) { return 700 * (pow(10, mel / 2595) - 1); };
+    double top = hz_to_mel(WHISPER_SAMPLE_RATE / 2);
+    for (int j = 0; j < n_mel; ++j) {
+        double lo = mel_to_hz(top * j / (n_mel + 1));
+        double mid = mel_to_hz(top * (j + 1) / (n_mel + 1));
+        double hi = mel_to_hz(top * (j + 2) / (n_mel + 1));
+        for (int k = 0; k < filters.n_fft; ++k) {
+            double hz = (double)k * WHISPER_SAMPLE_RATE / WHISPER_N_FFT;
+            double w = std::max(0., std::min((hz - lo) / (mid - lo), (hi - hz) / (hi - mid)));
+            filters.data[j * filters.n_fft + k] = w * 2 / (hi - lo);
+        }
+    }
+    return filters;
+}
+
+// speech-like test signal with some silence in the middle
+std::vector<float> make_audio(int n) {
+    std::vector<float> samples(n);
+    for (int i = 0; i < n; ++i) {
+        double t = (double)i / WHISPER_SAMPLE_RATE;
+        double env = fmod(t, 7) < 5 ? 0.5 + 0.5 * sin(2 * M_PI * 3 * t) : 0;
+        double f0 = 120 + 40 * sin(2 * M_PI * 0.3 * t);
+        double x = 0;
+        for (int h = 1; h <= 8; ++h)
+            x += sin(2 * M_PI * f0 * h * t) / h;
+        x += ((rand() & 0xffff) / 32768. - 1) * 0.01;
+        samples[i] = 0.2 * env * x;
+    }
+    return samples;
+}
+
+std::vector<float> fast_mel(ggml_backend_t backend, const whisper_filters &filters,
+                            const std::vector<float> &samples, int n_threads) {
+    whisper_mel_calc *calc = whisper_mel_calc_create_cpu(backend, filters);
+    whisper_mel mel = calc->calculate({samples.data(), (int)samples.size()}, n_threads);
+    std::vector<float> data(ggml_nelements(mel.tensor));
+    ggml_backend_tensor_get(mel.tensor, data.data(), 0, ggml_nbytes(mel.tensor));
+    whisper_mel_free(mel);
+    delete calc;
+    return data;
+}
+
+void test_matches_reference(ggml_backend_t backend) {
+    for (int n_mel : {80, 128}) {
+        whisper_filters filters = make_filters(n_mel);
+        for (int n_samples : {201, 1000, 3 * WHISPER_SAMPLE_RATE + 37, 31 * WHISPER_SAMPLE_RATE}) {
+            std::vector<float> samples = make_audio(n_samples);
+            std::vector<float> want = reference_mel(samples, filters);
+            for (int n_threads : {1, 3, 8}) {
+                std::vector<float> got = fast_mel(backend, filters, samples, n_threads);
+                npassert(got.size() == want.size());
+                double worst = 0;
+                for (size_t i = 0; i < got.size(); ++i)
+                    worst = std::max(worst, (double)fabsf(got[i] - want[i]));
+                if (worst > 1e-3) {
+                    fprintf(stderr, "n_mel=%d n_samples=%d n_threads=%d error %g\n", n_mel,
+                            n_samples, n_threads, worst);
+                    exit(1);
+                }
+            }
+        }
+    }
+}
+
+void bench_hour(ggml_backend_t backend) {
+    int n_threads = std::min(8u, std::thread::hardware_concurrency());
+    whisper_filters filters = make_filters(80);
+    std::vector<float> minute = make_audio(60 * WHISPER_SAMPLE_RATE);
+    std::vector<float> hour;
+    for (int i = 0; i < 60; ++i)
+        hour.insert(hour.end(), minute.begin(), minute.end());
+
+    double start = now();
+    reference_mel(minute, filters);
+    double slow = (now() - start) * 60;
+
+    start = now();
+    fast_mel(backend, filters, hour, 1);
+    double fast1 = now() - start;
+
+    start = now();
+    fast_mel(backend, filters, hour, n_threads);
+    double fastn = now() - start;
+
+    printf("mel of one hour of audio\n");
+    printf("upstream       %8.3f s (extrapolated from one minute)\n", slow);
+    printf("fast 1 thread  %8.3f s (%.1fx)\n", fast1, slow / fast1);
+    printf("fast %d threads %8.3f s (%.1fx)\n", n_threads, fastn, slow / fastn);
+}
+
+int main(int argc, char *argv[]) {
+    ShowCrashReports();
+    for (int i = 0; i < SIN_COS_N_COUNT; i++) {
+        double theta = (2 * M_PI * i) / SIN_COS_N_COUNT;
+        g_sin_vals[i] = sinf(theta);
+        g_cos_vals[i] = cosf(theta);
+    }
+    for (int i = 0; i < WHISPER_N_FFT; i++)
+        g_hann[i] = 0.5 * (1.0 - cosf((2.0 * M_PI * i) / WHISPER_N_FFT));
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    test_matches_reference(backend);
+    bench_hour(backend);
+    ggml_backend_free(backend);
+}
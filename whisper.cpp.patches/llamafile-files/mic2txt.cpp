@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <signal.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <ctl/min.h>
@@ -32,13 +33,45 @@
 #include <ctl/vector.h>
 #include <cosmoaudio.h>
 
+// speech to text using microphone
+//
+// by default audio is recorded until ctrl-c is pressed, and then it's
+// transcribed all at once. the -s flag enables streaming mode, where a
+// simple energy based voice activity detector cuts the audio into
+// utterances at pauses in speech. each utterance is transcribed by a
+// worker thread while the microphone keeps recording, and the text of
+// the previous utterance is used as the prompt for the next one.
+
 #define FRAMES_PER_SECOND 30
 #define CHUNK_FRAMES (WHISPER_SAMPLE_RATE / FRAMES_PER_SECOND)
 
+#define VAD_THRESHOLD 3.f // speech is this many times louder than noise
+#define VAD_MIN_ENERGY .002f // rms below this is always silence
+#define VAD_PREROLL_CHUNKS (FRAMES_PER_SECOND * 3 / 10) // keep before speech
+#define VAD_HANGOVER_CHUNKS (FRAMES_PER_SECOND * 7 / 10) // silence ending speech
+#define VAD_MIN_SPEECH_CHUNKS (FRAMES_PER_SECOND / 4) // shorter is a click
+#define MAX_UTTERANCE_SECONDS 20
+#define MAX_PENDING_UTTERANCES 8
+#define MAX_PROMPT_TOKENS 224
+
 const char *g_model;
 volatile sig_atomic_t g_done;
 struct whisper_context *g_ctx;
 struct whisper_context_params g_cparams;
+pthread_t g_model_loader;
+bool g_should_print_color;
+
+// utterances waiting to be transcribed in streaming mode
+//
+// the capture thread fills slots at g_tail and the transcriber reads
+// the slot at g_head without holding the lock. the slot isn't reused
+// until the transcriber is done with it and increments g_head.
+pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+ctl::vector<float> g_pending[MAX_PENDING_UTTERANCES];
+unsigned g_head;
+unsigned g_tail;
+bool g_capture_done;
 
 static void onsig(int sig) {
     g_done = 1;
@@ -53,26 +86,256 @@ static void *load_model(void *arg) {
     return 0;
 }
 
+static void print_result(void) {
+    int n_segments = whisper_full_n_segments(g_ctx);
+    for (int i = 0; i < n_segments; ++i) {
+        int n_tokens = whisper_full_n_tokens(g_ctx, i);
+        for (int j = 0; j < n_tokens; ++j) {
+            const whisper_token id = whisper_full_get_token_id(g_ctx, i, j);
+            if (id >= whisper_token_eot(g_ctx))
+                continue;
+            const char *text = whisper_full_get_token_text(g_ctx, i, j);
+            if (g_should_print_color) {
+                float confidence = whisper_full_get_token_p(g_ctx, i, j);
+                int colorcount = kRedToGreenXterm256.size();
+                int colorindex = powf(confidence, 3) * colorcount;
+                colorindex = ctl::max(0, ctl::min(colorcount - 1, colorindex));
+                fprintf(stderr, "%s", kRedToGreenXterm256[colorindex].c_str());
+                fflush(stderr);
+            }
+            printf("%s", text);
+            fflush(stdout);
+        }
+    }
+    if (g_should_print_color)
+        fprintf(stderr, "\033[0m");
+    printf("\n");
+    fflush(stdout);
+}
+
+static void print_status(const char *status) {
+    if (g_should_print_color) {
+        fprintf(stderr, "\r\033[K%s", status);
+        fflush(stderr);
+    }
+}
+
+static void show_status(const char *status) {
+    pthread_mutex_lock(&g_lock);
+    print_status(status);
+    pthread_mutex_unlock(&g_lock);
+}
+
+static float get_energy(const float *samples, int n) {
+    float sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += samples[i] * samples[i];
+    return sqrtf(sum / n);
+}
+
+static void submit_utterance(const ctl::vector<float> &samples) {
+    pthread_mutex_lock(&g_lock);
+    if (g_tail - g_head < MAX_PENDING_UTTERANCES) {
+        g_pending[g_tail++ % MAX_PENDING_UTTERANCES] = samples;
+        pthread_cond_signal(&g_cond);
+    } else {
+        print_status("");
+        fprintf(stderr, "warning: dropped utterance because transcription can't keep up\n");
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void *transcribe_utterances(void *arg) {
+    unassert(!pthread_join(g_model_loader, 0));
+    ctl::vector<whisper_token> prompt;
+    for (;;) {
+        pthread_mutex_lock(&g_lock);
+        while (g_head == g_tail && !g_capture_done)
+            pthread_cond_wait(&g_cond, &g_lock);
+        if (g_head == g_tail) {
+            pthread_mutex_unlock(&g_lock);
+            break;
+        }
+        const ctl::vector<float> &samples = g_pending[g_head % MAX_PENDING_UTTERANCES];
+        pthread_mutex_unlock(&g_lock);
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+        wparams.no_timestamps = true;
+        wparams.no_context = true;
+        wparams.single_segment = true;
+        wparams.suppress_non_speech_tokens = true;
+        wparams.prompt_tokens = prompt.data();
+        wparams.prompt_n_tokens = prompt.size();
+        int status = whisper_full(g_ctx, wparams, samples.data(), samples.size());
+
+        pthread_mutex_lock(&g_lock);
+        if (status) {
+            print_status("");
+            fprintf(stderr, "error: whisper failed with %d\n", status);
+        } else {
+            print_status("");
+            print_result();
+            prompt.clear();
+            int n_segments = whisper_full_n_segments(g_ctx);
+            for (int i = 0; i < n_segments; ++i) {
+                int n_tokens = whisper_full_n_tokens(g_ctx, i);
+                for (int j = 0; j < n_tokens; ++j) {
+                    whisper_token id = whisper_full_get_token_id(g_ctx, i, j);
+                    if (id < whisper_token_eot(g_ctx))
+                        prompt.push_back(id);
+                }
+            }
+            if (prompt.size() > MAX_PROMPT_TOKENS) {
+                size_t extra = prompt.size() - MAX_PROMPT_TOKENS;
+                memmove(prompt.data(), prompt.data() + extra,
+                        MAX_PROMPT_TOKENS * sizeof(whisper_token));
+                prompt.resize(MAX_PROMPT_TOKENS);
+            }
+        }
+        ++g_head;
+        pthread_mutex_unlock(&g_lock);
+    }
+    return 0;
+}
+
+// records audio until ctrl-c is pressed, then transcribes it
+static int transcribe_all(struct CosmoAudio *mic) {
+    int status;
+    ctl::vector<float> samples;
+    while (!g_done) {
+        size_t n = samples.size();
+        samples.resize(n + CHUNK_FRAMES);
+        cosmoaudio_poll(mic, (int[]){CHUNK_FRAMES}, 0);
+        cosmoaudio_read(mic, &samples[n], CHUNK_FRAMES);
+        fprintf(stderr, "\rcaptured %f seconds of audio... (press ctrl-c when done)",
+                (double)samples.size() / WHISPER_SAMPLE_RATE);
+        fflush(stderr);
+    }
+    fprintf(stderr, "\n");
+    cosmoaudio_close(mic);
+
+    // transcribe audio
+    unassert(!pthread_join(g_model_loader, 0));
+    whisper_full_params wparams =
+            whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH);
+    wparams.no_timestamps = true;
+    wparams.suppress_non_speech_tokens = true;
+    wparams.greedy.best_of = 8;
+    wparams.beam_search.beam_size = 8;
+    if ((status = whisper_full(g_ctx, wparams, samples.data(), samples.size()))) {
+        fprintf(stderr, "error: whisper failed with %d\n", status);
+        return 3;
+    }
+    print_result();
+    return 0;
+}
+
+// transcribes each utterance while recording continues
+//
+// we only hold the current utterance in memory, plus up to a fixed
+// number of utterances waiting to be transcribed, each of which is at
+// most MAX_UTTERANCE_SECONDS long. the noise floor adapts to the room
+// by following the energy of audio that isn't considered speech.
+static int transcribe_stream(struct CosmoAudio *mic) {
+    pthread_t transcriber;
+    unassert(!pthread_create(&transcriber, 0, transcribe_utterances, 0));
+    size_t preroll = VAD_PREROLL_CHUNKS * CHUNK_FRAMES;
+    size_t max_samples = MAX_UTTERANCE_SECONDS * WHISPER_SAMPLE_RATE;
+    ctl::vector<float> samples;
+    float noise = -1;
+    bool speaking = false;
+    int silent_chunks = 0;
+    int voiced_chunks = 0;
+    show_status("listening... (press ctrl-c when done)");
+    while (!g_done) {
+        size_t n = samples.size();
+        samples.resize(n + CHUNK_FRAMES);
+        cosmoaudio_poll(mic, (int[]){CHUNK_FRAMES}, 0);
+        cosmoaudio_read(mic, &samples[n], CHUNK_FRAMES);
+
+        // classify chunk as speech or silence
+        float energy = get_energy(&samples[n], CHUNK_FRAMES);
+        if (noise < 0)
+            noise = energy;
+        bool voice = energy > ctl::max(noise * VAD_THRESHOLD, VAD_MIN_ENERGY);
+        if (!voice)
+            noise += (energy - noise) * .05f;
+
+        // find where utterances begin and end
+        if (voice) {
+            if (!speaking)
+                show_status("hearing speech...");
+            speaking = true;
+            silent_chunks = 0;
+            ++voiced_chunks;
+        } else if (speaking) {
+            ++silent_chunks;
+        }
+        if (!speaking) {
+            if (samples.size() > preroll) {
+                size_t extra = samples.size() - preroll;
+                memmove(samples.data(), samples.data() + extra, preroll * sizeof(float));
+                samples.resize(preroll);
+            }
+            continue;
+        }
+        if (silent_chunks < VAD_HANGOVER_CHUNKS && samples.size() < max_samples)
+            continue;
+        if (voiced_chunks >= VAD_MIN_SPEECH_CHUNKS)
+            submit_utterance(samples);
+        show_status("listening... (press ctrl-c when done)");
+        samples.clear();
+        speaking = false;
+        silent_chunks = 0;
+        voiced_chunks = 0;
+    }
+    cosmoaudio_close(mic);
+    if (speaking && voiced_chunks >= VAD_MIN_SPEECH_CHUNKS)
+        submit_utterance(samples);
+    show_status("finishing...");
+
+    // wait for transcriber to drain queue
+    pthread_mutex_lock(&g_lock);
+    g_capture_done = true;
+    pthread_cond_signal(&g_cond);
+    pthread_mutex_unlock(&g_lock);
+    unassert(!pthread_join(transcriber, 0));
+    show_status("");
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     FLAG_gpu = LLAMAFILE_GPU_DISABLE;
     FLAG_log_disable = true;
     llamafile_check_cpu();
     ShowCrashReports();
 
-    // get argument
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s MODEL\n", argv[0]);
+    // get arguments
+    int opt;
+    bool stream = false;
+    while ((opt = getopt(argc, argv, "s")) != -1) {
+        switch (opt) {
+        case 's':
+            stream = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s] MODEL\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: %s [-s] MODEL\n", argv[0]);
         return 1;
     }
     struct stat st;
-    g_model = argv[1];
+    g_model = argv[optind];
     if (stat(g_model, &st)) {
         perror(g_model);
         return 1;
     }
 
     // detect teletypewriters
-    bool should_print_color = isatty(1) && isatty(2);
+    g_should_print_color = isatty(1) && isatty(2);
 
     // connect to microphone
     int status;
@@ -89,9 +352,8 @@ int main(int argc, char *argv[]) {
     }
 
     // load model
-    pthread_t model_loader;
     g_cparams = whisper_context_default_params();
-    unassert(!pthread_create(&model_loader, 0, load_model, 0));
+    unassert(!pthread_create(&g_model_loader, 0, load_model, 0));
 
     // setup signals
     struct sigaction sa;
@@ -100,54 +362,8 @@ int main(int argc, char *argv[]) {
     sigemptyset(&sa.sa_mask);
     sigaction(SIGINT, &sa, 0);
 
-    // record audio until ctrl-c is pressed
-    ctl::vector<float> samples;
-    while (!g_done) {
-        size_t n = samples.size();
-        samples.resize(n + CHUNK_FRAMES);
-        cosmoaudio_poll(mic, (int[]){CHUNK_FRAMES}, 0);
-        cosmoaudio_read(mic, &samples[n], CHUNK_FRAMES);
-        fprintf(stderr, "\rcaptured %f seconds of audio... (press ctrl-c when done)",
-                (double)samples.size() / WHISPER_SAMPLE_RATE);
-        fflush(stderr);
-    }
-    fprintf(stderr, "\n");
-    cosmoaudio_close(mic);
-
     // transcribe audio
-    unassert(!pthread_join(model_loader, 0));
-    whisper_full_params wparams =
-            whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH);
-    wparams.no_timestamps = true;
-    wparams.suppress_non_speech_tokens = true;
-    wparams.greedy.best_of = 8;
-    wparams.beam_search.beam_size = 8;
-    if ((status = whisper_full(g_ctx, wparams, samples.data(), samples.size()))) {
-        fprintf(stderr, "error: whisper failed with %d\n", status);
-        return 3;
-    }
-    int n_segments = whisper_full_n_segments(g_ctx);
-    for (int i = 0; i < n_segments; ++i) {
-        int n_tokens = whisper_full_n_tokens(g_ctx, i);
-        for (int j = 0; j < n_tokens; ++j) {
-            const whisper_token id = whisper_full_get_token_id(g_ctx, i, j);
-            if (id >= whisper_token_eot(g_ctx))
-                continue;
-            const char *text = whisper_full_get_token_text(g_ctx, i, j);
-            if (should_print_color) {
-                float confidence = whisper_full_get_token_p(g_ctx, i, j);
-                int colorcount = kRedToGreenXterm256.size();
-                int colorindex = powf(confidence, 3) * colorcount;
-                colorindex = ctl::max(0, ctl::min(colorcount - 1, colorindex));
-                fprintf(stderr, "%s", kRedToGreenXterm256[colorindex].c_str());
-                fflush(stderr);
-            }
-            printf("%s", text);
-            fflush(stdout);
-        }
-    }
-    if (should_print_color)
-        fprintf(stderr, "\033[0m");
-    printf("\n");
+    int rc = stream ? transcribe_stream(mic) : transcribe_all(mic);
     whisper_free(g_ctx);
+    return rc;
 }
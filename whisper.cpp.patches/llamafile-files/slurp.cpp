@@ -6,12 +6,20 @@
 #include "llamafile/log.h"
 #include <math.h>
 
-static int get_audio_file_channels(const char *fname) {
+// opens `data` if it's non-null, otherwise the file named `name`
+static ma_result open_audio(const char *name, const void *data, size_t size,
+                            const ma_decoder_config *config, ma_decoder *decoder) {
+    if (data)
+        return ma_decoder_init_memory(data, size, config, decoder);
+    return ma_decoder_init_file(name, config, decoder);
+}
+
+static int get_audio_channels(const char *name, const void *data, size_t size) {
     ma_decoder decoder;
-    ma_result rc = ma_decoder_init_file(fname, NULL, &decoder);
+    ma_result rc = open_audio(name, data, size, NULL, &decoder);
     if (rc != MA_SUCCESS) {
         tinylogf("%s: failed to open audio file: %s (we support .wav, .mp3, .flac, and .ogg)\n",
-                 fname, ma_result_description(rc));
+                 name, ma_result_description(rc));
         return -1;
     }
     int channels = decoder.outputChannels;
@@ -19,33 +27,51 @@ static int get_audio_file_channels(const char *fname) {
     return channels;
 }
 
-/**
- * Reads entire pulse-code modulation content of audio file into memory.
- *
- * This function reads raw audio data from an MP3/WAV/OGG/FLAC file into
- * `pcmf32` at the `COMMON_SAMPLE_RATE`. Resampling, channel mixing, and
- * data type conversions will be performed as necessary.
- *
- * If `stereo` is true, then `pcmf32s` will also be populated with two
- * vectors, holding the left and right audio channels, and `pcmf32` will
- * receive their mixture. If the audio file does not have two or more
- * channels, then an error is returned.
- *
- * The output vectors are not cleared. Therefore this function may be
- * called multiple times to append audio files.
- */
-bool slurp_audio_file(const char *fname,
-                      std::vector<float> &pcmf32,
-                      std::vector<std::vector<float>> &pcmf32s,
-                      bool stereo) {
+// appends all remaining interleaved frames of decoder to `out`
+//
+// the length reported by the decoder is used to size the vector so the
+// audio can usually be decoded by a single read. it's only an estimate
+// once resampling is involved, so we keep reading until the decoder is
+// at the end.
+static bool read_audio_frames(const char *name, ma_decoder *decoder, std::vector<float> &out) {
+    size_t channels = decoder->outputChannels;
+    size_t total = out.size();
+    ma_uint64 length = 0;
+    ma_decoder_get_length_in_pcm_frames(decoder, &length);
+    ma_uint64 want = length ? length + 1 : 65536;
+    for (;;) {
+        ma_uint64 got = 0;
+        out.resize(total + want * channels);
+        ma_result rc = ma_decoder_read_pcm_frames(decoder, &out[total], want, &got);
+        total += got * channels;
+        if (rc != MA_SUCCESS && rc != MA_AT_END) {
+            out.resize(total);
+            tinylogf("%s: failed to read pcm frames from audio file: %s\n",
+                     name, ma_result_description(rc));
+            return false;
+        }
+        if (rc == MA_AT_END || got < want)
+            break;
+        want = 65536;
+    }
+    out.resize(total);
+    return true;
+}
+
+static bool slurp_audio(const char *name,
+                        const void *data,
+                        size_t size,
+                        std::vector<float> &pcmf32,
+                        std::vector<std::vector<float>> &pcmf32s,
+                        bool stereo) {
 
     // validate stereo is stereo
     if (stereo) {
-        int channels = get_audio_file_channels(fname);
+        int channels = get_audio_channels(name, data, size);
         if (channels == -1)
             return false;
         if (channels < 2) {
-            tinylogf("%s: audio file is mono when stereo is required\n", fname);
+            tinylogf("%s: audio file is mono when stereo is required\n", name);
             return false;
         }
     }
@@ -56,55 +82,84 @@ bool slurp_audio_file(const char *fname,
     decoderConfig.resampling.algorithm = ma_resample_algorithm_linear;
     decoderConfig.resampling.linear.lpfOrder = 8;
 
-    // open input file
+    // open input
     ma_decoder decoder;
-    ma_result rc = ma_decoder_init_file(fname, &decoderConfig, &decoder);
+    ma_result rc = open_audio(name, data, size, &decoderConfig, &decoder);
     if (rc != MA_SUCCESS) {
         tinylogf("%s: failed to open audio file: %s (we support .wav, .mp3, .flac, and .ogg)\n",
-                 fname, ma_result_description(rc));
+                 name, ma_result_description(rc));
         return false;
     }
 
     // load pulse-code modulation samples
+    bool ok;
     if (!stereo) {
-        ma_uint64 total = pcmf32.size();
-        ma_uint64 want = 512;
-        ma_uint64 got;
-        do {
-            pcmf32.resize(total + want);
-            rc = ma_decoder_read_pcm_frames(&decoder, &pcmf32[total], want, &got);
-            if (rc != MA_SUCCESS) {
-                ma_decoder_uninit(&decoder);
-                tinylogf("%s: failed to read pcm frames from audio file: %s\total",
-                         fname, ma_result_description(rc));
-                return false;
-            }
-            pcmf32.resize((total += got));
-        } while (got == want);
+        ok = read_audio_frames(name, &decoder, pcmf32);
     } else {
-        float frames[512];
-        ma_uint64 want = sizeof(frames) / sizeof(*frames) / 2;
-        ma_uint64 got;
-        pcmf32s.resize(2);
-        do {
-            rc = ma_decoder_read_pcm_frames(&decoder, frames, want, &got);
-            if (rc != MA_SUCCESS) {
-                ma_decoder_uninit(&decoder);
-                tinylogf("%s: failed to read pcm frames from audio file: %s\n",
-                         fname, ma_result_description(rc));
-                return false;
-            }
-            for (int i = 0; i < got; ++i) {
+        std::vector<float> frames;
+        if ((ok = read_audio_frames(name, &decoder, frames))) {
+            size_t n = frames.size() / 2;
+            size_t total = pcmf32.size();
+            pcmf32s.resize(2);
+            pcmf32.resize(total + n);
+            pcmf32s[0].resize(pcmf32s[0].size() + n);
+            pcmf32s[1].resize(pcmf32s[1].size() + n);
+            float *mix = &pcmf32[total];
+            float *lefts = &pcmf32s[0][pcmf32s[0].size() - n];
+            float *rights = &pcmf32s[1][pcmf32s[1].size() - n];
+            for (size_t i = 0; i < n; ++i) {
                 float left = frames[i*2+0];
                 float right = frames[i*2+1];
-                pcmf32.push_back(sqrtf((left*left + right*right) / 2));
-                pcmf32s[0].push_back(left);
-                pcmf32s[1].push_back(right);
+                mix[i] = sqrtf((left*left + right*right) / 2);
+                lefts[i] = left;
+                rights[i] = right;
             }
-        } while (got == want);
+        }
     }
 
     // we're done
     ma_decoder_uninit(&decoder);
-    return true;
+    return ok;
+}
+
+/**
+ * Reads entire pulse-code modulation content of audio file into memory.
+ *
+ * This function reads raw audio data from an MP3/WAV/OGG/FLAC file into
+ * `pcmf32` at the `COMMON_SAMPLE_RATE`. Resampling, channel mixing, and
+ * data type conversions will be performed as necessary.
+ *
+ * If `stereo` is true, then `pcmf32s` will also be populated with two
+ * vectors, holding the left and right audio channels, and `pcmf32` will
+ * receive their mixture. If the audio file does not have two or more
+ * channels, then an error is returned.
+ *
+ * The output vectors are not cleared. Therefore this function may be
+ * called multiple times to append audio files.
+ */
+bool slurp_audio_file(const char *fname,
+                      std::vector<float> &pcmf32,
+                      std::vector<std::vector<float>> &pcmf32s,
+                      bool stereo) {
+    return slurp_audio(fname, NULL, 0, pcmf32, pcmf32s, stereo);
+}
+
+/**
+ * Decodes audio file content that's already in memory.
+ *
+ * This works the same way as slurp_audio_file() except the encoded file
+ * is read from `data`, which is useful for decoding an HTTP request body
+ * without writing it to disk first. The `name` is only used for logging.
+ */
+bool slurp_audio_memory(const char *name,
+                        const void *data,
+                        size_t size,
+                        std::vector<float> &pcmf32,
+                        std::vector<std::vector<float>> &pcmf32s,
+                        bool stereo) {
+    if (!size) {
+        tinylogf("%s: audio file is empty\n", name);
+        return false;
+    }
+    return slurp_audio(name, data, size, pcmf32, pcmf32s, stereo);
 }
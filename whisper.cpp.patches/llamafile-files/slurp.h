@@ -6,3 +6,10 @@ bool slurp_audio_file(const char *fname,
                       std::vector<float> &pcmf32,
                       std::vector<std::vector<float>> &pcmf32s,
                       bool stereo);
+
+bool slurp_audio_memory(const char *name,
+                        const void *data,
+                        size_t size,
+                        std::vector<float> &pcmf32,
+                        std::vector<std::vector<float>> &pcmf32s,
+                        bool stereo);
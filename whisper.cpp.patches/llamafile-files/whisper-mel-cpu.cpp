@@ -0,0 +1,356 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "whisper-mel-cpu.hpp"
+#include "whisper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "llama.cpp/ggml.h"
+#include "llamafile/sgemm.h"
+
+// log mel spectrogram on cpu
+//
+// upstream computes a scalar fft of each 25ms frame of audio, and then
+// multiplies the power spectrum by the mel filterbank one dot product
+// at a time. we instead transform eight frames at once, where each simd
+// lane holds a different frame, so every butterfly is a vector op. the
+// 400 point real fft is computed as a 200 point complex fft, using the
+// mixed radix 4*5*5*2 stockham algorithm which needs no bit reversal.
+// the power spectra of a block of frames are then projected onto the
+// mel filters as a matrix multiplication using tinyBLAS.
+
+#define LANES 8 // frames per fft
+#define BLOCK 64 // frames per matmul
+#define N_HALF (WHISPER_N_FFT / 2)
+#define N_BINS (N_HALF + 1)
+#define N_BINS_PAD ((N_BINS + 15) & -16)
+
+typedef float vfloat __attribute__((__vector_size__(LANES * sizeof(float))));
+
+namespace {
+
+struct fft_stage {
+    int radix;
+    int n; // length of subsequences being transformed
+    int s; // stride between them
+    std::vector<float> wr; // twiddle factors indexed by p*radix+u
+    std::vector<float> wi;
+};
+
+struct fft_plan {
+    std::vector<fft_stage> stages;
+    float pr[N_BINS]; // twiddles for splitting the real fft
+    float pi[N_BINS];
+
+    fft_plan() {
+        int n = N_HALF;
+        int s = 1;
+        for (int radix : {4, 5, 5, 2}) {
+            fft_stage st;
+            st.radix = radix;
+            st.n = n;
+            st.s = s;
+            for (int p = 0; p < n / radix; ++p) {
+                for (int u = 0; u < radix; ++u) {
+                    double theta = -2 * M_PI * p * u / n;
+                    st.wr.push_back(cos(theta));
+                    st.wi.push_back(sin(theta));
+                }
+            }
+            stages.push_back(std::move(st));
+            n /= radix;
+            s *= radix;
+        }
+        for (int k = 0; k < N_BINS; ++k) {
+            double theta = -2 * M_PI * k / WHISPER_N_FFT;
+            pr[k] = cos(theta);
+            pi[k] = sin(theta);
+        }
+    }
+};
+
+const fft_plan g_plan;
+
+// computes dft of R complex vectors in place
+template <int R>
+inline void butterfly(vfloat * ar, vfloat * ai) {
+    if constexpr (R == 2) {
+        vfloat tr = ar[0] - ar[1];
+        vfloat ti = ai[0] - ai[1];
+        ar[0] += ar[1];
+        ai[0] += ai[1];
+        ar[1] = tr;
+        ai[1] = ti;
+    } else if constexpr (R == 4) {
+        vfloat s0r = ar[0] + ar[2], s0i = ai[0] + ai[2];
+        vfloat d0r = ar[0] - ar[2], d0i = ai[0] - ai[2];
+        vfloat s1r = ar[1] + ar[3], s1i = ai[1] + ai[3];
+        vfloat d1r = ar[1] - ar[3], d1i = ai[1] - ai[3];
+        ar[0] = s0r + s1r, ai[0] = s0i + s1i;
+        ar[1] = d0r + d1i, ai[1] = d0i - d1r;
+        ar[2] = s0r - s1r, ai[2] = s0i - s1i;
+        ar[3] = d0r - d1i, ai[3] = d0i + d1r;
+    } else if constexpr (R == 5) {
+        const float c1 = 0.30901699437494742f; // cos(2π/5)
+        const float c2 = -0.80901699437494742f; // cos(4π/5)
+        const float s1 = 0.95105651629515357f; // sin(2π/5)
+        const float s2 = 0.58778525229247313f; // sin(4π/5)
+        vfloat t1r = ar[1] + ar[4], t1i = ai[1] + ai[4];
+        vfloat t2r = ar[2] + ar[3], t2i = ai[2] + ai[3];
+        vfloat t3r = ar[1] - ar[4], t3i = ai[1] - ai[4];
+        vfloat t4r = ar[2] - ar[3], t4i = ai[2] - ai[3];
+        vfloat b1r = ar[0] + c1 * t1r + c2 * t2r, b1i = ai[0] + c1 * t1i + c2 * t2i;
+        vfloat b2r = ar[0] + c2 * t1r + c1 * t2r, b2i = ai[0] + c2 * t1i + c1 * t2i;
+        vfloat d1r = s1 * t3r + s2 * t4r, d1i = s1 * t3i + s2 * t4i;
+        vfloat d2r = s2 * t3r - s1 * t4r, d2i = s2 * t3i - s1 * t4i;
+        ar[0] += t1r + t2r, ai[0] += t1i + t2i;
+        ar[1] = b1r + d1i, ai[1] = b1i - d1r;
+        ar[4] = b1r - d1i, ai[4] = b1i + d1r;
+        ar[2] = b2r + d2i, ai[2] = b2i - d2r;
+        ar[3] = b2r - d2i, ai[3] = b2i + d2r;
+    }
+}
+
+// performs one decimation in frequency stockham pass from x to y
+template <int R>
+void fft_pass(const fft_stage & st, const vfloat * xr, const vfloat * xi, vfloat * yr,
+              vfloat * yi) {
+    const int m = st.n / R;
+    const int s = st.s;
+    for (int p = 0; p < m; ++p) {
+        const float * wr = &st.wr[p * R];
+        const float * wi = &st.wi[p * R];
+        for (int q = 0; q < s; ++q) {
+            vfloat ar[R];
+            vfloat ai[R];
+            for (int t = 0; t < R; ++t) {
+                ar[t] = xr[q + s * (p + t * m)];
+                ai[t] = xi[q + s * (p + t * m)];
+            }
+            butterfly<R>(ar, ai);
+            yr[q + s * R * p] = ar[0];
+            yi[q + s * R * p] = ai[0];
+            for (int u = 1; u < R; ++u) {
+                yr[q + s * (R * p + u)] = ar[u] * wr[u] - ai[u] * wi[u];
+                yi[q + s * (R * p + u)] = ar[u] * wi[u] + ai[u] * wr[u];
+            }
+        }
+    }
+}
+
+struct mel_calc_fast : public whisper_mel_calc {
+    ggml_backend_t m_backend;
+    int m_n_mel;
+    std::vector<float> m_filters; // n_mel rows of N_BINS_PAD
+
+    mel_calc_fast(ggml_backend_t backend, const whisper_filters & filters)
+        : m_backend(backend), m_n_mel(filters.n_mel), m_filters(filters.n_mel * N_BINS_PAD) {
+        GGML_ASSERT(filters.n_fft == N_BINS);
+        for (int j = 0; j < m_n_mel; ++j)
+            std::copy(filters.data.begin() + j * N_BINS, filters.data.begin() + (j + 1) * N_BINS,
+                      m_filters.begin() + j * N_BINS_PAD);
+    }
+
+    // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L110-L157
+    whisper_mel calculate(whisper_span<const float> ssamples, int n_threads) override {
+        // audio is reflect padded by 200 samples at the beginning, and
+        // zero padded by 200 samples plus 30 seconds at the end, which
+        // we do on the fly rather than copying the samples
+        const int64_t stage_1_pad = WHISPER_SAMPLE_RATE * 30;
+        const int64_t stage_2_pad = WHISPER_N_FFT / 2;
+        const int n_samples = ssamples.len;
+        const int n_len = (n_samples + stage_1_pad) / WHISPER_HOP_LENGTH;
+        const int n_len_org = 1 + (n_samples + stage_2_pad - WHISPER_N_FFT) / WHISPER_HOP_LENGTH;
+
+        whisper_mel ret;
+        whisper_mel_init(ret, m_backend, n_len, n_len_org, m_n_mel);
+        std::vector<float> host_mel_data;
+        float * mel;
+        if (ggml_backend_buffer_is_host(ret.buffer)) {
+            mel = (float *)ret.tensor->data;
+        } else {
+            host_mel_data.resize((size_t)n_len * m_n_mel);
+            mel = host_mel_data.data();
+        }
+
+        // frames past the end of the audio only see zeros
+        const int n_frames =
+            std::min(int((n_samples + stage_2_pad) / WHISPER_HOP_LENGTH + 1), n_len);
+        const int n_blocks = (n_frames + BLOCK - 1) / BLOCK;
+        n_threads = std::max(1, std::min(n_threads, n_blocks));
+        std::atomic_int next_block(0);
+        std::vector<float> maxes(n_threads, log10f(1e-10f));
+        auto worker = [&](int ith) {
+            maxes[ith] = compute(ssamples.data, n_samples, mel, n_len, n_frames, n_blocks,
+                                 &next_block);
+        };
+        std::vector<std::thread> workers;
+        for (int i = 1; i < n_threads; ++i)
+            workers.emplace_back(worker, i);
+        worker(0);
+        for (std::thread & th : workers)
+            th.join();
+
+        // clamping and normalization
+        const float silence = log10f(1e-10f);
+        float mmax = *std::max_element(maxes.begin(), maxes.end()) - 8;
+        for (int j = 0; j < m_n_mel; ++j) {
+            float * row = mel + (size_t)j * n_len;
+            for (int i = 0; i < n_frames; ++i)
+                row[i] = (std::max(row[i], mmax) + 4) / 4;
+            std::fill(row + n_frames, row + n_len, (std::max(silence, mmax) + 4) / 4);
+        }
+
+        if (!host_mel_data.empty()) {
+            // the ret buffer isn't host accessible, so upload our temporary buffer
+            ggml_backend_tensor_set(ret.tensor, host_mel_data.data(), 0, ggml_nbytes(ret.tensor));
+        }
+
+        return ret;
+    }
+
+  private:
+    // computes log mel of blocks of frames claimed from `next_block`
+    // and returns the greatest value this thread wrote to `mel`
+    float compute(const float * samples, int n_samples, float * mel, int n_len, int n_frames,
+                  int n_blocks, std::atomic_int * next_block) {
+        vfloat xr[N_HALF];
+        vfloat xi[N_HALF];
+        vfloat yr[N_HALF];
+        vfloat yi[N_HALF];
+        float frame[WHISPER_N_FFT];
+        const float * hann = hann_window().data;
+        std::vector<float> power(BLOCK * N_BINS_PAD);
+        float mmax = log10f(1e-10f);
+        for (int b; (b = (*next_block)++) < n_blocks;) {
+            int f0 = b * BLOCK;
+            int nf = std::min(BLOCK, n_frames - f0);
+
+            // compute power spectrum of frames
+            for (int fb = 0; fb < nf; fb += LANES) {
+                for (int l = 0; l < LANES; ++l) {
+                    if (fb + l < nf) {
+                        load_frame(frame, samples, n_samples, (f0 + fb + l) * WHISPER_HOP_LENGTH,
+                                   hann);
+                    } else {
+                        std::fill(frame, frame + WHISPER_N_FFT, 0.f);
+                    }
+                    for (int n = 0; n < N_HALF; ++n) {
+                        xr[n][l] = frame[2 * n + 0];
+                        xi[n][l] = frame[2 * n + 1];
+                    }
+                }
+                fft(xr, xi, yr, yi);
+                for (int k = 0; k < N_BINS; ++k) {
+                    // untangle real fft of frame from complex fft of its even and odd samples
+                    int k1 = k % N_HALF;
+                    int k2 = (N_HALF - k) % N_HALF;
+                    vfloat er = xr[k1] + xr[k2];
+                    vfloat ei = xi[k1] - xi[k2];
+                    vfloat or_ = xi[k1] + xi[k2];
+                    vfloat oi = xr[k2] - xr[k1];
+                    vfloat re = er + or_ * g_plan.pr[k] - oi * g_plan.pi[k];
+                    vfloat im = ei + oi * g_plan.pr[k] + or_ * g_plan.pi[k];
+                    vfloat pw = (re * re + im * im) * .25f;
+                    for (int l = 0; l < LANES && fb + l < nf; ++l)
+                        power[(fb + l) * N_BINS_PAD + k] = pw[l];
+                }
+            }
+
+            // project onto mel filterbank
+            float * C = mel + f0;
+            if (!llamafile_sgemm(nf, m_n_mel, N_BINS_PAD, power.data(), N_BINS_PAD,
+                                 m_filters.data(), N_BINS_PAD, C, n_len, 0, 1, GGML_TYPE_F32,
+                                 GGML_TYPE_F32, GGML_TYPE_F32)) {
+                for (int j = 0; j < m_n_mel; ++j) {
+                    const float * filter = &m_filters[j * N_BINS_PAD];
+                    for (int i = 0; i < nf; ++i) {
+                        const float * pw = &power[i * N_BINS_PAD];
+                        float sum = 0;
+                        for (int k = 0; k < N_BINS; ++k)
+                            sum += pw[k] * filter[k];
+                        C[(size_t)j * n_len + i] = sum;
+                    }
+                }
+            }
+            for (int j = 0; j < m_n_mel; ++j) {
+                float * row = C + (size_t)j * n_len;
+                for (int i = 0; i < nf; ++i) {
+                    row[i] = log10f(std::max(row[i], 1e-10f));
+                    mmax = std::max(mmax, row[i]);
+                }
+            }
+        }
+        return mmax;
+    }
+
+    // computes fft of x in place using y as scratch space
+    static void fft(vfloat * xr, vfloat * xi, vfloat * yr, vfloat * yi) {
+        for (const fft_stage & st : g_plan.stages) {
+            switch (st.radix) {
+            case 2:
+                fft_pass<2>(st, xr, xi, yr, yi);
+                break;
+            case 4:
+                fft_pass<4>(st, xr, xi, yr, yi);
+                break;
+            case 5:
+                fft_pass<5>(st, xr, xi, yr, yi);
+                break;
+            default:
+                __builtin_unreachable();
+            }
+            std::swap(xr, yr);
+            std::swap(xi, yi);
+        }
+        static_assert(N_HALF == 4 * 5 * 5 * 2, "even number of passes leaves result in x");
+    }
+
+    // loads windowed frame starting at `offset` of the padded audio
+    static void load_frame(float * frame, const float * samples, int n_samples, int offset,
+                           const float * hann) {
+        int start = offset - WHISPER_N_FFT / 2;
+        if (start >= 0 && start + WHISPER_N_FFT <= n_samples) {
+            for (int j = 0; j < WHISPER_N_FFT; ++j)
+                frame[j] = hann[j] * samples[start + j];
+            return;
+        }
+        for (int j = 0; j < WHISPER_N_FFT; ++j) {
+            int i = start + j;
+            float x = 0;
+            if (i < 0) {
+                if (-i < n_samples)
+                    x = samples[-i];
+            } else if (i < n_samples) {
+                x = samples[i];
+            }
+            frame[j] = hann[j] * x;
+        }
+    }
+};
+
+} // namespace
+
+whisper_mel_calc * whisper_mel_calc_create_cpu(ggml_backend_t backend,
+                                               const whisper_filters & filters) {
+    return new mel_calc_fast(backend, filters);
+}
@@ -0,0 +1,3 @@
+#include "whisper-mel.hpp"
+
+whisper_mel_calc * whisper_mel_calc_create_cpu(ggml_backend_t backend, const whisper_filters & filters);